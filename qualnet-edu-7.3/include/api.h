@@ -909,6 +909,12 @@ enum
 	MSG_APP_UP_PathTimer,
 	MSG_APP_UP_PathStopTimeout,
 	MSG_APP_UP_TerminationTimer,
+	MSG_APP_UP_ReplanResult,
+	MSG_APP_UP_FromMacRateHint,
+	MSG_APP_UP_FromMacLinkLost,
+	MSG_APP_UP_RetryTimer,
+	MSG_APP_UP_AbstractLinkTimer,
+	MSG_APP_UP_HandoffTimer,
 
     /*
      * Any other message types which have to be added should be added before
@@ -502,6 +502,9 @@ struct AppData
     AppTrafficSender* appTrafficSender;
 
     void* msdpData;
+
+    // Modifications
+    void* upData;
 };
 
 #define APP_TIMER_SEND_PKT     (1)  /* for sending a packet */
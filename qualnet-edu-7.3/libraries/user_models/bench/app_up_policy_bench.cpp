@@ -0,0 +1,364 @@
+// Microbenchmark of the UP chunk selection policies and the re-planner
+//
+// Drives every registered policy over synthetic chunk sets and reports
+// time and heap allocations per decision. Then re-plans synthetic
+// snapshots of up to BENCH_PLAN_CHUNKS_MAX chunks and checks that
+// no AP is planned over its capacity. Usage:
+//
+//   up_policy_bench [maxChunks] [maxNsPerChunk]
+//
+// With maxNsPerChunk given, exits with 1 if any policy run needs more
+// time per decision and chunk, so the benchmark can gate regressions.
+// Exits with 1 if a plan breaks capacity.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <new>
+#include <map>
+
+#include "app_up_policy.h"
+
+static long long benchAllocCount = 0;
+static long long benchAllocBytes = 0;
+
+// Every replaced operator goes through this pair, so that allocation
+// and release are matched for the compiler as well
+static void* BenchAlloc(size_t size) {
+	void* ptr = malloc(size > 0 ? size : 1);
+
+	if(ptr == NULL) throw std::bad_alloc();
+	++benchAllocCount;
+	benchAllocBytes += size;
+	return ptr;
+}
+
+static void BenchFree(void* ptr) {
+	free(ptr);
+}
+
+void* operator new(size_t size) {
+	return BenchAlloc(size);
+}
+
+void* operator new[](size_t size) {
+	return BenchAlloc(size);
+}
+
+void operator delete(void* ptr) noexcept {
+	BenchFree(ptr);
+}
+
+void operator delete[](void* ptr) noexcept {
+	BenchFree(ptr);
+}
+
+void operator delete(void* ptr, size_t) noexcept {
+	BenchFree(ptr);
+}
+
+void operator delete[](void* ptr, size_t) noexcept {
+	BenchFree(ptr);
+}
+
+const double BENCH_CURRENT_TIME = 1000.0; // Seconds
+const int BENCH_CHUNK_VISITS = 2000000; // Per run, bounds decisions
+const int BENCH_DECISIONS_MIN = 5;
+const int BENCH_PLAN_CHUNKS_MAX = 100000;
+const int BENCH_PLAN_REPEAT = 5;
+const double BENCH_PLAN_LOAD = 1.25; // Chunk KB over total AP capacity
+
+typedef struct struct_bench_scenario {
+	int         numChunks;
+	int         numAps; // Plan spreads chunks over this many APs
+	int         numHistory; // APs already visited
+} BenchScenario;
+
+typedef struct struct_bench_data {
+	AppUpClientDaemonDataChunkStr* chunks;
+	std::map<int, int> plan;
+	std::map<int, AppUpAccessPointSpec*> specs;
+	std::map<int, float> historyRates;
+} BenchData;
+
+static double BenchNow() {
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static double BenchUniform(double l, double r) {
+	return l + (r - l) * (rand() / (RAND_MAX + 1.0));
+}
+
+static void BenchSetup(BenchData* data, const BenchScenario& scenario) {
+	int i;
+
+	srand(scenario.numChunks * 31 + scenario.numAps * 7
+			+ scenario.numHistory);
+	data->chunks = new AppUpClientDaemonDataChunkStr[scenario.numChunks];
+	for(i = 0; i < scenario.numChunks; i++) {
+		AppUpClientDaemonDataChunkStr* chunk = &data->chunks[i];
+
+		chunk->identifier = i + 1;
+		chunk->size = (int)BenchUniform(100, 10000);
+		chunk->deadline = (int)(BENCH_CURRENT_TIME + BenchUniform(0, 3600));
+		// Coarse priorities so that ties are common
+		chunk->priority = (int)BenchUniform(0, 10) / 10.0;
+		chunk->dirty = 0;
+		chunk->partial = 0;
+		chunk->sizeDone = 0;
+		chunk->sizeSegment = 0;
+		chunk->next = i + 1 < scenario.numChunks ? &data->chunks[i + 1] : NULL;
+		data->plan[chunk->identifier] = 1 + i % scenario.numAps;
+	}
+	for(i = 1; i <= scenario.numAps + scenario.numHistory; i++) {
+		AppUpAccessPointSpec* spec = new AppUpAccessPointSpec;
+
+		spec->estRate = (int)BenchUniform(200, 800);
+		spec->estCompTime = BENCH_CURRENT_TIME + BenchUniform(30, 120);
+		data->specs[i] = spec;
+	}
+	// Visited APs are numbered after those still ahead
+	for(i = 0; i < scenario.numHistory; i++) {
+		int aId = scenario.numAps + 1 + i;
+
+		data->historyRates[aId] =
+				data->specs[aId]->estRate * BenchUniform(0.5, 1.5);
+	}
+}
+
+static void BenchTeardown(BenchData* data) {
+	for(std::map<int, AppUpAccessPointSpec*>::iterator it =
+				data->specs.begin();
+			it != data->specs.end();
+			++it) {
+		delete it->second;
+	}
+	delete[] data->chunks;
+	data->plan.clear();
+	data->specs.clear();
+	data->historyRates.clear();
+}
+
+/*
+ * Returns ns per decision, chosen chunks are marked finished so that
+ * consecutive decisions walk through the chunk set
+ */
+static double BenchRun(
+		const AppUpPolicyEntry* entry,
+		const BenchScenario& scenario,
+		int numDecisions,
+		double* allocsPerDecision,
+		double* bytesPerDecision) {
+	BenchData data;
+	AppUpPolicyState state;
+	long long allocCount;
+	long long allocBytes;
+	double elapsed = 0.0;
+	double start;
+	int chunkId;
+	int i;
+
+	BenchSetup(&data, scenario);
+	state.dataChunks = data.chunks;
+	state.plan = &data.plan;
+	state.specs = &data.specs;
+	state.historyRates = &data.historyRates;
+	state.joinedAId = 1;
+	state.currentRate = data.specs[1]->estRate;
+	state.currentTime = BENCH_CURRENT_TIME;
+	state.estCompTime = data.specs[1]->estCompTime;
+	state.segmentSize = 0;
+	state.atLastA = scenario.numAps == 1;
+
+	allocCount = benchAllocCount;
+	allocBytes = benchAllocBytes;
+	for(i = 0; i < numDecisions; i++) {
+		start = BenchNow();
+		chunkId = entry->func(&state);
+		elapsed += BenchNow() - start;
+
+		if(chunkId > 0) {
+			data.chunks[chunkId - 1].dirty |= 2;
+		} else { // Nothing left here, move on to next AP
+			state.joinedAId = state.joinedAId % scenario.numAps + 1;
+			state.currentRate = data.specs[state.joinedAId]->estRate;
+			state.estCompTime = data.specs[state.joinedAId]->estCompTime;
+			state.atLastA = state.joinedAId == scenario.numAps;
+		}
+	}
+	*allocsPerDecision = (double)(benchAllocCount - allocCount) / numDecisions;
+	*bytesPerDecision = (double)(benchAllocBytes - allocBytes) / numDecisions;
+
+	BenchTeardown(&data);
+	return elapsed / numDecisions;
+}
+
+static void BenchPlanSetup(
+		AppUpPlanSnapshot* snapshot,
+		int numChunks,
+		int numAps) {
+	double sizeTotal = 0.0;
+	int i;
+
+	srand(numChunks * 17 + numAps);
+	snapshot->currentTime = BENCH_CURRENT_TIME;
+	snapshot->chunks.resize(numChunks);
+	for(i = 0; i < numChunks; i++) {
+		AppUpPlanChunk* chunk = &snapshot->chunks[i];
+
+		chunk->identifier = i + 1;
+		chunk->sizeLeft = (int)BenchUniform(100, 10000);
+		chunk->deadline = (int)(BENCH_CURRENT_TIME + BenchUniform(0, 3600));
+		chunk->priority = (int)BenchUniform(0, 10) / 10.0;
+		chunk->planAId = 1 + i % numAps;
+		sizeTotal += chunk->sizeLeft;
+	}
+	// Over-subscribed, so that repair and eviction are exercised
+	snapshot->aps.resize(numAps);
+	for(i = 0; i < numAps; i++) {
+		AppUpPlanAccessPoint* ap = &snapshot->aps[i];
+
+		ap->aId = i + 1;
+		ap->capacity = sizeTotal / BENCH_PLAN_LOAD / numAps
+				* BenchUniform(0.5, 1.5);
+		ap->compTime = BENCH_CURRENT_TIME + 60.0 * (i + 1);
+	}
+}
+
+/*
+ * Returns ns per plan, sets overloaded to the number of APs planned over
+ * capacity and unplanned to the number of chunks planned nowhere
+ */
+static double BenchPlanRun(
+		int numChunks,
+		int numAps,
+		int* overloaded,
+		int* unplanned) {
+	AppUpPlanSnapshot snapshot;
+	std::map<int, int> plan;
+	std::map<int, double> load;
+	double elapsed = 0.0;
+	double start;
+	int i;
+
+	BenchPlanSetup(&snapshot, numChunks, numAps);
+	for(i = 0; i < BENCH_PLAN_REPEAT; i++) {
+		plan.clear();
+		start = BenchNow();
+		AppUpPlanCompute(&snapshot, &plan);
+		elapsed += BenchNow() - start;
+	}
+
+	*overloaded = 0;
+	*unplanned = 0;
+	for(i = 0; i < numChunks; i++) {
+		const AppUpPlanChunk& chunk = snapshot.chunks[i];
+
+		if(plan[chunk.identifier] < 1) {
+			++*unplanned;
+		} else {
+			load[plan[chunk.identifier]] += chunk.sizeLeft;
+		}
+	}
+	for(i = 0; i < numAps; i++) {
+		if(load[snapshot.aps[i].aId] > snapshot.aps[i].capacity) {
+			++*overloaded;
+		}
+	}
+	return elapsed / BENCH_PLAN_REPEAT;
+}
+
+int main(int argc, char** argv) {
+	int maxChunks = 1000000;
+	double maxNsPerChunk = 0.0;
+	int numAps[] = {1, 8, 64};
+	int numHistory[] = {0, 32};
+	bool failed = false;
+
+	if(argc > 1) maxChunks = atoi(argv[1]);
+	if(argc > 2) maxNsPerChunk = atof(argv[2]);
+
+	printf("%-12s %8s %4s %4s %9s %14s %12s %12s\n",
+			"policy", "chunks", "aps", "hist", "decisions",
+			"ns/decision", "allocs/dec", "bytes/dec");
+	for(int numChunks = 100; numChunks <= maxChunks; numChunks *= 10) {
+		int numDecisions = BENCH_CHUNK_VISITS / numChunks;
+
+		if(numDecisions < BENCH_DECISIONS_MIN) {
+			numDecisions = BENCH_DECISIONS_MIN;
+		}
+		for(size_t a = 0; a < sizeof(numAps) / sizeof(numAps[0]); a++) {
+			for(size_t h = 0;
+					h < sizeof(numHistory) / sizeof(numHistory[0]);
+					h++) {
+				BenchScenario scenario;
+
+				scenario.numChunks = numChunks;
+				scenario.numAps = numAps[a];
+				scenario.numHistory = numHistory[h];
+				for(const AppUpPolicyEntry* entry = APP_UP_POLICIES;
+						entry->name;
+						++entry) {
+					double allocs;
+					double bytes;
+					double ns = BenchRun(
+							entry,
+							scenario,
+							numDecisions,
+							&allocs,
+							&bytes);
+
+					printf("%-12s %8d %4d %4d %9d %14.1f %12.2f %12.1f\n",
+							entry->name,
+							scenario.numChunks,
+							scenario.numAps,
+							scenario.numHistory,
+							numDecisions,
+							ns,
+							allocs,
+							bytes);
+					if(maxNsPerChunk > 0 && ns / numChunks > maxNsPerChunk) {
+						printf("%-12s exceeds %.2f ns per chunk\n",
+								entry->name,
+								maxNsPerChunk);
+						failed = true;
+					}
+				}
+			}
+		}
+	}
+
+	printf("\n%-12s %8s %4s %14s %10s %10s\n",
+			"plan", "chunks", "aps", "ns/plan", "overloaded", "unplanned");
+	for(int numChunks = 100;
+			numChunks <= maxChunks && numChunks <= BENCH_PLAN_CHUNKS_MAX;
+			numChunks *= 10) {
+		for(size_t a = 0; a < sizeof(numAps) / sizeof(numAps[0]); a++) {
+			int overloaded;
+			int unplanned;
+			double ns = BenchPlanRun(
+					numChunks,
+					numAps[a],
+					&overloaded,
+					&unplanned);
+
+			printf("%-12s %8d %4d %14.1f %10d %10d\n",
+					"GREEDY_SWAP",
+					numChunks,
+					numAps[a],
+					ns,
+					overloaded,
+					unplanned);
+			if(overloaded > 0) {
+				printf("%-12s plans %d APs over capacity\n",
+						"GREEDY_SWAP",
+						overloaded);
+				failed = true;
+			}
+		}
+	}
+	return failed ? 1 : 0;
+}
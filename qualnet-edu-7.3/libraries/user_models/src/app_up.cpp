@@ -4,9 +4,11 @@
 #include <time.h>
 #include <pthread.h>
 #include <math.h>
-#include <signal.h>
+#include <unistd.h>
 #include <iostream>
 #include <fstream>
+#include <vector>
+#include <algorithm>
 
 #include "api.h"
 #include "app_util.h"
@@ -24,13 +26,6 @@
 // Pseudo traffic sender layer
 #include "app_trafficSender.h"
 
-float AppUpObjectiveF(float delay) {
-	if(delay > 0) {
-		return exp(-delay / APP_UP_OBJECTIVE_F_HALFLIFE * log(2.0));
-	}
-	return 1.0;
-}
-
 void AppUpServerInit(
 	Node* node,
 	Address serverAddr) {
@@ -63,7 +58,7 @@ void AppUpServerInit(
 		addrStr);
 }
 
-void AppUpClientInit(
+AppDataUpClient* AppUpClientInit(
 	Node* node,
 	Address clientAddr,
 	Address serverAddr,
@@ -71,7 +66,8 @@ void AppUpClientInit(
 	char* sourceString,
 	AppUpNodeType nodeType,
 	int waitTime,
-	AppUpClientDaemonDataChunkStr* chunk) {
+	AppUpClientDaemonDataChunkStr* chunk,
+	int daemonId) {
 	AppDataUpClient *clientPtr;
 	char addrStr[MAX_STRING_LENGTH];
 
@@ -86,30 +82,8 @@ void AppUpClientInit(
 			"new client\n", node->hostname);
 		assert(false);
 	}
-	if (node->appData.appStats)
-	{
-		std::string customName;
-
-		if (clientPtr->applicationName->empty()) {
-			customName = "UP Client";
-		} else {
-			customName = *clientPtr->applicationName;
-		}
-		clientPtr->stats = new STAT_AppStatistics(
-				 node,
-				 "up",
-				 STAT_Unicast,
-				 STAT_AppSenderReceiver,
-				 customName.c_str());
-		clientPtr->stats->EnableAutoRefragment();
-		clientPtr->stats->Initialize(
-				 node,
-				 clientAddr,
-				 serverAddr,
-				 (STAT_SessionIdType)clientPtr->uniqueId,
-				 clientPtr->uniqueId);
-	}
-	clientPtr->dataChunk = chunk;
+	clientPtr->daemonId = daemonId;
+	AppUpClientSetDataChunk(clientPtr, chunk);
 	AppUpClientAddAddressInformation(node, clientPtr);
 
 	IO_ConvertIpAddressToString(&clientAddr, addrStr);
@@ -129,6 +103,63 @@ void AppUpClientInit(
 /*	char waitTimeStr[MAX_STRING_LENGTH];
 
 	sprintf(waitTimeStr, "%d", waitTime);*/
+	AppUpClientOpenConnection(node, clientPtr, waitTime);
+	return clientPtr;
+}
+
+/*
+ * Bytes of chunk carried by next upload
+ */
+void AppUpItemRange(
+	AppUpClientDaemonDataChunkStr* chunk,
+	Int32* itemOffset,
+	Int32* itemEnd) {
+	if(chunk) { // Send next segment only, or the rest of the chunk
+		*itemOffset = chunk->sizeDone * 1024;
+		*itemEnd = chunk->size * 1024;
+		if(chunk->sizeSegment > 0
+				&& chunk->sizeDone + chunk->sizeSegment < chunk->size) {
+			*itemEnd = (chunk->sizeDone + chunk->sizeSegment) * 1024;
+		}
+	} else {
+		*itemOffset = 0;
+		*itemEnd = APP_UP_MDC_TEST_DATA_SIZE * 1024;
+	}
+}
+
+void AppUpClientSetDataChunk(
+	AppDataUpClient* clientPtr,
+	AppUpClientDaemonDataChunkStr* chunk) {
+	clientPtr->dataChunk = chunk;
+	AppUpItemRange(chunk, &clientPtr->itemOffset, &clientPtr->itemEnd);
+}
+
+/*
+ * Reuse client whose connection failed for another attempt
+ */
+void AppUpClientReopen(
+	Node* node,
+	AppDataUpClient* clientPtr,
+	AppUpClientDaemonDataChunkStr* chunk,
+	int waitTime) {
+	clientPtr->connectionId = -1;
+	clientPtr->sessionIsClosed = true;
+	clientPtr->preempted = false;
+	clientPtr->itemLeft = 0;
+	clientPtr->tranStart = (clocktype)0;
+	AppUpClientSetDataChunk(clientPtr, chunk);
+
+	printf("UP client: %s reopened, uniqueId=%d\n",
+		node->hostname,
+		clientPtr->uniqueId);
+	AppUpClientOpenConnection(node, clientPtr, waitTime);
+}
+
+void AppUpClientOpenConnection(
+	Node* node,
+	AppDataUpClient* clientPtr,
+	int waitTime) {
+	clientPtr->openStart = node->getNodeTime() + waitTime * SECOND;
 	node->appData.appTrafficSender->appTcpOpenConnection(
 		node,
 		APP_UP_CLIENT,
@@ -146,6 +177,61 @@ void AppUpClientInit(
 		clientPtr->destInterfaceIndex);
 }
 
+/*
+ * Send chunk as the next item over the open connection of a burst
+ */
+void AppUpClientSendNext(
+	Node* node,
+	AppDataUpClient* clientPtr,
+	AppUpClientDaemonDataChunkStr* chunk) {
+	char* item;
+	Int32 fullSize;
+
+	assert(clientPtr->burst && clientPtr->connectionId >= 0);
+	AppUpClientSetDataChunk(clientPtr, chunk);
+	clientPtr->sessionIsClosed = false;
+	clientPtr->preempted = false;
+	clientPtr->tranStart = node->getNodeTime();
+
+	if(chunk == NULL) {
+		item = AppUpClientNewVirtualDataItem(
+				clientPtr->itemEnd,
+				0,
+				clientPtr->itemEnd,
+				fullSize,
+				0, 0, 0.);
+	} else {
+		item = AppUpClientNewVirtualDataItem(
+				chunk->size * 1024,
+				clientPtr->itemOffset,
+				clientPtr->itemEnd - clientPtr->itemOffset,
+				fullSize,
+				chunk->identifier,
+				chunk->deadline,
+				chunk->priority);
+	}
+	printf("UP client: %s sending next item, connectionId=%d\n",
+		node->hostname,
+		clientPtr->connectionId);
+	AppUpClientSendVirtualItem(node, clientPtr, item, fullSize);
+	MEM_free(item);
+}
+
+/*
+ * No item follows, close the connection of a burst
+ */
+void AppUpClientBurstEnd(
+	Node* node,
+	AppDataUpClient* clientPtr) {
+	clientPtr->burst = false;
+	node->appData.appTrafficSender->appTcpCloseConnection(
+			node,
+			clientPtr->connectionId);
+	printf("UP client: %s disconnecting, connectionId=%d\n",
+			node->hostname,
+			clientPtr->connectionId);
+}
+
 /*
  * Called when a new connection is opened passively on a server node
  * Create a new server structure and register it
@@ -157,7 +243,7 @@ AppDataUpServer* AppUpServerNewUpServer(
 	char localAddrStr[MAX_STRING_LENGTH];
 	char remoteAddrStr[MAX_STRING_LENGTH];
 
-	upServer = (AppDataUpServer*)MEM_malloc(sizeof(AppDataUpServer));
+	upServer = AppUpServerAlloc(node);
 
 	// Fill in connection-specific application data
 	upServer->connectionId = openResult->connectionId;
@@ -168,34 +254,28 @@ AppDataUpServer* AppUpServerNewUpServer(
 	upServer->uniqueId = node->appData.uniqueId++;
 	upServer->itemData.sizeExpected = -1;
 	upServer->itemData.sizeReceived = 0;
+	upServer->itemData.sizeResumed = 0;
 	upServer->sessionIsClosed = false;
 	upServer->sessionStart = node->getNodeTime();
 	upServer->sessionFinish = node->getNodeTime();
-	upServer->stats = NULL;
+	upServer->itemStart = node->getNodeTime();
+	upServer->itemOpen = false;
 
 	// Determine role of server
-	if(AppUpClientGetUpClientDaemon(node) == NULL) {
+	if(AppUpClientDaemonGetMdc(node) == NULL) {
 		upServer->nodeType = APP_UP_NODE_CLOUD;
 	} else {
 		upServer->nodeType = APP_UP_NODE_MDC;
 	}
 
+	// Statistics, one aggregator for all servers on the node
 	if (node->appData.appStats)
 	{
-		upServer->stats = new STAT_AppStatistics(
-				node,
-				"upServer",
-				STAT_Unicast,
-				STAT_AppSenderReceiver,
-				"UP Server");
-		upServer->stats->Initialize(
-				node,
-				openResult->remoteAddr,
-				openResult->localAddr,
-				(STAT_SessionIdType)openResult->clientUniqueId,
-				upServer->uniqueId);
-		upServer->stats->EnableAutoRefragment();
-		upServer->stats->SessionStart(node);
+		AppUpNodeData* nodeData = AppUpGetNodeData(node);
+
+		if(nodeData->serverStats == NULL) {
+			nodeData->serverStats = AppUpStatsNew();
+		}
 	}
 	RANDOM_SetSeed(upServer->seed,
 			node->globalSeed,
@@ -203,8 +283,18 @@ AppDataUpServer* AppUpServerNewUpServer(
 			APP_UP_SERVER,
 			upServer->uniqueId);
 
-	// Register
-	APP_RegisterNewApp(node, APP_UP_SERVER, upServer);
+	// Register, sessions are found through the table of open sessions
+	AppUpNodeData* nodeData = AppUpGetNodeData(node);
+
+	if(upServer->connectionId >= (int)nodeData->servers->size()) {
+		nodeData->servers->resize(upServer->connectionId + 1, NULL);
+	}
+	(*nodeData->servers)[upServer->connectionId] = upServer;
+	nodeData->numServers += 1;
+	if(!nodeData->serverRegistered) {
+		APP_RegisterNewApp(node, APP_UP_SERVER, nodeData);
+		nodeData->serverRegistered = true;
+	}
 
 	IO_ConvertIpAddressToString(&upServer->localAddr, localAddrStr);
 	IO_ConvertIpAddressToString(&upServer->remoteAddr, remoteAddrStr);
@@ -247,7 +337,7 @@ AppDataUpClient* AppUpClientNewUpClient(
 	upClient->sessionIsClosed = true;
 	upClient->sessionStart = node->getNodeTime();
 	upClient->sessionFinish = node->getNodeTime();
-	upClient->stats = NULL;
+	upClient->openStart = (clocktype)0;
 	upClient->tranStart = (clocktype)0;
 
 	if (appName) {
@@ -354,10 +444,35 @@ void AppLayerUpServer(Node *node, Message *msg) {
 			if(packetSize - packetSizeVirtual > 0 && packet[0] == '^') {
 				AppUpMessageHeader* header = (AppUpMessageHeader*)(packet + 1);
 				Int32 capSize;
-
+				Int32 tailSize = 0;
+
+				// Next item of a burst, TCP may pack the tail of the open
+				// item into this segment ahead of the header, virtual bytes
+				// complete that item first and the rest belongs to this one
+				if(header->type == APP_UP_MSG_DATA) {
+					if(serverPtr->itemOpen) {
+						tailSize = serverPtr->itemData.sizeExpected
+								- serverPtr->itemData.sizeReceived;
+						if(tailSize > packetSizeVirtual) {
+							tailSize = packetSizeVirtual;
+						}
+						if(tailSize > 0) {
+							serverPtr->itemData.sizeReceived += tailSize;
+							AppUpServerUpdateReceivedRange(node, serverPtr);
+						} else tailSize = 0;
+						AppUpServerReportItem(node, serverPtr);
+					}
+					serverPtr->itemStart = node->getNodeTime();
+					serverPtr->itemOpen = true;
+				}
 				serverPtr->itemData.sizeExpected = header->itemSize;
 				serverPtr->itemData.dataChunk = header->dataChunk;
 
+				if(header->type == APP_UP_MSG_RESUME_QUERY) {
+					AppUpServerSendResumeReply(node, serverPtr);
+					break;
+				}
+
 				// Changed for virtual packets
 /*				if(packet[packetSize - 1] == '$') {
 					capSize = sizeof(AppUpMessageHeader) + 2;
@@ -366,12 +481,15 @@ void AppLayerUpServer(Node *node, Message *msg) {
 				}*/
 
 				capSize = sizeof(AppUpMessageHeader) + 2;
-				serverPtr->itemData.sizeReceived += packetSize - capSize;
+				serverPtr->itemData.sizeReceived =
+						header->itemOffset + packetSize - capSize - tailSize;
+				serverPtr->itemData.sizeResumed = header->itemOffset;
 				printf("UP server: %s received data, "
-						"identifier=%d itemSizeExpected=%d\n",
+						"identifier=%d itemSizeExpected=%d itemOffset=%d\n",
 						node->hostname,
 						serverPtr->itemData.dataChunk.identifier,
-						serverPtr->itemData.sizeExpected);
+						serverPtr->itemData.sizeExpected,
+						header->itemOffset);
 
 				if(serverPtr->nodeType == APP_UP_NODE_MDC) {
 					Message* msg;
@@ -384,6 +502,8 @@ void AppLayerUpServer(Node *node, Message *msg) {
 							APP_LAYER,
 							APP_UP_CLIENT_DAEMON /*APP_UP_CLIENT*/,
 							MSG_APP_UP_DataChunkHeaderReceived);
+					MESSAGE_SetInstanceId(msg,
+							AppUpClientDaemonGetMdc(node)->daemonId);
 					MESSAGE_InfoAlloc(node, msg, sizeof(int));
 					memcpy(MESSAGE_ReturnInfo(msg),
 							&chunkIdentifier,
@@ -401,6 +521,15 @@ void AppLayerUpServer(Node *node, Message *msg) {
 			}*/ else {
 				serverPtr->itemData.sizeReceived += packetSize;
 			}
+			AppUpServerUpdateReceivedRange(node, serverPtr);
+
+			// Report a complete item at once, not at next header or close
+			if(serverPtr->itemOpen
+					&& serverPtr->itemData.sizeReceived
+							>= serverPtr->itemData.sizeExpected) {
+				AppUpServerReportItem(node, serverPtr);
+				serverPtr->itemOpen = false;
+			}
 			break; }
 		case MSG_APP_FromTransCloseResult: {
 			TransportToAppCloseResult *closeResult;
@@ -408,7 +537,7 @@ void AppLayerUpServer(Node *node, Message *msg) {
 			closeResult = (TransportToAppCloseResult*)MESSAGE_ReturnInfo(msg);
 			serverPtr = AppUpServerGetUpServer(node,
 					closeResult->connectionId);
-			assert(serverPtr != NULL);
+			if(serverPtr == NULL) break; // Already returned to pool
 			if(serverPtr->sessionIsClosed) break;
 
 			if(closeResult->type == TCP_CONN_PASSIVE_CLOSE) {
@@ -417,90 +546,25 @@ void AppLayerUpServer(Node *node, Message *msg) {
 						node->hostname,
 						closeResult->connectionId);
 
-				AppUpServerItemData* itemData;
-
-				itemData = &serverPtr->itemData;
-				printf("UP server: %s received data, "
-						"identifier=%d itemSizeReceived=%d\n",
-						node->hostname,
-						itemData->dataChunk.identifier,
-						itemData->sizeReceived);
-
-				char serverRecFileName[MAX_STRING_LENGTH];
-				ofstream serverRecFile;
-
-				sprintf(serverRecFileName, "server_%s.out",
-						node->hostname);
-				serverRecFile.open(serverRecFileName, ios::app);
-//				TIME_PrintClockInSecond(node->getNodeTime(), clockInSecond);
-				if(serverPtr->nodeType == APP_UP_NODE_MDC) {
-					serverRecFile << "MDC";
-				} else if (serverPtr->nodeType == APP_UP_NODE_CLOUD) {
-					serverRecFile << "CLOUD";
-				} else assert(false);
-				serverRecFile << " "
-						<< node->hostname
-						<< " " << "RECV DATA" << " "
-						<< itemData->dataChunk.identifier
-						<< " " << "AT TIME" << " "
-						<< clockInSecond
-						<< std::endl;
-				serverRecFile.close();
-
-				// Report data chunk information to daemon
-				if(itemData->sizeReceived == itemData->sizeExpected
-						&&serverPtr->nodeType == APP_UP_NODE_MDC) {
-					Message* msg;
-					ActionData acnData;
-					int infoSize = sizeof(int);
-					int packetSize = sizeof(AppUpClientDaemonDataChunkStr);
-					int chunkIdentifier;
-
-					chunkIdentifier = itemData->dataChunk.identifier;
-
-					msg = MESSAGE_Alloc(node,
-							APP_LAYER,
-							APP_UP_CLIENT_DAEMON /*APP_UP_CLIENT*/,
-							MSG_APP_UP_DataChunkReceived);
-					MESSAGE_InfoAlloc(node, msg, infoSize);
-					memcpy(MESSAGE_ReturnInfo(msg), &chunkIdentifier, infoSize);
-					if(chunkIdentifier > 0) {
-						MESSAGE_PacketAlloc(node, msg, packetSize, TRACE_UP);
-						memcpy(MESSAGE_ReturnPacket(msg),
-								&itemData->dataChunk,
-								packetSize);
-					}
-
-					//Trace Information
-					acnData.actionType = SEND;
-					acnData.actionComment = NO_COMMENT;
-					TRACE_PrintTrace(node, msg, TRACE_APPLICATION_LAYER,
-							PACKET_OUT, &acnData);
-					MESSAGE_Send(node, msg, (clocktype)0);
-				}
-
-				if (node->appData.appStats) {
-					if (!serverPtr->stats->IsSessionFinished()) {
-						serverPtr->stats->SessionFinish(node);
-					}
+				if(serverPtr->itemOpen) { // Complete items are reported
+					AppUpServerReportItem(node, serverPtr);
+					serverPtr->itemOpen = false;
 				}
 			} else {
 				printf("UP server: %s actively closed, "
 						"connectionId=%d\n",
 						node->hostname,
 						closeResult->connectionId);
-			}
-
-			// Original handler
-			if (node->appData.appStats) {
-				if (!serverPtr->stats->IsSessionFinished()) {
-					serverPtr->stats->SessionFinish(node);
+				if(serverPtr->itemOpen) {
+					AppUpServerRecordItemStats(node, serverPtr);
+					serverPtr->itemOpen = false;
 				}
 			}
 			if(serverPtr->sessionIsClosed == false) {
 				serverPtr->sessionIsClosed = true;
 				serverPtr->sessionFinish = node->getNodeTime();
 			}
+			AppUpServerRelease(node, serverPtr);
 			break; }
 		case MSG_APP_TimerExpired:
 			printf("UP server: %s at time %s timer expired\n",
@@ -543,23 +607,30 @@ void AppLayerUpClient(Node *node, Message *msg) {
 				clientPtr = AppUpClientGetClientPtr(node, openResult->uniqueId);
 				assert(clientPtr != NULL);
 
+				// Daemon already moved on from this upload
+				if(clientPtr->preempted) break;
+
 				// Report data chunk information to daemon
 				Message* msg;
 				ActionData acnData;
-				int infoSize = sizeof(int);
+				AppUpConnectionFailedInfo failedInfo;
+				int infoSize = sizeof(AppUpConnectionFailedInfo);
 				int packetSize = sizeof(AppUpClientDaemonDataChunkStr);
 				int chunkIdentifier = 0;
 
 				if(clientPtr->dataChunk) {
 					chunkIdentifier = clientPtr->dataChunk->identifier;
 				}
+				failedInfo.chunkIdentifier = chunkIdentifier;
+				failedInfo.uniqueId = clientPtr->uniqueId;
 
 				msg = MESSAGE_Alloc(node,
 						APP_LAYER,
 						APP_UP_CLIENT_DAEMON,
 						MSG_APP_UP_TransportConnectionFailed);
+				MESSAGE_SetInstanceId(msg, clientPtr->daemonId);
 				MESSAGE_InfoAlloc(node, msg, infoSize);
-				memcpy(MESSAGE_ReturnInfo(msg), &chunkIdentifier, infoSize);
+				memcpy(MESSAGE_ReturnInfo(msg), &failedInfo, infoSize);
 				if(chunkIdentifier > 0) {
 					MESSAGE_PacketAlloc(node, msg, packetSize, TRACE_UP);
 					memcpy(MESSAGE_ReturnPacket(msg),
@@ -581,23 +652,39 @@ void AppLayerUpClient(Node *node, Message *msg) {
 
 				clientPtr = AppUpClientUpdateUpClient(node, openResult);
 				assert(clientPtr != NULL);
+				clientPtr->tranStart = node->getNodeTime();
+
+				if(clientPtr->preempted) {
+					clientPtr->sessionIsClosed = true;
+					node->appData.appTrafficSender->appTcpCloseConnection(
+							node,
+							clientPtr->connectionId);
+					break;
+				}
+
+				// Ask server how much of this chunk it already holds
+				if(clientPtr->dataChunk && clientPtr->dataChunk->partial) {
+					AppUpClientSendResumeQuery(node, clientPtr);
+					break;
+				}
 
 				if(clientPtr->dataChunk == NULL) {
 					// Changed for virtual packets
 //					item = AppUpClientNewDataItem(
 					item = AppUpClientNewVirtualDataItem(
-							itemSize, fullSize, 0, 0, 0.);
+							itemSize, 0, itemSize, fullSize, 0, 0, 0.);
 				} else {
 					// Changed for virtual packets
 //					item = AppUpClientNewDataItem(
 					item = AppUpClientNewVirtualDataItem(
 							clientPtr->dataChunk->size * 1024,
+							clientPtr->itemOffset,
+							clientPtr->itemEnd - clientPtr->itemOffset,
 							fullSize,
 							clientPtr->dataChunk->identifier,
 							clientPtr->dataChunk->deadline,
 							clientPtr->dataChunk->priority);
 				}
-				clientPtr->tranStart = node->getNodeTime();
 
 				// Changed for virtual packets
 //				AppUpClientSendItem(
@@ -632,17 +719,34 @@ void AppLayerUpClient(Node *node, Message *msg) {
 			// Removed for virtual packets
 /*			if(clientPtr->packets) {
 				AppUpClientSendNextPacket(node, clientPtr);
-			} else*/ if(clientPtr->sessionIsClosed) {
+			} else*/ if(clientPtr->preempted) {
+				// Stop here, server keeps what it received for resume
+				clientPtr->itemLeft = 0;
+				clientPtr->sessionIsClosed = true;
 				node->appData.appTrafficSender->appTcpCloseConnection(
 						node,
 						clientPtr->connectionId);
-				printf("UP client: %s disconnecting, connectionId=%d\n",
+				printf("UP client: %s preempted, connectionId=%d\n",
 						node->hostname,
 						clientPtr->connectionId);
+			} else if(clientPtr->itemLeft > 0) {
+				AppUpClientSendNextVirtualBlock(node, clientPtr);
+			} else if(clientPtr->sessionIsClosed) {
+				// In a burst the daemon decides whether the next item follows
+				if(!clientPtr->burst) {
+					node->appData.appTrafficSender->appTcpCloseConnection(
+							node,
+							clientPtr->connectionId);
+					printf("UP client: %s disconnecting, connectionId=%d\n",
+							node->hostname,
+							clientPtr->connectionId);
+				}
 
 				Message* msg;
 				ActionData acnData;
-				int infoSize = sizeof(int) + sizeof(clocktype);
+				int infoSize = sizeof(int) + sizeof(clocktype)
+						+ sizeof(Int32) * 2;
+				Int32 itemLength = clientPtr->itemEnd - clientPtr->itemOffset;
 				int packetSize = sizeof(AppUpClientDaemonDataChunkStr);
 				int chunkIdentifier;
 				clocktype uploadTime =
@@ -656,11 +760,18 @@ void AppLayerUpClient(Node *node, Message *msg) {
 						APP_LAYER,
 						APP_UP_CLIENT_DAEMON /*APP_UP_CLIENT*/,
 						MSG_APP_UP_DataChunkDelivered);
+				MESSAGE_SetInstanceId(msg, clientPtr->daemonId);
 				MESSAGE_InfoAlloc(node, msg, infoSize);
 				memcpy(MESSAGE_ReturnInfo(msg),
 						&chunkIdentifier, sizeof(int));
 				memcpy(MESSAGE_ReturnInfo(msg) + sizeof(int),
 						&uploadTime, sizeof(clocktype));
+				memcpy(MESSAGE_ReturnInfo(msg) + sizeof(int)
+						+ sizeof(clocktype),
+						&clientPtr->itemOffset, sizeof(Int32));
+				memcpy(MESSAGE_ReturnInfo(msg) + sizeof(int)
+						+ sizeof(clocktype) + sizeof(Int32),
+						&itemLength, sizeof(Int32));
 				if(clientPtr->dataChunk) {
 					MESSAGE_PacketAlloc(node, msg, packetSize, TRACE_UP);
 					memcpy(MESSAGE_ReturnPacket(msg),
@@ -675,12 +786,6 @@ void AppLayerUpClient(Node *node, Message *msg) {
 				TRACE_PrintTrace(node, msg, TRACE_APPLICATION_LAYER,
 						PACKET_OUT, &acnData);
 				MESSAGE_Send(node, msg, (clocktype)0);
-
-				if (node->appData.appStats) {
-					if (!clientPtr->stats->IsSessionFinished()) {
-						clientPtr->stats->SessionFinish(node);
-					}
-				}
 			}
 			pthread_mutex_unlock(&clientPtr->packetsMutex);
 			break; }
@@ -707,6 +812,36 @@ void AppLayerUpClient(Node *node, Message *msg) {
 			if (node->appData.appStats) {
 				;
 			}
+
+			if(packetSize > 0 && packet[0] == '^') {
+				AppUpMessageHeader* header = (AppUpMessageHeader*)(packet + 1);
+				char* item;
+				Int32 fullSize;
+
+				assert(header->type == APP_UP_MSG_RESUME_REPLY);
+				assert(clientPtr->dataChunk != NULL);
+				clientPtr->itemOffset = header->itemOffset;
+				if(clientPtr->itemEnd < clientPtr->itemOffset) {
+					clientPtr->itemEnd = clientPtr->itemOffset;
+				}
+				printf("UP client: %s resumed data chunk, "
+						"identifier=%d itemOffset=%d\n",
+						node->hostname,
+						clientPtr->dataChunk->identifier,
+						clientPtr->itemOffset);
+
+				item = AppUpClientNewVirtualDataItem(
+						clientPtr->dataChunk->size * 1024,
+						clientPtr->itemOffset,
+						clientPtr->itemEnd - clientPtr->itemOffset,
+						fullSize,
+						clientPtr->dataChunk->identifier,
+						clientPtr->dataChunk->deadline,
+						clientPtr->dataChunk->priority);
+				AppUpClientSendVirtualItem(
+						node, clientPtr, item, fullSize);
+				MEM_free(item);
+			}
 			break;
 		case MSG_APP_FromTransCloseResult: {
 			TransportToAppCloseResult *closeResult;
@@ -730,11 +865,7 @@ void AppLayerUpClient(Node *node, Message *msg) {
 					closeResult->connectionId);
 			assert(clientPtr != NULL);
 
-			if (node->appData.appStats) {
-				if (!clientPtr->stats->IsSessionFinished()) {
-					clientPtr->stats->SessionFinish(node);
-				}
-			}
+			clientPtr->burst = false; // Connection cannot carry more items
 			if(clientPtr->sessionIsClosed == false) {
 				clientPtr->sessionIsClosed = true;
 				clientPtr->sessionFinish = node->getNodeTime();
@@ -756,15 +887,20 @@ void AppLayerUpClient(Node *node, Message *msg) {
 	MESSAGE_Free(node, msg);
 }
 
+/*
+ * Registered once per node, detail is the node-wide UP state
+ */
 void AppUpServerFinalize(Node *node, AppInfo *appInfo) {
-	AppDataUpServer *serverPtr = (AppDataUpServer*)appInfo->appDetail;
-	char addrStr[MAX_STRING_LENGTH];
+	AppUpNodeData* nodeData = (AppUpNodeData*)appInfo->appDetail;
 
-	printf("UP server: Finalized at %s\n", node->hostname);
+	printf("UP server: Finalized at %s, open=%d slabs=%d\n",
+			node->hostname,
+			nodeData->numServers,
+			(int)nodeData->serverSlabs->size());
 
 	// Statistics
 	if(node->appData.appStats) {
-		;
+		AppUpServerPrintStats(node);
 	}
 }
 
@@ -776,18 +912,49 @@ void AppUpClientFinalize(Node *node, AppInfo *appInfo) {
 
 	// Statistics
 	if(node->appData.appStats) {
-		;
+		AppUpClientPrintStats(node, clientPtr);
 	}
 }
 
-void AppUpServerPrintStats(Node *node, AppDataUpServer *serverPtr) {
-//	TODO
-	return;
+/*
+ * Servers on a node share one aggregator, printed and written once
+ */
+void AppUpServerPrintStats(Node *node) {
+	AppUpNodeData* nodeData = AppUpGetNodeData(node);
+	AppUpStats* stats = nodeData->serverStats;
+	char histFileName[MAX_STRING_LENGTH];
+
+	if(stats == NULL) return;
+
+	AppUpStatsPrint(node, stats, "server");
+	if(AppUpClientDaemonGetMdc(node) == NULL) {
+		AppUpServerPrintDeliveries(node);
+	}
+	sprintf(histFileName, "%s%s_server.csv",
+			APP_UP_HIST_FILE_PREFIX, node->hostname);
+	AppUpStatsWrite(
+			node,
+			stats,
+			AppUpClientDaemonGetMdc(node) ? "MDC" : "CLOUD",
+			histFileName);
+
+	AppUpStatsDelete(stats);
+	nodeData->serverStats = NULL;
 }
 
+/*
+ * Report uploads still in progress when simulation ends
+ */
 void AppUpClientPrintStats(Node *node, AppDataUpClient *clientPtr) {
-//	TODO
-	return;
+	if(clientPtr->sessionIsClosed || clientPtr->dataChunk == NULL) return;
+
+	printf("UP client: %s upload unfinished at end, "
+			"identifier=%d itemOffset=%d itemEnd=%d itemLeft=%d\n",
+			node->hostname,
+			clientPtr->dataChunk->identifier,
+			clientPtr->itemOffset,
+			clientPtr->itemEnd,
+			clientPtr->itemLeft);
 }
 
 void
@@ -831,22 +998,51 @@ AppUpClientAddAddressInformation(
 AppDataUpServer*
 AppUpServerGetUpServer(Node *node, int connId)
 {
-	AppInfo *appList = node->appData.appPtr;
-	AppDataUpServer *upServer;
+	AppUpNodeData* nodeData = (AppUpNodeData*)node->appData.upData;
 
-	for (; appList != NULL; appList = appList->appNext)
+	if (nodeData == NULL
+			|| connId < 0
+			|| connId >= (int)nodeData->servers->size())
 	{
-		if (appList->appType == APP_UP_SERVER)
-		{
-			upServer = (AppDataUpServer *) appList->appDetail;
+		return NULL;
+	}
+	return (*nodeData->servers)[connId];
+}
 
-			if (upServer->connectionId == connId)
-			{
-				return upServer;
-			}
+/*
+ * Take a server session from the pool, refilled a slab at a time
+ */
+AppDataUpServer* AppUpServerAlloc(Node* node) {
+	AppUpNodeData* nodeData = AppUpGetNodeData(node);
+	AppDataUpServer* upServer;
+
+	if(nodeData->serverFree == NULL) {
+		AppDataUpServer* slab = (AppDataUpServer*)MEM_malloc(
+				sizeof(AppDataUpServer) * APP_UP_SERVER_SLAB_SIZE);
+
+		for(int i = 0; i < APP_UP_SERVER_SLAB_SIZE; ++i) {
+			slab[i].nextFree = i + 1 < APP_UP_SERVER_SLAB_SIZE
+					? &slab[i + 1] : NULL;
 		}
+		nodeData->serverSlabs->push_back(slab);
+		nodeData->serverFree = slab;
 	}
-	return NULL;
+	upServer = nodeData->serverFree;
+	nodeData->serverFree = upServer->nextFree;
+	memset(upServer, 0, sizeof(AppDataUpServer));
+	return upServer;
+}
+
+/*
+ * Closed session goes back to the pool, later events for it are dropped
+ */
+void AppUpServerRelease(Node* node, AppDataUpServer* serverPtr) {
+	AppUpNodeData* nodeData = AppUpGetNodeData(node);
+
+	(*nodeData->servers)[serverPtr->connectionId] = NULL;
+	nodeData->numServers -= 1;
+	serverPtr->nextFree = nodeData->serverFree;
+	nodeData->serverFree = serverPtr;
 }
 
 /*
@@ -1048,6 +1244,8 @@ void AppUpClientSendItem(
 
 char* AppUpClientNewVirtualDataItem(
 		Int32 itemSize,
+		Int32 itemOffset,
+		Int32 itemLength,
 		Int32& fullSize,
 		int identifier,
 		int deadline,
@@ -1055,7 +1253,9 @@ char* AppUpClientNewVirtualDataItem(
 	char* item;
 	AppUpMessageHeader* header;
 
-	fullSize = itemSize + sizeof(AppUpMessageHeader) + 2;
+	assert(itemOffset >= 0 && itemLength >= 0
+			&& itemOffset + itemLength <= itemSize);
+	fullSize = itemLength + sizeof(AppUpMessageHeader) + 2;
 	item = (char*)MEM_malloc(sizeof(AppUpMessageHeader) + 2);
 	memset(item, 0, sizeof(AppUpMessageHeader) + 2);
 	item[0] = '^';
@@ -1063,6 +1263,7 @@ char* AppUpClientNewVirtualDataItem(
 	header = (AppUpMessageHeader*)(item + 1);
 	header->type = APP_UP_MSG_DATA;
 	header->itemSize = itemSize;
+	header->itemOffset = itemOffset;
 	header->dataChunk.identifier = identifier;
 	header->dataChunk.size = itemSize / 1024;
 	header->dataChunk.deadline = deadline;
@@ -1093,8 +1294,17 @@ void AppUpClientSendVirtualItem(
 		clientPtr->connectionId,
 		TRACE_UP);
 
+	// Virtual payload goes out in blocks so that upload can be preempted
+	clientPtr->itemLeft = 0;
+#ifdef APP_UP_PREEMPTION
+	if(itemSize - packetSize > APP_UP_CLIENT_SEND_BLOCK_SIZE) {
+		clientPtr->itemLeft =
+				itemSize - packetSize - APP_UP_CLIENT_SEND_BLOCK_SIZE;
+	}
+#endif
 	APP_AddPayload(node, msg, item, packetSize);
-	APP_AddVirtualPayload(node, msg, itemSize - packetSize);
+	APP_AddVirtualPayload(node, msg,
+			itemSize - packetSize - clientPtr->itemLeft);
 	node->appData.appTrafficSender->appTcpSend(node, msg);
 
 	// Statistics
@@ -1103,7 +1313,7 @@ void AppUpClientSendVirtualItem(
 		;
 	}
 
-	if(clientPtr->packets == NULL) {
+	if(clientPtr->packets == NULL && clientPtr->itemLeft == 0) {
 		clientPtr->sessionIsClosed = true;
 		clientPtr->sessionFinish = node->getNodeTime();
 
@@ -1116,85 +1326,445 @@ void AppUpClientSendVirtualItem(
 }
 
 /*
- * Called when a new connection is opened on a client node
- * Match an existing client structure with uniqueId
- * Update it with connectionId
+ * Send next block of virtual payload of current item
  */
-AppDataUpClient*
-AppUpClientUpdateUpClient(Node *node,
-	TransportToAppOpenResult *openResult)
-{
-	AppInfo *appList = node->appData.appPtr;
-	AppDataUpClient *tmpUpClient = NULL;
-	AppDataUpClient *upClient = NULL;
-	char localAddrStr[MAX_STRING_LENGTH];
-	char remoteAddrStr[MAX_STRING_LENGTH];
-
-	for (; appList != NULL; appList = appList->appNext)
-	{
-		if (appList->appType == APP_UP_CLIENT)
-		{
-			tmpUpClient = (AppDataUpClient *) appList->appDetail;
+void AppUpClientSendNextVirtualBlock(
+		Node* node,
+		AppDataUpClient *clientPtr) {
+	Int32 blockSize = clientPtr->itemLeft;
 
-			if (tmpUpClient->uniqueId == openResult->uniqueId)
-			{
-				upClient = tmpUpClient;
-				break;
-			}
-		}
+	assert(!clientPtr->sessionIsClosed && clientPtr->itemLeft > 0);
+	if(blockSize > APP_UP_CLIENT_SEND_BLOCK_SIZE) {
+		blockSize = APP_UP_CLIENT_SEND_BLOCK_SIZE;
 	}
-	assert (upClient != NULL);
 
-	// Fill in
-	upClient->connectionId = openResult->connectionId;
-	upClient->localAddr = openResult->localAddr;
-	upClient->remoteAddr = openResult->remoteAddr;
-	upClient->localPort = openResult->localPort;
-	upClient->remotePort = openResult->remotePort;
-	upClient->sessionIsClosed = false;
-	upClient->sessionStart = node->getNodeTime();
-	upClient->sessionFinish = node->getNodeTime();
+	Message *msg = APP_TcpCreateMessage(
+		node,
+		clientPtr->connectionId,
+		TRACE_UP);
 
-	if (node->appData.appStats) {
-		if (!upClient->stats->IsSessionStarted()) {
-			upClient->stats->SessionStart(node);
-		}
-	}
+	APP_AddVirtualPayload(node, msg, blockSize);
+	node->appData.appTrafficSender->appTcpSend(node, msg);
+	clientPtr->itemLeft -= blockSize;
 
-	IO_ConvertIpAddressToString(&upClient->localAddr, localAddrStr);
-	IO_ConvertIpAddressToString(&upClient->remoteAddr, remoteAddrStr);
-	printf("UP client: %s:%d -> %s:%d, connectionId=%d\n",
-			localAddrStr, upClient->localPort,
-			remoteAddrStr, upClient->remotePort,
-			upClient->connectionId);
-	return upClient;
+	if(clientPtr->itemLeft == 0) {
+		clientPtr->sessionIsClosed = true;
+		clientPtr->sessionFinish = node->getNodeTime();
+	}
 }
 
-AppUpClientPacketList* AppUpClientPacketListAppend(
-		AppUpClientPacketList* list,
-		AppUpClientPacketList* item) {
-	if(list == NULL) {
-		list = item;
-	} else { // list != NULL
-		AppUpClientPacketList* ptr = list;
+/*
+ * Ask the server for the received prefix of a partially uploaded chunk
+ * The remainder is sent once the reply arrives
+ */
+void AppUpClientSendResumeQuery(
+		Node* node,
+		AppDataUpClient* clientPtr) {
+	char clockInSecond[MAX_STRING_LENGTH];
+	char item[sizeof(AppUpMessageHeader) + 2];
+	AppUpMessageHeader* header;
+	AppUpClientDaemonDataChunkStr* chunk = clientPtr->dataChunk;
 
-//		assert(ptr != NULL);
-		while(ptr->next != NULL) {
-			ptr = ptr->next;
-		}
-		ptr->next = item;
+	TIME_PrintClockInSecond(node->getNodeTime(), clockInSecond);
+	if(clientPtr->sessionIsClosed) {
+		printf("UP client: %s at time %s attempted invalid operation\n",
+				node->hostname, clockInSecond);
+		return;
 	}
-	return list;
-}
+	assert(chunk != NULL);
 
-void AppUpSendGeneralMessageToServer(Node* node, clocktype delay) {
-	Message* msg;
+	memset(item, 0, sizeof(item));
+	item[0] = '^';
+	item[sizeof(item) - 1] = '$';
+	header = (AppUpMessageHeader*)(item + 1);
+	header->type = APP_UP_MSG_RESUME_QUERY;
+	header->itemSize = chunk->size * 1024;
+	header->itemOffset = 0;
+	header->dataChunk.identifier = chunk->identifier;
+	header->dataChunk.size = chunk->size;
+	header->dataChunk.deadline = chunk->deadline;
+	header->dataChunk.priority = chunk->priority;
+	header->dataChunk.next = NULL;
 
-	msg = MESSAGE_Alloc(node, APP_LAYER, APP_UP_SERVER, MSG_APP_UP);
-	MESSAGE_Send(node, msg, delay);
+	Message *msg = APP_TcpCreateMessage(
+		node,
+		clientPtr->connectionId,
+		TRACE_UP);
+
+	APP_AddPayload(node, msg, item, sizeof(item));
+	node->appData.appTrafficSender->appTcpSend(node, msg);
+	printf("UP client: %s queried resume offset, identifier=%d\n",
+			node->hostname,
+			chunk->identifier);
 }
 
-void AppUpSendGeneralMessageToClient(Node* node, clocktype delay) {
+/*
+ * Reply to a resume query with the received prefix of that chunk
+ * Only a prefix of matching size is granted, otherwise upload restarts
+ */
+void AppUpServerSendResumeReply(
+		Node* node,
+		AppDataUpServer* serverPtr) {
+	char item[sizeof(AppUpMessageHeader) + 2];
+	AppUpMessageHeader* header;
+	AppUpServerItemData* itemData = &serverPtr->itemData;
+	map<int, AppUpServerReceivedRange>* ranges =
+			AppUpGetNodeData(node)->receivedRanges;
+	map<int, AppUpServerReceivedRange>::iterator it;
+	Int32 itemOffset = 0;
+
+	it = ranges->find(itemData->dataChunk.identifier);
+	if(it != ranges->end()
+			&& it->second.sizeExpected == itemData->sizeExpected) {
+		itemOffset = it->second.sizeReceived;
+	}
+	itemData->sizeReceived = itemOffset;
+
+	memset(item, 0, sizeof(item));
+	item[0] = '^';
+	item[sizeof(item) - 1] = '$';
+	header = (AppUpMessageHeader*)(item + 1);
+	header->type = APP_UP_MSG_RESUME_REPLY;
+	header->itemSize = itemData->sizeExpected;
+	header->itemOffset = itemOffset;
+	header->dataChunk = itemData->dataChunk;
+
+	Message *msg = APP_TcpCreateMessage(
+		node,
+		serverPtr->connectionId,
+		TRACE_UP);
+
+	APP_AddPayload(node, msg, item, sizeof(item));
+	node->appData.appTrafficSender->appTcpSend(node, msg);
+	printf("UP server: %s granted resume offset, "
+			"identifier=%d itemOffset=%d\n",
+			node->hostname,
+			itemData->dataChunk.identifier,
+			itemOffset);
+}
+
+/*
+ * Persist the received prefix of the current chunk on this node
+ * Completed chunks are dropped since they will not be resumed
+ */
+void AppUpServerUpdateReceivedRange(
+		Node* node,
+		AppDataUpServer* serverPtr) {
+	AppUpServerItemData* itemData = &serverPtr->itemData;
+	map<int, AppUpServerReceivedRange>* ranges;
+	int chunkIdentifier = itemData->dataChunk.identifier;
+
+	if(itemData->sizeExpected < 0 || chunkIdentifier <= 0) return;
+	ranges = AppUpGetNodeData(node)->receivedRanges;
+	if(itemData->sizeReceived >= itemData->sizeExpected) {
+		ranges->erase(chunkIdentifier);
+	} else {
+		AppUpServerReceivedRange& range = (*ranges)[chunkIdentifier];
+
+		range.sizeExpected = itemData->sizeExpected;
+		range.sizeReceived = itemData->sizeReceived;
+	}
+}
+
+/*
+ * Record upload that came over abstract link as the server would,
+ * no server session exists to hold statistics
+ */
+void AppUpServerRecordAbstract(
+		Node* node,
+		AppUpClientDaemonDataChunkStr* chunk,
+		bool finished,
+		NodeAddress source) {
+	char clockInSecond[MAX_STRING_LENGTH];
+	char serverRecFileName[MAX_STRING_LENGTH];
+	ofstream serverRecFile;
+	const char* recvEvent = finished ? "RECV DATA" : "RECV PART";
+
+	if(finished && !AppUpServerRecordDelivery(node, chunk, source)) {
+		recvEvent = "RECV DUPL";
+	}
+	TIME_PrintClockInSecond(node->getNodeTime(), clockInSecond);
+	sprintf(serverRecFileName, "server_%s.out", node->hostname);
+	serverRecFile.open(serverRecFileName, ios::app);
+	serverRecFile << "CLOUD" << " "
+			<< node->hostname
+			<< " " << recvEvent << " "
+			<< chunk->identifier
+			<< " " << "AT TIME" << " "
+			<< clockInSecond
+			<< std::endl;
+	serverRecFile.close();
+}
+
+/*
+ * Index complete receipt of chunk at the cloud
+ * Returns false if the chunk was delivered before and duplicates are
+ * told apart
+ */
+bool AppUpServerRecordDelivery(
+		Node* node,
+		AppUpClientDaemonDataChunkStr* chunk,
+		NodeAddress source) {
+	map<int, AppUpDelivery>* deliveries;
+	map<int, AppUpDelivery>::iterator it;
+
+	if(chunk->identifier <= 0) return true;
+	deliveries = AppUpGetNodeData(node)->deliveries;
+	it = deliveries->find(chunk->identifier);
+	if(it != deliveries->end()) {
+		it->second.numDuplicates += 1;
+		printf("UP server: %s received duplicate data chunk, "
+				"identifier=%d source=%u firstSource=%u\n",
+				node->hostname,
+				chunk->identifier,
+				source,
+				it->second.source);
+#ifdef APP_UP_CLOUD_DEDUP
+		return false;
+#else
+		return true;
+#endif
+	}
+
+	AppUpDelivery& delivery = (*deliveries)[chunk->identifier];
+
+	delivery.time = node->getNodeTime();
+	delivery.source = source;
+	delivery.size = chunk->size;
+	delivery.numDuplicates = 0;
+	return true;
+}
+
+/*
+ * Unique goodput of the cloud, duplicates do not count
+ */
+void AppUpServerPrintDeliveries(Node* node) {
+	map<int, AppUpDelivery>* deliveries = AppUpGetNodeData(node)->deliveries;
+	Int64 sizeUnique = 0;
+	Int64 sizeDuplicate = 0;
+	Int64 numDuplicates = 0;
+
+	if(deliveries->empty()) return;
+	for(map<int, AppUpDelivery>::iterator it = deliveries->begin();
+			it != deliveries->end();
+			++it) {
+		sizeUnique += it->second.size;
+		sizeDuplicate += (Int64)it->second.size * it->second.numDuplicates;
+		numDuplicates += it->second.numDuplicates;
+	}
+	printf("UP server: %s stats uniqueChunks=%lld uniqueKB=%lld "
+			"duplicates=%lld duplicateKB=%lld\n",
+			node->hostname,
+			(long long)deliveries->size(),
+			(long long)sizeUnique,
+			(long long)numDuplicates,
+			(long long)sizeDuplicate);
+}
+
+/*
+ * Record the current item of a session and report a complete chunk to
+ * the MDC daemon, called once its last byte arrives, or for an item left
+ * short when the next one begins or at close
+ */
+void AppUpServerReportItem(
+		Node* node,
+		AppDataUpServer* serverPtr) {
+	char clockInSecond[MAX_STRING_LENGTH];
+	AppUpServerItemData* itemData;
+
+	TIME_PrintClockInSecond(node->getNodeTime(), clockInSecond);
+	itemData = &serverPtr->itemData;
+	printf("UP server: %s received data, "
+			"identifier=%d itemSizeReceived=%d\n",
+			node->hostname,
+			itemData->dataChunk.identifier,
+			itemData->sizeReceived);
+
+	char serverRecFileName[MAX_STRING_LENGTH];
+	ofstream serverRecFile;
+
+	sprintf(serverRecFileName, "server_%s.out",
+			node->hostname);
+	serverRecFile.open(serverRecFileName, ios::app);
+	if(serverPtr->nodeType == APP_UP_NODE_MDC) {
+		serverRecFile << "MDC";
+	} else if (serverPtr->nodeType == APP_UP_NODE_CLOUD) {
+		serverRecFile << "CLOUD";
+	} else assert(false);
+	// A chunk counts as received only when all segments arrived
+	const char* recvEvent =
+			itemData->sizeReceived < itemData->sizeExpected
+			? "RECV PART" : "RECV DATA";
+
+	if(serverPtr->nodeType == APP_UP_NODE_CLOUD
+			&& itemData->sizeReceived >= itemData->sizeExpected
+			&& !AppUpServerRecordDelivery(
+					node,
+					&itemData->dataChunk,
+					MAPPING_GetNodeIdFromInterfaceAddress(
+							node,
+							serverPtr->remoteAddr))) {
+		recvEvent = "RECV DUPL";
+	}
+	serverRecFile << " "
+			<< node->hostname
+			<< " " << recvEvent << " "
+			<< itemData->dataChunk.identifier
+			<< " " << "AT TIME" << " "
+			<< clockInSecond
+			<< std::endl;
+	serverRecFile.close();
+
+	// Report data chunk information to daemon
+	if(itemData->sizeReceived == itemData->sizeExpected
+			&& serverPtr->nodeType == APP_UP_NODE_MDC) {
+		Message* msg;
+		ActionData acnData;
+		int infoSize = sizeof(int);
+		int packetSize = sizeof(AppUpClientDaemonDataChunkStr);
+		int chunkIdentifier;
+
+		chunkIdentifier = itemData->dataChunk.identifier;
+
+		msg = MESSAGE_Alloc(node,
+				APP_LAYER,
+				APP_UP_CLIENT_DAEMON /*APP_UP_CLIENT*/,
+				MSG_APP_UP_DataChunkReceived);
+		MESSAGE_SetInstanceId(msg,
+				AppUpClientDaemonGetMdc(node)->daemonId);
+		MESSAGE_InfoAlloc(node, msg, infoSize);
+		memcpy(MESSAGE_ReturnInfo(msg), &chunkIdentifier, infoSize);
+		if(chunkIdentifier > 0) {
+			MESSAGE_PacketAlloc(node, msg, packetSize, TRACE_UP);
+			memcpy(MESSAGE_ReturnPacket(msg),
+					&itemData->dataChunk,
+					packetSize);
+		}
+
+		//Trace Information
+		acnData.actionType = SEND;
+		acnData.actionComment = NO_COMMENT;
+		TRACE_PrintTrace(node, msg, TRACE_APPLICATION_LAYER,
+				PACKET_OUT, &acnData);
+		MESSAGE_Send(node, msg, (clocktype)0);
+	}
+
+	AppUpServerRecordItemStats(node, serverPtr);
+}
+
+/*
+ * Session statistics cover one item, from its header to its last byte
+ */
+void AppUpServerRecordItemStats(
+		Node* node,
+		AppDataUpServer* serverPtr) {
+	if (node->appData.appStats) {
+		AppUpStatsRecordSession(
+				node,
+				AppUpGetNodeData(node)->serverStats,
+				serverPtr->nodeType == APP_UP_NODE_MDC
+						? "MDC" : "CLOUD",
+				serverPtr->itemData.dataChunk.identifier,
+				-1,
+				serverPtr->itemData.sizeReceived
+						- serverPtr->itemData.sizeResumed,
+				node->getNodeTime() - serverPtr->itemStart);
+	}
+}
+
+/*
+ * Node-wide UP state, allocated on first use
+ */
+AppUpNodeData* AppUpGetNodeData(Node* node) {
+	AppUpNodeData* nodeData = (AppUpNodeData*)node->appData.upData;
+
+	if(nodeData == NULL) {
+		nodeData = (AppUpNodeData*)MEM_malloc(sizeof(AppUpNodeData));
+		memset(nodeData, 0, sizeof(AppUpNodeData));
+		nodeData->receivedRanges = new map<int, AppUpServerReceivedRange>;
+		nodeData->daemons = new vector<AppDataUpClientDaemon*>;
+		nodeData->deliveries = new map<int, AppUpDelivery>;
+		nodeData->servers = new vector<AppDataUpServer*>;
+		nodeData->serverSlabs = new vector<AppDataUpServer*>;
+		node->appData.upData = nodeData;
+	}
+	return nodeData;
+}
+
+/*
+ * Called when a new connection is opened on a client node
+ * Match an existing client structure with uniqueId
+ * Update it with connectionId
+ */
+AppDataUpClient*
+AppUpClientUpdateUpClient(Node *node,
+	TransportToAppOpenResult *openResult)
+{
+	AppInfo *appList = node->appData.appPtr;
+	AppDataUpClient *tmpUpClient = NULL;
+	AppDataUpClient *upClient = NULL;
+	char localAddrStr[MAX_STRING_LENGTH];
+	char remoteAddrStr[MAX_STRING_LENGTH];
+
+	for (; appList != NULL; appList = appList->appNext)
+	{
+		if (appList->appType == APP_UP_CLIENT)
+		{
+			tmpUpClient = (AppDataUpClient *) appList->appDetail;
+
+			if (tmpUpClient->uniqueId == openResult->uniqueId)
+			{
+				upClient = tmpUpClient;
+				break;
+			}
+		}
+	}
+	assert (upClient != NULL);
+
+	// Fill in
+	upClient->connectionId = openResult->connectionId;
+	upClient->localAddr = openResult->localAddr;
+	upClient->remoteAddr = openResult->remoteAddr;
+	upClient->localPort = openResult->localPort;
+	upClient->remotePort = openResult->remotePort;
+	upClient->sessionIsClosed = false;
+	upClient->sessionStart = node->getNodeTime();
+	upClient->sessionFinish = node->getNodeTime();
+
+	IO_ConvertIpAddressToString(&upClient->localAddr, localAddrStr);
+	IO_ConvertIpAddressToString(&upClient->remoteAddr, remoteAddrStr);
+	printf("UP client: %s:%d -> %s:%d, connectionId=%d\n",
+			localAddrStr, upClient->localPort,
+			remoteAddrStr, upClient->remotePort,
+			upClient->connectionId);
+	return upClient;
+}
+
+AppUpClientPacketList* AppUpClientPacketListAppend(
+		AppUpClientPacketList* list,
+		AppUpClientPacketList* item) {
+	if(list == NULL) {
+		list = item;
+	} else { // list != NULL
+		AppUpClientPacketList* ptr = list;
+
+//		assert(ptr != NULL);
+		while(ptr->next != NULL) {
+			ptr = ptr->next;
+		}
+		ptr->next = item;
+	}
+	return list;
+}
+
+void AppUpSendGeneralMessageToServer(Node* node, clocktype delay) {
+	Message* msg;
+
+	msg = MESSAGE_Alloc(node, APP_LAYER, APP_UP_SERVER, MSG_APP_UP);
+	MESSAGE_Send(node, msg, delay);
+}
+
+void AppUpSendGeneralMessageToClient(Node* node, clocktype delay) {
 	Message* msg;
 
 	msg = MESSAGE_Alloc(node, APP_LAYER, APP_UP_CLIENT, MSG_APP_UP);
@@ -1208,7 +1778,8 @@ void AppUpClientDaemonInit(
 		NodeAddress destNodeId,
 		char* inputString,
 		char* appName,
-		AppUpNodeType nodeType) {
+		AppUpNodeType nodeType,
+		const NodeInput* nodeInput) {
 	AppDataUpClientDaemon* clientDaemonPtr;
 
 	clientDaemonPtr = AppUpClientNewUpClientDaemon(
@@ -1225,7 +1796,13 @@ void AppUpClientDaemonInit(
 		assert(false);
 	}
 	if(clientDaemonPtr->nodeType == APP_UP_NODE_MDC) {
+		AppUpClientDaemonInitLinkModel(node, clientDaemonPtr, nodeInput);
+		AppUpClientDaemonInitRateModel(node, clientDaemonPtr, nodeInput);
+		AppUpClientDaemonCheckPartitions(node, clientDaemonPtr);
 		AppUpClientDaemonSetNextPathTimer(node, (clocktype)0, true);
+#ifdef APP_UP_HANDOFF
+		AppUpClientDaemonSetNextHandoffTimer(node, clientDaemonPtr);
+#endif
 		char daemonRecFileName[MAX_STRING_LENGTH];
 		ofstream daemonRecFile;
 
@@ -1277,12 +1854,75 @@ AppDataUpClientDaemon* AppUpClientNewUpClientDaemon(
 	upClientDaemon->dataChunks = NULL;
 	upClientDaemon->getNextDataChunk = NULL;
 	upClientDaemon->policy = APP_UP_ADAPTION_UNINITIALIZED;
+	upClientDaemon->policyFunc = NULL;
 	upClientDaemon->specs = new std::map<int, AppUpAccessPointSpec*>;
 	upClientDaemon->currentRate = 0.0;
 	upClientDaemon->historyRates = new std::map<int, float>;
+	upClientDaemon->contactTimes = new std::map<int, float>;
+	upClientDaemon->contactPredictions =
+			new std::map<int, AppUpContactPrediction>;
+	upClientDaemon->contactPredictionTime = -1;
+	upClientDaemon->contactPredictionPath = NULL;
+	upClientDaemon->contactPredictionSpeed = 0.0;
+	upClientDaemon->replanAId = -1;
+	upClientDaemon->replanGeneration = 0;
+	upClientDaemon->replanJobs = new vector<AppUpAsyncPlanJob*>;
+	upClientDaemon->rateHint = 0.0;
+	upClientDaemon->ratePrior = 0.0;
+	upClientDaemon->rateModelFile = NULL;
+	upClientDaemon->linkUp = false;
+	upClientDaemon->idleClient = NULL;
+	upClientDaemon->retryId = 0;
+	upClientDaemon->apPositions = new std::map<int, Coordinates>;
+	upClientDaemon->contactStats = new std::map<int, AppUpContactStat>;
+	upClientDaemon->stats = NULL;
+	upClientDaemon->instruments = NULL;
+	if(node->appData.appStats) {
+		upClientDaemon->stats = AppUpStatsNew();
+		upClientDaemon->instruments =
+				new std::map<pair<int, int>, AppUpInstrument*>;
+	}
+	upClientDaemon->contactJoinTime = (clocktype)0;
+	upClientDaemon->contactFirstByte = (clocktype)0;
+	upClientDaemon->contactBusy = (clocktype)0;
+	upClientDaemon->contactBytes = 0;
+	memset(&upClientDaemon->timeline, 0, sizeof(AppUpContactTimeline));
+	upClientDaemon->timelineHists = NULL;
+#ifdef APP_UP_CONTACT_TIMELINE
+	if(node->appData.appStats) {
+		upClientDaemon->timelineHists = (AppUpHistogram*)MEM_malloc(
+				sizeof(AppUpHistogram) * APP_UP_TIMELINE_NUM);
+		for(int i = 0; i < APP_UP_TIMELINE_NUM; i++) {
+			AppUpHistogramInit(
+					&upClientDaemon->timelineHists[i],
+					APP_UP_HIST_UNIT_TIME);
+		}
+	}
+#endif
+	upClientDaemon->linkModel = APP_UP_LINK_FULL;
+	upClientDaemon->linkRateCurve = NULL;
+	upClientDaemon->linkCandidateAId = -1;
+	upClientDaemon->linkCandidateTime = (clocktype)0;
+	upClientDaemon->linkRate = 0.0;
+	upClientDaemon->linkTickId = 0;
+	memset(&upClientDaemon->linkTransfer, 0, sizeof(AppUpAbstractTransfer));
+	upClientDaemon->linkTransfer.chunkIdentifier = -1;
+	upClientDaemon->pathDone = false;
+	upClientDaemon->handoffPeer = 0;
+	upClientDaemon->handoffBudget = 0.0;
+	upClientDaemon->handoffReserved = 0.0;
+	upClientDaemon->handoffPeers = new std::map<NodeAddress, AppUpHandoffPeer>;
+	upClientDaemon->burstClient = NULL;
+	memset(&upClientDaemon->contactGlobal, 0, sizeof(AppUpContactStat));
 	upClientDaemon->currentSizeTotal = 0;
 	upClientDaemon->currentTimeTotal = (clocktype)0;
 	upClientDaemon->lastAId = 0;
+	upClientDaemon->sendingClient = NULL;
+	upClientDaemon->lastPreemptTime = (clocktype)0;
+	upClientDaemon->stopArriveTime = (clocktype)0;
+	upClientDaemon->legStartTime = (clocktype)0;
+	upClientDaemon->legBudget = 0.0;
+	upClientDaemon->legBaseSpeed = 0.0;
 
 	if (appName) {
 		upClientDaemon->applicationName = new std::string(appName);
@@ -1303,38 +1943,31 @@ AppDataUpClientDaemon* AppUpClientNewUpClientDaemon(
 				policyName,
 				specFileName);
 		assert(numValues >= 2 && numValues <= 4);
-		if(numValues <= 2) {
-			upClientDaemon->policy = APP_UP_ADAPTION_STRICT_PLAN;
-			upClientDaemon->getNextDataChunk =
-						AppUpClientDaemonGNDCStrictPlan;
-		} else if(numValues == 3) {
-			if(strcmp(policyName,        "EVERYTHING" ) == 0
-				|| strcmp(policyName,    "OPPORTUNITY") == 0) {
-				upClientDaemon->policy = APP_UP_ADAPTION_OPPORTUNITY;
-				upClientDaemon->getNextDataChunk =
-						AppUpClientDaemonGNDCOpportunity;
-				assert(strcmp(planFileName, "-") == 0);
-			} else if(strcmp(policyName, "STRICT_PLAN") == 0) {
-				upClientDaemon->policy = APP_UP_ADAPTION_STRICT_PLAN;
-				upClientDaemon->getNextDataChunk =
-						AppUpClientDaemonGNDCStrictPlan;
+		/* Resolve policy */ {
+			const AppUpPolicyEntry* entry;
+
+			if(numValues <= 2) {
+				entry = AppUpPolicyFindById(APP_UP_ADAPTION_STRICT_PLAN);
+			} else {
+				entry = AppUpPolicyFind(policyName);
+			}
+			if(entry == NULL || entry->needsSpecs != (numValues >= 4)) {
+				char errorString[MAX_STRING_LENGTH];
+
+				sprintf(errorString,
+						"UP: %s has unknown policy %s or %s AP spec file\n",
+						node->hostname,
+						policyName,
+						numValues >= 4 ? "an unexpected" : "no");
+				ERROR_ReportError(errorString);
 			}
-		} else if(numValues >= 4) {
-			if(strcmp(policyName,        "TIMELINE"   ) == 0) {
-				upClientDaemon->policy = APP_UP_ADAPTION_TIMELINE;
-				upClientDaemon->getNextDataChunk =
-						AppUpClientDaemonGNDCTimeline;
-			} else if(strcmp(policyName, "ADAPTIVE_GP") == 0) {
-				upClientDaemon->policy = APP_UP_ADAPTION_ADAPTIVE_GP;
-				upClientDaemon->getNextDataChunk =
-						AppUpClientDaemonGNDCAdaptiveGP;
-			} else if(strcmp(policyName, "CONTROL_TH") == 0) {
-				upClientDaemon->policy = APP_UP_ADAPTION_CONTROL_TH;
-				upClientDaemon->getNextDataChunk =
-						AppUpClientDaemonGNDCControlTh;
+			if(entry->policy == APP_UP_ADAPTION_OPPORTUNITY) {
+				assert(strcmp(planFileName, "-") == 0);
 			}
-		} else assert(false);
-		assert(upClientDaemon->policy >= 0);
+			upClientDaemon->policy = entry->policy;
+			upClientDaemon->policyFunc = entry->func;
+			upClientDaemon->getNextDataChunk = AppUpClientDaemonGNDCPolicy;
+		}
 
 		/* Read path */ {
 			ifstream pathFile;
@@ -1374,6 +2007,7 @@ AppDataUpClientDaemon* AppUpClientNewUpClientDaemon(
 						tmpStop->lsAId->insert(
 								pair<int, int>(idA, APP_UP_PLAN_TASK_INIT));
 						upClientDaemon->lastAId = idA;
+						(*upClientDaemon->apPositions)[idA] = tmpStop->crds;
 					}
 					assert(j == numA);
 				}
@@ -1601,6 +2235,9 @@ AppDataUpClientDaemon* AppUpClientNewUpClientDaemon(
 				}
 				upClientDaemon->dataChunks->deadline = dataChunkDeadline;
 				upClientDaemon->dataChunks->dirty = 0;
+				upClientDaemon->dataChunks->partial = 0;
+				upClientDaemon->dataChunks->sizeDone = 0;
+				upClientDaemon->dataChunks->sizeSegment = 0;
 				upClientDaemon->dataChunks->next = NULL;
 			}
 		} else { // Multiple data chunks at same data site
@@ -1670,6 +2307,9 @@ AppDataUpClientDaemon* AppUpClientNewUpClientDaemon(
 					}
 					upClientDaemon->dataChunks->deadline = dataChunkDeadline;
 					upClientDaemon->dataChunks->dirty = 0;
+					upClientDaemon->dataChunks->partial = 0;
+					upClientDaemon->dataChunks->sizeDone = 0;
+					upClientDaemon->dataChunks->sizeSegment = 0;
 					upClientDaemon->dataChunks->next = lastChunkPtr;
 				}
 				++linesRead;
@@ -1683,6 +2323,34 @@ AppDataUpClientDaemon* AppUpClientNewUpClientDaemon(
 	} else assert(false);
 
 	// Register
+	AppUpNodeData* nodeData = AppUpGetNodeData(node);
+
+	if(nodeType == APP_UP_NODE_MDC) {
+		if(nodeData->mdcDaemon != NULL) {
+			char errorString[MAX_STRING_LENGTH];
+
+			sprintf(errorString,
+					"UP: %s runs more than one MDC, "
+					"one path can drive a node\n",
+					node->hostname);
+			ERROR_ReportError(errorString);
+		}
+		nodeData->mdcDaemon = upClientDaemon;
+	}
+	upClientDaemon->daemonId = (int)nodeData->daemons->size();
+	nodeData->daemons->push_back(upClientDaemon);
+	RANDOM_SetSeed(upClientDaemon->retrySeed,
+			node->globalSeed,
+			node->nodeId,
+			APP_UP_CLIENT_DAEMON,
+			upClientDaemon->daemonId * APP_UP_SEED_STREAMS
+					+ APP_UP_SEED_RETRY);
+	RANDOM_SetSeed(upClientDaemon->linkSeed,
+			node->globalSeed,
+			node->nodeId,
+			APP_UP_CLIENT_DAEMON,
+			upClientDaemon->daemonId * APP_UP_SEED_STREAMS
+					+ APP_UP_SEED_LINK);
 	APP_RegisterNewApp(node, APP_UP_CLIENT_DAEMON, upClientDaemon);
 	return upClientDaemon;
 }
@@ -1694,7 +2362,8 @@ void AppLayerUpClientDaemon(Node *node, Message *msg) {
 	char daemonRecFileName[MAX_STRING_LENGTH];
 	ofstream daemonRecFile;
 
-	clientDaemonPtr = AppUpClientGetUpClientDaemon(node);
+	clientDaemonPtr = AppUpClientDaemonGet(node, msg->instanceId);
+	AppUpClientDaemonFanOut(node, msg);
 	sprintf(daemonRecFileName, "daemon_%s.out", node->hostname);
 	TIME_PrintClockInSecond(node->getNodeTime(), clockInSecond);
 /*	printf("UP client: %s at time %s processed an event\n",
@@ -1740,8 +2409,13 @@ void AppLayerUpClientDaemon(Node *node, Message *msg) {
 //		clientDaemonPtr = AppUpClientGetUpClientDaemon(node);
 //		assert(clientDaemonPtr != NULL);
 		if(!clientDaemonPtr) break;
+		if(clientDaemonPtr->nodeType == APP_UP_NODE_MDC
+				&& clientDaemonPtr->linkModel == APP_UP_LINK_ABSTRACT) {
+			break; // Contacts come from abstract link model
+		}
 
 		clientDaemonPtr->connAttempted = 0;
+		clientDaemonPtr->linkUp = true;
 //		clientDaemonPtr->sending = 0;
 
 		if(clientDaemonPtr->nodeType == APP_UP_NODE_MDC) {
@@ -1756,36 +2430,19 @@ void AppLayerUpClientDaemon(Node *node, Message *msg) {
 					node->hostname,
 					macData->stationMIB->dot11DesiredSSID,
 					bssAddrIdentifier);
-			clientDaemonPtr->joinedAId = bssAddrIdentifier;
-
-			AppUpPathStop* nextStop = clientDaemonPtr->path;
-			int joinedAId = clientDaemonPtr->joinedAId;
-
-			// Initialize dynamic statistics
-			clientDaemonPtr->currentRate = 0.0;
-			if(clientDaemonPtr->specs->count(joinedAId) > 0) {
-				clientDaemonPtr->currentRate =
-						clientDaemonPtr->specs->at(joinedAId)->estRate;
-			}
-			clientDaemonPtr->currentSizeTotal = 0;
-			clientDaemonPtr->currentTimeTotal = (clocktype)0;
-
-			// Mark corresponding task as going
-			assert(nextStop);
-			if(nextStop->lsAId->count(joinedAId) > 0) {
-				nextStop->lsAId->at(joinedAId) =
-						APP_UP_PLAN_TASK_WAIT;
-			} else { // Connected to another AP
-				for(AppUpPathStop* ptrStop = nextStop;
-						ptrStop;
-						ptrStop = ptrStop->next) {
-					if(ptrStop->lsAId->count(joinedAId) > 0) {
-						ptrStop->lsAId->at(joinedAId) =
-								APP_UP_PLAN_TASK_WAIT;
-						break;
-					}
-				}
-			}
+			AppUpClientDaemonJoinA(
+					node,
+					clientDaemonPtr,
+					bssAddrIdentifier,
+					macData->upScanStartTime,
+					macData->upAuthStartTime,
+					macData->upAssocStartTime);
+		} else if(clientDaemonPtr->nodeType == APP_UP_NODE_DATA_SITE) {
+			// MDCs are identified like APs, by their BSS address
+			AppUpClientDaemonJoinMdc(
+					node,
+					clientDaemonPtr,
+					bssAddrArray[4] * 256 + bssAddrArray[5]);
 		}
 
 		// Print coordinates
@@ -1875,6 +2532,7 @@ void AppLayerUpClientDaemon(Node *node, Message *msg) {
 				"%*s %s %s",
 				sourceString,
 				destString);
+		sprintf(destString, "%u", clientDaemonPtr->destNodeId);
 		IO_AppParseSourceAndDestStrings(
 				clientDaemonPtr->firstNode,
 				clientDaemonPtr->inputString->c_str(),
@@ -1937,7 +2595,8 @@ void AppLayerUpClientDaemon(Node *node, Message *msg) {
 					sourceString,
 					clientDaemonPtr->nodeType,
 					waitTime,
-					NULL);
+					NULL,
+					clientDaemonPtr->daemonId);
 
 			daemonRecFile.open(daemonRecFileName, ios::app);
 			daemonRecFile << "MDC" << " "
@@ -1963,10 +2622,19 @@ void AppLayerUpClientDaemon(Node *node, Message *msg) {
 	case MSG_APP_UP_DataChunkDelivered: {
 		int chunkIdentifier;
 		clocktype uploadTime;
+		Int32 itemOffset;
+		Int32 itemLength;
 		AppUpClientDaemonDataChunkStr* chunk;
+		AppUpClientDaemonDataChunkStr* chunkPtr = NULL;
+		bool chunkFinished = true;
+		AppDataUpClient* deliveredClient;
 
 		chunkIdentifier = *(int*)MESSAGE_ReturnInfo(msg);
 		uploadTime = *(clocktype*)(MESSAGE_ReturnInfo(msg) + sizeof(int));
+		itemOffset = *(Int32*)(MESSAGE_ReturnInfo(msg) + sizeof(int)
+				+ sizeof(clocktype));
+		itemLength = *(Int32*)(MESSAGE_ReturnInfo(msg) + sizeof(int)
+				+ sizeof(clocktype) + sizeof(Int32));
 		chunk = (AppUpClientDaemonDataChunkStr*)MESSAGE_ReturnPacket(msg);
 
 /*		char daemonRecFileName[MAX_STRING_LENGTH];
@@ -1981,6 +2649,16 @@ void AppLayerUpClientDaemon(Node *node, Message *msg) {
 
 		clientDaemonPtr->connAttempted = 0;
 		clientDaemonPtr->sending -= 1;
+		deliveredClient = clientDaemonPtr->sendingClient;
+		clientDaemonPtr->sendingClient = NULL;
+		if(clientDaemonPtr->handoffPeer != 0) {
+			AppUpClientDaemonHandoffDone(
+					node,
+					clientDaemonPtr,
+					chunkIdentifier,
+					true);
+			break;
+		}
 
 		printf("UP client daemon: %s delivered data chunk, "
 				"identifier=%d sending=%d\n",
@@ -1988,18 +2666,36 @@ void AppLayerUpClientDaemon(Node *node, Message *msg) {
 				chunkIdentifier,
 				clientDaemonPtr->sending);
 
+		// Track segment progress, chunk is done when its last byte is sent
+		if(chunkIdentifier > 0) {
+			for(chunkPtr = clientDaemonPtr->dataChunks;
+					chunkPtr;
+					chunkPtr = chunkPtr->next) {
+				if(chunkPtr->identifier == chunkIdentifier) {
+					break;
+				}
+			}
+			if(chunkPtr) {
+				chunkPtr->sizeDone = (itemOffset + itemLength) / 1024;
+				chunkPtr->partial = 0;
+				chunkFinished = chunkPtr->sizeDone >= chunkPtr->size;
+			}
+		}
+
 		if(clientDaemonPtr->nodeType == APP_UP_NODE_MDC) {
 			// Update dynamic statistics
 			int chunkSize = APP_UP_MDC_TEST_DATA_SIZE;
 			float averageRate;
 
-			if(chunkIdentifier > 0) chunkSize = chunk->size;
+			// Only the bytes of this session went over the air
+			if(chunkIdentifier > 0) chunkSize = itemLength / 1024;
 			averageRate = chunkSize / ((double)uploadTime / SECOND);
 
-			if(averageRate * 0 == 0.0) { // Avoid inf or NaN
+			if(chunkSize > 0 && averageRate * 0 == 0.0) { // Avoid inf or NaN
 				clientDaemonPtr->currentRate =
 						clientDaemonPtr->currentRate * 0.2
 						+ averageRate * 0.8;
+				AppUpClientDaemonCheckRateDeviation(node, clientDaemonPtr);
 			}
 			clientDaemonPtr->currentSizeTotal += chunkSize;
 			clientDaemonPtr->currentTimeTotal += uploadTime;
@@ -2013,7 +2709,7 @@ void AppLayerUpClientDaemon(Node *node, Message *msg) {
 			daemonRecFile.open(daemonRecFileName, ios::app);
 			daemonRecFile << "MDC" << " "
 					<< node->hostname
-					<< " " << "SENT DATA" << " "
+					<< " " << (chunkFinished ? "SENT DATA" : "SENT PART") << " "
 					<< chunkIdentifier
 					<< " " << "AT TIME" << " "
 					<< clockInSecond
@@ -2021,18 +2717,72 @@ void AppLayerUpClientDaemon(Node *node, Message *msg) {
 			daemonRecFile.close();
 		}
 
-		if(chunkIdentifier > 0) {
-			for(AppUpClientDaemonDataChunkStr* chunkPtr =
-					clientDaemonPtr->dataChunks;
-					chunkPtr;
-					chunkPtr = chunkPtr->next) {
-				if(chunkPtr->identifier == chunkIdentifier) {
-					chunkPtr->dirty |= 2; // Set finish bit
-					break;
-				}
+		// Statistics
+		if(node->appData.appStats) {
+			AppUpStatsRecordSession(
+					node,
+					clientDaemonPtr->stats,
+					clientDaemonPtr->nodeType == APP_UP_NODE_MDC
+							? "MDC" : "DATASITE",
+					chunkIdentifier,
+					clientDaemonPtr->joinedAId,
+					itemLength,
+					uploadTime);
+			if(chunkPtr && chunkFinished) {
+				AppUpStatsRecordDeadline(
+						clientDaemonPtr->stats,
+						node->getNodeTime() / SECOND
+								<= (clocktype)chunkPtr->deadline);
+			}
+		}
+		if(clientDaemonPtr->nodeType == APP_UP_NODE_MDC
+				&& clientDaemonPtr->joinedAId > 0) {
+			int joinedAId = clientDaemonPtr->joinedAId;
+
+			AppUpClientDaemonInstrument(
+					node,
+					clientDaemonPtr,
+					joinedAId,
+					APP_UP_INSTRUMENT_UPLOAD_TIME,
+					(double)uploadTime / SECOND);
+			if(clientDaemonPtr->contactFirstByte == 0
+					&& clientDaemonPtr->contactJoinTime > 0) {
+				clientDaemonPtr->contactFirstByte =
+						node->getNodeTime() - uploadTime;
+				AppUpClientDaemonInstrument(
+						node,
+						clientDaemonPtr,
+						joinedAId,
+						APP_UP_INSTRUMENT_JOIN_TO_FIRST_BYTE,
+						(double)(clientDaemonPtr->contactFirstByte
+								- clientDaemonPtr->contactJoinTime) / SECOND);
+			}
+			clientDaemonPtr->contactBusy += uploadTime;
+			clientDaemonPtr->contactBytes += itemLength;
+#ifdef APP_UP_CONTACT_TIMELINE
+			AppUpClientDaemonTimelineSession(
+					node,
+					clientDaemonPtr,
+					deliveredClient,
+					uploadTime,
+					itemLength);
+#endif
+		}
+
+		if(chunkPtr) {
+			if(chunkFinished) {
+				chunkPtr->dirty |= 2; // Set finish bit
+			} else {
+				chunkPtr->dirty &= -2; // Reset work bit for next segment
 			}
 		}
 
+#ifdef APP_UP_DATA_SITE_BURST
+		// Next chunk goes over the open session, close it if none follows
+		if(deliveredClient && deliveredClient->burst) {
+			clientDaemonPtr->burstClient = deliveredClient;
+		}
+#endif
 		if(clientDaemonPtr->test) {
 			AppUpClientDaemonCompAtA(
 					node,
@@ -2044,6 +2794,12 @@ void AppLayerUpClientDaemon(Node *node, Message *msg) {
 					clientDaemonPtr,
 					(clocktype)0);
 		}
+#ifdef APP_UP_DATA_SITE_BURST
+		if(clientDaemonPtr->burstClient) {
+			AppUpClientBurstEnd(node, clientDaemonPtr->burstClient);
+			clientDaemonPtr->burstClient = NULL;
+		}
+#endif
 		break; }
 	case MSG_APP_UP_DataChunkHeaderReceived: {
 		int chunkIdentifier;
@@ -2119,7 +2875,15 @@ void AppLayerUpClientDaemon(Node *node, Message *msg) {
 
 		chunkToAdd->next = clientDaemonPtr->dataChunks;
 		chunkToAdd->dirty = 0;
+		chunkToAdd->partial = 0;
+		chunkToAdd->sizeDone = 0;
+		chunkToAdd->sizeSegment = 0;
 		clientDaemonPtr->dataChunks = chunkToAdd;
+
+		// New chunk may be more urgent than ongoing upload
+		if(clientDaemonPtr->sending > 0 && clientDaemonPtr->joinedAId > 0) {
+			AppUpClientDaemonCheckPreemption(node, clientDaemonPtr);
+		}
 //		assert(nextStop);
 		if(!nextStop) {
 			printf("UP client daemon: %s disregarded past data chunk, "
@@ -2150,10 +2914,10 @@ void AppLayerUpClientDaemon(Node *node, Message *msg) {
 					break;
 				}
 			}
-			if(!ptrStop) {
-				printf("UP client daemon: %s disregarded past data chunk, "
-						"identifier=%d",
-						node->hostname,
+			if(!ptrStop) { // Not picked up on path, handed off by an MDC
+				AppUpClientDaemonAdoptChunk(
+						node,
+						clientDaemonPtr,
 						chunkIdentifier);
 				break;
 			}
@@ -2203,13 +2967,32 @@ void AppLayerUpClientDaemon(Node *node, Message *msg) {
 	case MSG_APP_UP_TransportConnectionFailed: {
 		int chunkIdentifier;
 		AppUpClientDaemonDataChunkStr* chunk;
+		AppUpConnectionFailedInfo failedInfo;
 
-		chunkIdentifier = *(int*)MESSAGE_ReturnInfo(msg);
+		memcpy(&failedInfo,
+				MESSAGE_ReturnInfo(msg),
+				sizeof(AppUpConnectionFailedInfo));
+		chunkIdentifier = failedInfo.chunkIdentifier;
 		chunk = (AppUpClientDaemonDataChunkStr*)MESSAGE_ReturnPacket(msg);
 
 //		clientDaemonPtr = AppUpClientGetUpClientDaemon(node);
 
 		clientDaemonPtr->sending -= 1;
+		clientDaemonPtr->sendingClient = NULL;
+		clientDaemonPtr->idleClient = AppUpClientGetClientPtr(
+				node,
+				failedInfo.uniqueId);
+		if(clientDaemonPtr->handoffPeer != 0) {
+			AppUpClientDaemonHandoffDone(
+					node,
+					clientDaemonPtr,
+					chunkIdentifier,
+					false);
+			break;
+		}
+		if(clientDaemonPtr->stats) {
+			clientDaemonPtr->stats->sessionsFailed += 1;
+		}
 		printf("UP client daemon: %s failed to connect for delivery, "
 				"id=%d connAttempted=%d sending=%d\n",
 				node->hostname,
@@ -2230,37 +3013,7 @@ void AppLayerUpClientDaemon(Node *node, Message *msg) {
 		} else
 		if(clientDaemonPtr->connAttempted < APP_UP_OPEN_CONN_ATTEMPT_MAX) {
 			// Application-layer reconnection handler
-			// Will start a new client application instance
-
-			// Initialize client application
-			char sourceString[MAX_STRING_LENGTH];
-			char destString[MAX_STRING_LENGTH];
-			NodeAddress sourceNodeId;
-			Address sourceAddr;
-			NodeAddress destNodeId;
-			Address destAddr;
-			char sourceAddrStr[MAX_STRING_LENGTH];
-			char destAddrStr[MAX_STRING_LENGTH];
-			int waitTime = 0;
-
-			sscanf(clientDaemonPtr->inputString->c_str(),
-					"%*s %s %s",
-					sourceString,
-					destString);
-			IO_AppParseSourceAndDestStrings(
-					clientDaemonPtr->firstNode,
-					clientDaemonPtr->inputString->c_str(),
-					sourceString,
-					&sourceNodeId,
-					&sourceAddr,
-					destString,
-					&destNodeId,
-					&destAddr);
-/*			printf("UP client daemon: %s will try to connect, "
-					"waitTime=%d\n",
-					node->hostname,
-					waitTime);*/
-
+			// Will reuse the failed client after a backoff
 			if(chunkIdentifier > 0) {
 				for(AppUpClientDaemonDataChunkStr* chunkPtr =
 						clientDaemonPtr->dataChunks;
@@ -2271,34 +3024,11 @@ void AppLayerUpClientDaemon(Node *node, Message *msg) {
 						break;
 					}
 				}
-				AppUpClientDaemonSendNextDataChunk(
-						node,
-						clientDaemonPtr,
-						(clocktype)0);
-			} else if(clientDaemonPtr->nodeType == APP_UP_NODE_MDC) {
-				clientDaemonPtr->sending += 1;
-				AppUpClientInit(
-						node,
-						sourceAddr,
-						destAddr,
-						clientDaemonPtr->applicationName->c_str(),
-						sourceString,
-						clientDaemonPtr->nodeType,
-						waitTime /*0*/,
-						NULL);
 			}
-
-/*			if(clientDaemonPtr->nodeType == APP_UP_NODE_MDC) {
-				daemonRecFile.open(daemonRecFileName, ios::app);
-				daemonRecFile << "MDC" << " "
-					<< node->hostname
-					<< " " << "REPR DATA" << " "
-					<< chunkIdentifier
-					<< " " << "AT TIME" << " "
-					<< clockInSecond
-					<< std::endl;
-				daemonRecFile.close();
-			}*/
+			AppUpClientDaemonScheduleRetry(
+					node,
+					clientDaemonPtr,
+					chunkIdentifier);
 			++clientDaemonPtr->connAttempted;
 		} else {
 			if(clientDaemonPtr->nodeType == APP_UP_NODE_MDC) {
@@ -2310,6 +3040,36 @@ void AppLayerUpClientDaemon(Node *node, Message *msg) {
 			}
 		}
 		break; }
+	case MSG_APP_UP_RetryTimer: {
+		AppUpRetryInfo retryInfo;
+
+		memcpy(&retryInfo, MESSAGE_ReturnInfo(msg), sizeof(AppUpRetryInfo));
+		if(!clientDaemonPtr || retryInfo.retryId != clientDaemonPtr->retryId) {
+			printf("UP client daemon: %s disregarded retry, retryId=%d\n",
+					node->hostname,
+					retryInfo.retryId);
+			break;
+		}
+		if(clientDaemonPtr->nodeType == APP_UP_NODE_MDC
+				&& (clientDaemonPtr->joinedAId < 1
+				|| !clientDaemonPtr->linkUp)) {
+			printf("UP client daemon: %s suppressed retry while "
+					"not associated\n",
+					node->hostname);
+			break;
+		}
+		if(clientDaemonPtr->sending > 0) break;
+
+		if(retryInfo.chunkIdentifier > 0) {
+			AppUpClientDaemonSendNextDataChunk(
+					node,
+					clientDaemonPtr,
+					(clocktype)0);
+		} else if(clientDaemonPtr->nodeType == APP_UP_NODE_MDC) {
+			clientDaemonPtr->sending += 1;
+			AppUpClientDaemonStartClient(node, clientDaemonPtr, NULL, 0);
+		}
+		break; }
 	case MSG_APP_UP_PathTimer:
 		bool initPath;
 
@@ -2340,8 +3100,95 @@ void AppLayerUpClientDaemon(Node *node, Message *msg) {
 					timeoutId);
 		}
 		break; }
+	case MSG_APP_UP_HandoffTimer: {
+		if(!clientDaemonPtr) break;
+		AppUpClientDaemonHandoffCheck(node, clientDaemonPtr);
+		if(clientDaemonPtr->path) {
+			AppUpClientDaemonSetNextHandoffTimer(node, clientDaemonPtr);
+		}
+		break; }
 	case MSG_APP_UP_TerminationTimer: {
-		kill(getpid(), SIGINT);
+		if(!clientDaemonPtr) break;
+		clientDaemonPtr->pathDone = true;
+		if(AppUpClientDaemonAllDone(node)) {
+			printf("\033[1;33m"
+					"UP client daemon: %s ends the simulation, "
+					"all MDCs are done\n"
+					"\033[0m",
+					node->hostname);
+			PARTITION_RequestEndSimulation();
+		}
+		break; }
+	case MSG_APP_UP_FromMacRateHint: {
+		MacDot11UpRateHint hint;
+
+		memcpy(&hint, MESSAGE_ReturnInfo(msg), sizeof(MacDot11UpRateHint));
+		if(!clientDaemonPtr
+				|| clientDaemonPtr->nodeType != APP_UP_NODE_MDC
+				|| clientDaemonPtr->linkModel == APP_UP_LINK_ABSTRACT) {
+			break;
+		}
+		if(AppUpBssAddrToAId(&hint.bssAddr) != clientDaemonPtr->joinedAId) {
+			break;
+		}
+
+		AppUpClientDaemonApplyRateHint(
+				node,
+				clientDaemonPtr,
+				hint.phyRate,
+				hint.rssMean);
+		break; }
+	case MSG_APP_UP_FromMacLinkLost: {
+		MacDot11UpLinkLost linkLost;
+
+		memcpy(&linkLost, MESSAGE_ReturnInfo(msg), sizeof(MacDot11UpLinkLost));
+		if(!clientDaemonPtr
+				|| clientDaemonPtr->nodeType != APP_UP_NODE_MDC
+				|| clientDaemonPtr->linkModel == APP_UP_LINK_ABSTRACT) {
+			break;
+		}
+		AppUpClientDaemonLinkLost(
+				node,
+				clientDaemonPtr,
+				AppUpBssAddrToAId(&linkLost.bssAddr),
+				linkLost.reason);
+		break; }
+	case MSG_APP_UP_AbstractLinkTimer: {
+		int linkTickId;
+
+		linkTickId = *(int*)MESSAGE_ReturnInfo(msg);
+		if(!clientDaemonPtr || linkTickId != clientDaemonPtr->linkTickId) {
+			break; // Superseded by a later tick
+		}
+		AppUpClientDaemonAbstractTick(node, clientDaemonPtr);
+		break; }
+	case MSG_APP_UP_ReplanResult: {
+		AppUpAsyncPlanJob* job;
+		int numChanged;
+
+		memcpy(&job, MESSAGE_ReturnInfo(msg), sizeof(AppUpAsyncPlanJob*));
+		if(!clientDaemonPtr) break;
+		// Waits for the worker if it is not done by now
+		AppUpClientDaemonReplanJoin(clientDaemonPtr, job);
+		if(job->generation != clientDaemonPtr->replanGeneration) {
+			printf("UP client daemon: %s discarded stale plan, "
+					"generation=%d\n",
+					node->hostname,
+					job->generation);
+		} else {
+			numChanged = AppUpClientDaemonPlanApply(
+					node,
+					clientDaemonPtr,
+					&job->planNew);
+			AppUpClientDaemonRecordReplan(
+					node,
+					clientDaemonPtr,
+					job->reason,
+					job->snapshot.chunks.size(),
+					numChanged,
+					job->computeTime);
+		}
+		delete job;
 		break; }
 	default:
 		printf("UP client daemon: %s at time %s received "\
@@ -2353,368 +3200,706 @@ void AppLayerUpClientDaemon(Node *node, Message *msg) {
 	MESSAGE_Free(node, msg);
 }
 
-void AppUpClientDaemonFinalize(Node *node, AppInfo *appInfo) {
-	AppDataUpClient *clientDaemonPtr = (AppDataUpClient*)appInfo->appDetail;
-	char addrStr[MAX_STRING_LENGTH];
-
-//	printf("UP client daemon: Finalized at %s\n", node->hostname);
-
-	// Statistics
-	if(node->appData.appStats) {
-		;
+/*
+ * Merge summary b into a, Chan et al. parallel form of Welford
+ */
+void AppUpRateModelMerge(
+		AppUpRateModelEntry* a,
+		const AppUpRateModelEntry* b) {
+	double n = a->n + b->n;
+	double delta = b->mean - a->mean;
+
+	if(b->n <= 0.0) return;
+	if(a->n <= 0.0) {
+		*a = *b;
+		return;
 	}
+	a->mean += delta * b->n / n;
+	a->m2 += b->m2 + delta * delta * a->n * b->n / n;
+	a->n = n;
 }
 
-AppDataUpClientDaemon*
-AppUpClientGetUpClientDaemon(Node *node)
-{
-	AppInfo *appList = node->appData.appPtr;
-	AppDataUpClientDaemon *upClientDaemon;
-
-	for (; appList != NULL; appList = appList->appNext)
-	{
-		if (appList->appType == APP_UP_CLIENT_DAEMON)
-		{
-			upClientDaemon = (AppDataUpClientDaemon *) appList->appDetail;
-			return upClientDaemon;
-		}
+/*
+ * Returns false if file is missing or of another version
+ */
+bool AppUpRateModelLoad(
+		const char* fileName,
+		map<int, AppUpRateModelEntry>* model) {
+	ifstream modelFile;
+	std::string magic;
+	int version = 0;
+	int numA = 0;
+	int linesRead = 0;
+	int idA;
+	AppUpRateModelEntry entry;
+
+	modelFile.open(fileName);
+	if(!modelFile.is_open()) return false;
+	modelFile >> magic >> version;
+	if(magic != APP_UP_RATE_MODEL_MAGIC
+			|| version != APP_UP_RATE_MODEL_VERSION) {
+		printf("UP rate model: ignored %s of unknown version\n", fileName);
+		modelFile.close();
+		return false;
 	}
-	return NULL;
+	modelFile >> numA;
+	while(linesRead < numA
+			&& modelFile >> idA >> entry.n >> entry.mean >> entry.m2) {
+		(*model)[idA] = entry;
+		++linesRead;
+	}
+	modelFile.close();
+	return linesRead == numA;
 }
 
-int AppUpClientDaemonGNDCEverything(
-		Node *node,
-		AppDataUpClientDaemon* clientDaemonPtr) {
-	int chunkId = -1;
-	int chunkDeadline = -1;
-	float chunkPriority = 0.0;
-
-	for(AppUpClientDaemonDataChunkStr* chunkPtr = clientDaemonPtr->dataChunks;
-			chunkPtr;
-			chunkPtr = chunkPtr->next) {
-		if(chunkPtr->dirty == 0) {
-			if(chunkId < 0 || chunkPriority < chunkPtr->priority
-					|| (chunkPriority == chunkPtr->priority
-							&& chunkDeadline > chunkPtr->deadline)) {
-				chunkId = chunkPtr->identifier;
-				chunkDeadline = chunkPtr->deadline;
-				chunkPriority = chunkPtr->priority;
-			}
-		}
+/*
+ * Write to a temporary file and rename, so that a model is never read
+ * half written. Runs sharing a file still lose each other's updates
+ * between load and save, give concurrent runs a file each
+ */
+bool AppUpRateModelSave(
+		const char* fileName,
+		map<int, AppUpRateModelEntry>* model) {
+	char tmpFileName[MAX_STRING_LENGTH];
+	ofstream modelFile;
+
+	sprintf(tmpFileName, "%s.%d", fileName, (int)getpid());
+	modelFile.open(tmpFileName);
+	if(!modelFile.is_open()) return false;
+	modelFile << APP_UP_RATE_MODEL_MAGIC << " "
+			<< APP_UP_RATE_MODEL_VERSION << std::endl;
+	modelFile << model->size() << std::endl;
+	for(map<int, AppUpRateModelEntry>::iterator it = model->begin();
+			it != model->end();
+			++it) {
+		modelFile << it->first << " "
+				<< it->second.n << " "
+				<< it->second.mean << " "
+				<< it->second.m2 << std::endl;
 	}
-	return chunkId;
+	modelFile.close();
+	return rename(tmpFileName, fileName) == 0;
 }
 
-int AppUpClientDaemonGNDCStrictPlan(
-		Node *node,
+/*
+ * Rate model is kept only if UP-RATE-MODEL-FILE is given, so that runs
+ * do not depend on earlier runs by default
+ */
+void AppUpClientDaemonInitRateModel(
+		Node* node,
+		AppDataUpClientDaemon* clientDaemonPtr,
+		const NodeInput* nodeInput) {
+	char buf[MAX_STRING_LENGTH];
+	BOOL wasFound = FALSE;
+
+	if(nodeInput == NULL) return;
+	IO_ReadString(node->nodeId,
+			ANY_ADDRESS,
+			nodeInput,
+			"UP-RATE-MODEL-FILE",
+			&wasFound,
+			buf);
+	if(!wasFound) return;
+	clientDaemonPtr->rateModelFile = new std::string(buf);
+	AppUpClientDaemonLoadRateModel(node, clientDaemonPtr);
+}
+
+/*
+ * Blend learned rates into prior specifications
+ */
+void AppUpClientDaemonLoadRateModel(
+		Node* node,
 		AppDataUpClientDaemon* clientDaemonPtr) {
-	map<int, int>* plan = clientDaemonPtr->plan;
-	int joinedAId = clientDaemonPtr->joinedAId;
-	int chunkId = -1;
-	int chunkDeadline = -1;
-	float chunkPriority = 0.0;
+	map<int, AppUpRateModelEntry> model;
 
-	if(joinedAId < 1) return chunkId; // -1
-	for(AppUpClientDaemonDataChunkStr* chunkPtr = clientDaemonPtr->dataChunks;
-			chunkPtr;
-			chunkPtr = chunkPtr->next) {
-		if(plan->count(chunkPtr->identifier) > 0
-		&& plan->at(chunkPtr->identifier) == joinedAId
-		&& chunkPtr->dirty == 0) {
-			if(chunkId < 0 || chunkPriority < chunkPtr->priority
-					|| (chunkPriority == chunkPtr->priority
-							&& chunkDeadline > chunkPtr->deadline)) {
-				chunkId = chunkPtr->identifier;
-				chunkDeadline = chunkPtr->deadline;
-				chunkPriority = chunkPtr->priority;
-			}
-		}
+	if(!AppUpRateModelLoad(
+			clientDaemonPtr->rateModelFile->c_str(),
+			&model)) {
+		return;
+	}
+	for(map<int, AppUpRateModelEntry>::iterator it = model.begin();
+			it != model.end();
+			++it) {
+		AppUpAccessPointSpec* specPtr;
+		double n = it->second.n;
+
+		if(clientDaemonPtr->specs->count(it->first) < 1) continue;
+		if(n > APP_UP_RATE_MODEL_N_MAX) n = APP_UP_RATE_MODEL_N_MAX;
+		specPtr = clientDaemonPtr->specs->at(it->first);
+		specPtr->estRate = (int)((specPtr->estRate
+				* APP_UP_RATE_MODEL_PRIOR_WEIGHT + it->second.mean * n)
+				/ (APP_UP_RATE_MODEL_PRIOR_WEIGHT + n));
+		printf("UP client daemon: %s learned rate of AP, "
+				"identifier=%d estRate=%d n=%.1f\n",
+				node->hostname,
+				it->first,
+				specPtr->estRate,
+				it->second.n);
 	}
-	return chunkId;
 }
 
-int AppUpClientDaemonGNDCTimeline(
-		Node *node,
+/*
+ * Merge rates measured in this run into stored model
+ * Older runs are decayed so that the model follows changes
+ */
+void AppUpClientDaemonStoreRateModel(
+		Node* node,
 		AppDataUpClientDaemon* clientDaemonPtr) {
-	int joinedAId = clientDaemonPtr->joinedAId;
-	int chunkId = -1;
-	map<int, int>* plan = clientDaemonPtr->plan;
-	int numChunksThisAId = 0;
-	float estCompTime = 0.0;
+	map<int, AppUpRateModelEntry> model;
 
-	if(joinedAId < 1) return chunkId; // -1
-	if(clientDaemonPtr->specs->count(joinedAId) > 0) {
-		estCompTime = clientDaemonPtr->specs->at(joinedAId)->estCompTime;
+	if(!clientDaemonPtr || clientDaemonPtr->nodeType != APP_UP_NODE_MDC
+			|| !clientDaemonPtr->rateModelFile) {
+		return;
 	}
-	for(map<int, int>::iterator it = plan->begin(); it != plan->end(); ++it) {
-		if(it->second == joinedAId) {
-			++numChunksThisAId;
-		}
+	AppUpRateModelLoad(clientDaemonPtr->rateModelFile->c_str(), &model);
+	for(map<int, AppUpRateModelEntry>::iterator it = model.begin();
+			it != model.end();
+			++it) {
+		it->second.n *= APP_UP_RATE_MODEL_DECAY;
+		it->second.m2 *= APP_UP_RATE_MODEL_DECAY;
 	}
-
-	bool left = false;
-	int chunkDeadline = -1;
-	float chunkPriority = 0.0;
-
-	for(AppUpClientDaemonDataChunkStr* chunkPtr = clientDaemonPtr->dataChunks;
-			chunkPtr;
-			chunkPtr = chunkPtr->next) {
-		if(plan->count(chunkPtr->identifier) > 0
-		&& plan->at(chunkPtr->identifier) == joinedAId
-		&& (chunkPtr->dirty & 2) == 0) {
-			// This chunk is planned here and not uploaded yet
-			left = true;
-			if((chunkPtr->dirty & 1) != 0)
-				continue;
-		} else continue;
-
-		// Do not choose it if completion time is to be exceeded
-		if((double)node->getNodeTime() / SECOND
-				+ chunkPtr->size / clientDaemonPtr->currentRate
-			> estCompTime + APP_UP_GNDC_TIMELINE_GRACE_PERIOD) {
-			continue;
-		}
-
-		if(chunkId < 1 || chunkPriority < chunkPtr->priority
-				|| (chunkPriority == chunkPtr->priority
-						&& chunkDeadline > chunkPtr->deadline)) {
-			chunkId = chunkPtr->identifier;
-			chunkDeadline = chunkPtr->deadline;
-			chunkPriority = chunkPtr->priority;
+	for(map<int, float>::iterator it = clientDaemonPtr->historyRates->begin();
+			it != clientDaemonPtr->historyRates->end();
+			++it) {
+		AppUpRateModelEntry entry;
+
+		if(it->second <= 0.0) continue; // Failed contact
+		entry.n = 1.0;
+		entry.mean = it->second;
+		entry.m2 = 0.0;
+		if(model.count(it->first) < 1) {
+			model[it->first] = entry;
+		} else {
+			AppUpRateModelMerge(&model[it->first], &entry);
 		}
 	}
-	if(chunkId > 0) return chunkId;
-
-	if(!left) { // All chunks in plan are uploaded
-		bool chunkMeetDeadline = false;
-		int chunkSize = -1;
+	if(!AppUpRateModelSave(
+			clientDaemonPtr->rateModelFile->c_str(),
+			&model)) {
+		printf("UP client daemon: %s failed to store rate model to %s\n",
+				node->hostname,
+				clientDaemonPtr->rateModelFile->c_str());
+	}
+}
 
-		for(AppUpClientDaemonDataChunkStr* chunkPtr = clientDaemonPtr->dataChunks;
-				chunkPtr;
-				chunkPtr = chunkPtr->next) {
-			float estUpTime = (double)node->getNodeTime() / SECOND
-					+ chunkPtr->size / clientDaemonPtr->currentRate;
-			bool meetDeadline = estUpTime <= chunkPtr->deadline;
+void AppUpClientDaemonFinalize(Node *node, AppInfo *appInfo) {
+	AppDataUpClient *clientDaemonPtr = (AppDataUpClient*)appInfo->appDetail;
+	char addrStr[MAX_STRING_LENGTH];
 
-			// Do not choose it if completion time is to be exceeded
-			if(estUpTime > estCompTime) {
-				continue;
-			}
+	AppUpClientDaemonStoreRateModel(
+			node,
+			(AppDataUpClientDaemon*)appInfo->appDetail);
 
-			//Try to get a small chunk with high priority
-			if(chunkPtr->dirty == 0) {
-				if(chunkId < 1 || (!chunkMeetDeadline && meetDeadline)
-						|| chunkPriority < chunkPtr->priority
-						|| (chunkPriority == chunkPtr->priority
-								&& chunkSize > chunkPtr->size)) {
-					chunkId = chunkPtr->identifier;
-					chunkPriority = chunkPtr->priority;
-					chunkSize = chunkPtr->size;
-				}
-			}
-		}
-	}
-	if(chunkId > 0) return chunkId;
+//	printf("UP client daemon: Finalized at %s\n", node->hostname);
 
-	// If this is last opportunity, upload everything
-	if(AppUpClientDaemonIsAtLastA(node, clientDaemonPtr))
-		chunkId = AppUpClientDaemonGNDCEverything(node, clientDaemonPtr);
-	return chunkId;
-}
-int AppUpClientDaemonGNDCAdaptiveGP(
-		Node *node,
-		AppDataUpClientDaemon* clientDaemonPtr) {
-	int joinedAId = clientDaemonPtr->joinedAId;
-	int chunkId = -1;
-	map<int, int>* plan = clientDaemonPtr->plan;
-	int numChunksThisAId = 0;
-	float estCompTime = 0.0;
-
-	// Evaluate history data
-	map<int, float>* history = clientDaemonPtr->historyRates;
-	int historyEvalDif1 = 0;
-	int historyEvalDif2 = 0;
-	int historyEvalComp =
-			round((clientDaemonPtr->currentRate - 300) / APP_UP_GNDC_RATE_STEP);
-
-	if(historyEvalComp < 0) historyEvalComp = 0;
-	if(history->size() > 0) {
-		vector<float> historyDiff;
-		float sumDiff = 0.0;
-
-		for(map<int, float>::iterator it = history->begin();
-				it != history->end();
-				++it) {
-			if(clientDaemonPtr->specs->count(it->first) > 0) {
-				historyDiff.push_back(it->second
-						- clientDaemonPtr->specs->at(it->first)->estRate);
-				sumDiff += round(abs(it->second
-						- clientDaemonPtr->specs->at(it->first)->estRate)
-								/ APP_UP_GNDC_RATE_STEP);
-			}
-		}
-		for(int k = historyDiff.size() - 1; k >= 0; --k) {
-			if(round(historyDiff[k] / APP_UP_GNDC_RATE_STEP) < 0) {
-				historyEvalDif1 +=
-						round(historyDiff[k] / APP_UP_GNDC_RATE_STEP);
-			} else break;
-		}
-		if(historyEvalDif1 >= 0) {
-			historyEvalDif1 = historyDiff[historyDiff.size() - 1];
-		}
-		historyEvalDif2 = sumDiff / historyDiff.size();
+	// Results past the end of simulation are never applied
+	vector<AppUpAsyncPlanJob*>* replanJobs =
+			((AppDataUpClientDaemon*)appInfo->appDetail)->replanJobs;
 
-		// Evaluate actual rate history
-		vector<float> historyComp;
-		float sumComp = 0.0;
+	while(!replanJobs->empty()) {
+		AppUpAsyncPlanJob* job = replanJobs->back();
 
-		for(map<int, float>::iterator it = history->begin();
-				it != history->end();
-				++it) {
-			if(clientDaemonPtr->specs->count(it->first) > 0) {
-				historyComp.push_back(clientDaemonPtr->currentRate
-						- it->second);
-				sumComp += round(clientDaemonPtr->currentRate - it->second)
-						/ APP_UP_GNDC_RATE_STEP;
-			}
-		}
-		historyEvalComp += sumComp / historyComp.size();
+		pthread_join(job->thread, NULL);
+		replanJobs->pop_back();
+		delete job;
 	}
 
-	// Determine grace period
-	float gracePeriod = round(APP_UP_GNDC_ADAPTIVE_GRACE_PERIOD
-			* log2(numChunksThisAId + 1)
-			* (2 + abs(historyEvalDif1) + historyEvalDif2 * historyEvalComp));
+	// Statistics, last contact is closed and state freed either way
+	AppDataUpClientDaemon* upClientDaemon =
+			(AppDataUpClientDaemon*)appInfo->appDetail;
 
-	if(joinedAId < 1) return chunkId; // -1
-	if(clientDaemonPtr->specs->count(joinedAId) > 0) {
-		estCompTime = clientDaemonPtr->specs->at(joinedAId)->estCompTime;
+#ifdef APP_UP_CONTACT_TIMELINE
+	AppUpClientDaemonTimelineClose(node, upClientDaemon);
+#endif
+	if(node->appData.appStats) {
+		AppUpStatsPrint(node, upClientDaemon->stats, "client daemon");
+		AppUpClientDaemonWriteInstruments(node, upClientDaemon);
+		AppUpClientDaemonTimelinePrint(node, upClientDaemon);
 	}
-	for(map<int, int>::iterator it = plan->begin(); it != plan->end(); ++it) {
-		if(it->second == joinedAId) {
-			++numChunksThisAId;
-		}
+	AppUpStatsDelete(upClientDaemon->stats);
+	upClientDaemon->stats = NULL;
+	AppUpClientDaemonDeleteInstruments(upClientDaemon);
+	if(upClientDaemon->timelineHists) {
+		MEM_free(upClientDaemon->timelineHists);
+		upClientDaemon->timelineHists = NULL;
 	}
+}
 
-	bool left = false;
-	int chunkDeadline = -1;
-	float chunkPriority = 0.0;
+AppDataUpClientDaemon*
+AppUpClientGetUpClientDaemon(Node *node)
+{
+	return AppUpClientDaemonGet(node, 0);
+}
 
-	for(AppUpClientDaemonDataChunkStr* chunkPtr = clientDaemonPtr->dataChunks;
-			chunkPtr;
-			chunkPtr = chunkPtr->next) {
-		if(plan->count(chunkPtr->identifier) > 0
-		&& plan->at(chunkPtr->identifier) == joinedAId
-		&& (chunkPtr->dirty & 2) == 0) {
-			// This chunk is planned here and not uploaded yet
-			left = true;
-			if((chunkPtr->dirty & 1) != 0)
-				continue;
-		} else continue;
-
-		// Do not choose it if completion time is to be exceeded
-		if((double)node->getNodeTime() / SECOND
-				+ chunkPtr->size / clientDaemonPtr->currentRate
-			> estCompTime + gracePeriod) {
-			continue;
-		}
+/*
+ * Daemon of node by daemonId, NULL if there is none
+ */
+AppDataUpClientDaemon* AppUpClientDaemonGet(Node* node, int daemonId) {
+	AppUpNodeData* nodeData = (AppUpNodeData*)node->appData.upData;
 
-		if(chunkId < 1 || chunkPriority < chunkPtr->priority
-				|| (chunkPriority == chunkPtr->priority
-						&& chunkDeadline > chunkPtr->deadline)) {
-			chunkId = chunkPtr->identifier;
-			chunkDeadline = chunkPtr->deadline;
-			chunkPriority = chunkPtr->priority;
-		}
+	if(nodeData == NULL
+			|| daemonId < 0
+			|| daemonId >= (int)nodeData->daemons->size()) {
+		return NULL;
 	}
-	if(chunkId > 0) return chunkId;
+	return (*nodeData->daemons)[daemonId];
+}
+
+/*
+ * MDC daemon of node, NULL on cloud and data sites
+ */
+AppDataUpClientDaemon* AppUpClientDaemonGetMdc(Node* node) {
+	AppUpNodeData* nodeData = (AppUpNodeData*)node->appData.upData;
 
-	if(!left) { // All chunks in plan are uploaded
-		bool chunkMeetDeadline = false;
-		int chunkSize = -1;
+	if(nodeData == NULL) return NULL;
+	return nodeData->mdcDaemon;
+}
 
-		for(AppUpClientDaemonDataChunkStr* chunkPtr =
-					clientDaemonPtr->dataChunks;
-				chunkPtr;
-				chunkPtr = chunkPtr->next) {
-			float estUpTime = (double)node->getNodeTime() / SECOND
-					+ chunkPtr->size / clientDaemonPtr->currentRate;
-			bool meetDeadline = estUpTime <= chunkPtr->deadline;
-
-			// Do not choose it if completion time is to be exceeded
-			if(estUpTime > estCompTime
-					+ (historyEvalDif1 > 0 ? gracePeriod : 0)) {
-				continue;
-			}
+/*
+ * MAC events are addressed to the node, every daemon on it gets a copy
+ */
+void AppUpClientDaemonFanOut(Node* node, Message* msg) {
+	AppUpNodeData* nodeData = (AppUpNodeData*)node->appData.upData;
+	ActionData acnData;
 
-			//Try to get a small chunk with high priority
-			if(chunkPtr->dirty == 0) {
-				if(chunkId < 1 || (!chunkMeetDeadline && meetDeadline)
-						|| chunkPriority < chunkPtr->priority
-						|| (chunkPriority == chunkPtr->priority
-								&& chunkSize > chunkPtr->size)) {
-					chunkId = chunkPtr->identifier;
-					chunkPriority = chunkPtr->priority;
-					chunkSize = chunkPtr->size;
-				}
-			}
-		}
+	if(msg->instanceId != 0 || nodeData == NULL) return;
+	if(msg->eventType != MSG_APP_UP_FromMacJoinCompleted
+			&& msg->eventType != MSG_APP_UP_FromMacRateHint
+			&& msg->eventType != MSG_APP_UP_FromMacLinkLost) {
+		return;
 	}
-	if(chunkId > 0) return chunkId;
+	for(size_t i = 1; i < nodeData->daemons->size(); ++i) {
+		Message* copy = MESSAGE_Duplicate(node, msg);
 
-	// If this is last opportunity, upload everything
-	if(AppUpClientDaemonIsAtLastA(node, clientDaemonPtr))
-		chunkId = AppUpClientDaemonGNDCEverything(node, clientDaemonPtr);
-	return chunkId;
-}
+		MESSAGE_SetInstanceId(copy, (short)i);
 
-int AppUpClientDaemonGNDCControlTh(
-		Node *node,
-		AppDataUpClientDaemon* clientDaemonPtr) {
-	int joinedAId = clientDaemonPtr->joinedAId;
-	int chunkId = -1;
-	float estCompTime = 0.0;
-	float currentTime = (double)node->getNodeTime() / SECOND;
+		//Trace Information
+		acnData.actionType = SEND;
+		acnData.actionComment = NO_COMMENT;
+		TRACE_PrintTrace(node, copy, TRACE_APPLICATION_LAYER,
+				PACKET_OUT, &acnData);
+		MESSAGE_Send(node, copy, (clocktype)0);
+	}
+}
 
-	if(joinedAId < 1) return chunkId; // -1
-	if(clientDaemonPtr->specs->count(joinedAId) > 0) {
-		estCompTime = clientDaemonPtr->specs->at(joinedAId)->estCompTime;
+/*
+ * Data site joined an MDC, upload to it rather than the configured one
+ */
+void AppUpClientDaemonJoinMdc(
+		Node* node,
+		AppDataUpClientDaemon* clientDaemonPtr,
+		int mdcId) {
+	Node* mdcNode = MAPPING_GetNodePtrFromHash(
+			node->partitionData->nodeIdHash,
+			(NodeAddress)mdcId);
+
+	if(mdcNode == NULL || AppUpClientDaemonGetMdc(mdcNode) == NULL) {
+		return; // Not an MDC of this partition, keep destination
+	}
+	if(clientDaemonPtr->destNodeId != (NodeAddress)mdcId) {
+		printf("UP client daemon: %s is served by MDC %s\n",
+				node->hostname,
+				mdcNode->hostname);
+		clientDaemonPtr->destNodeId = (NodeAddress)mdcId;
 	}
+}
 
-	int queueSize = 0;
+/*
+ * Warn about what MDCs cannot see across partitions, per MDC for its
+ * cloud and once per run for the rest
+ */
+void AppUpClientDaemonCheckPartitions(
+		Node* node,
+		AppDataUpClientDaemon* clientDaemonPtr) {
+	static bool warned = false;
+	char warningString[MAX_STRING_LENGTH];
+
+	if(node->partitionData->numPartitions < 2) return;
+#ifdef APP_UP_CLOUD_DEDUP
+	if(MAPPING_GetNodePtrFromHash(
+			node->partitionData->nodeIdHash,
+			clientDaemonPtr->destNodeId) == NULL) {
+		sprintf(warningString,
+				"UP: %s has its cloud on another partition, "
+				"chunks the cloud holds are not skipped\n",
+				node->hostname);
+		ERROR_ReportWarning(warningString);
+	}
+#endif
+	if(node->partitionData->partitionId != 0 || warned) return;
+	warned = true;
+
+	sprintf(warningString,
+			"UP: %d partitions, simulation is not ended early "
+			"once all MDCs are done\n",
+			node->partitionData->numPartitions);
+	ERROR_ReportWarning(warningString);
+#ifdef APP_UP_HANDOFF
+	ERROR_ReportWarning(
+			"UP: MDCs hand off chunks only to MDCs of their own partition\n");
+#endif
+}
 
-	for(AppUpClientDaemonDataChunkStr* chunkPtr = clientDaemonPtr->dataChunks;
-			chunkPtr;
-			chunkPtr = chunkPtr->next) {
-		if(chunkPtr->dirty < 2)
-			++queueSize;
+/*
+ * True when every MDC daemon of the run has finished its path
+ * MDCs on other partitions are not visible, so runs with more than one
+ * end at their configured time
+ */
+bool AppUpClientDaemonAllDone(Node* node) {
+	Node* nodePtr;
+
+	if(node->partitionData->numPartitions > 1) return false;
+	for(nodePtr = node->partitionData->firstNode;
+			nodePtr != NULL;
+			nodePtr = nodePtr->nextNodeData) {
+		AppDataUpClientDaemon* clientDaemonPtr =
+				AppUpClientDaemonGetMdc(nodePtr);
+
+		if(clientDaemonPtr && !clientDaemonPtr->pathDone) {
+			return false;
+		}
+	}
+	return true;
+}
+
+/*
+ * Gather what policies read from daemon, computed once per decision
+ */
+void AppUpClientDaemonPolicyState(
+		Node* node,
+		AppDataUpClientDaemon* clientDaemonPtr,
+		AppUpPolicyState* state) {
+	int joinedAId = clientDaemonPtr->joinedAId;
+
+	state->dataChunks = clientDaemonPtr->dataChunks;
+	state->plan = clientDaemonPtr->plan;
+	state->specs = clientDaemonPtr->specs;
+	state->historyRates = clientDaemonPtr->historyRates;
+	state->joinedAId = joinedAId;
+	state->currentRate = clientDaemonPtr->currentRate;
+	state->currentTime = (double)node->getNodeTime() / SECOND;
+	state->estCompTime = 0.0;
+	if(joinedAId > 0 && clientDaemonPtr->specs->count(joinedAId) > 0) {
+		state->estCompTime = AppUpClientDaemonEstCompTime(
+				node,
+				clientDaemonPtr,
+				joinedAId);
 	}
+	state->segmentSize = AppUpClientDaemonSegmentTarget(node, clientDaemonPtr);
+	state->atLastA = AppUpClientDaemonIsAtLastA(node, clientDaemonPtr);
+}
 
-	float chunkEval = 0.0;
-	float eval;
+int AppUpClientDaemonGNDCEverything(
+		Node *node,
+		AppDataUpClientDaemon* clientDaemonPtr) {
+	AppUpPolicyState state;
 
-	for(AppUpClientDaemonDataChunkStr* chunkPtr = clientDaemonPtr->dataChunks;
-			chunkPtr;
-			chunkPtr = chunkPtr->next) {
-		if(chunkPtr->dirty > 0) continue;
-		eval = APP_UP_CONTROL_THEORY_K1 * queueSize * chunkPtr->size
-				+ chunkPtr->priority * AppUpObjectiveF(currentTime
-					+ chunkPtr->size / clientDaemonPtr->currentRate
-					- chunkPtr->deadline)
-				- APP_UP_CONTROL_THEORY_K3 * (currentTime - estCompTime)
-					* chunkPtr->size / clientDaemonPtr->currentRate;
-		if(eval < 0) continue;
-		if(chunkId < 1 || eval > chunkEval) {
-			chunkId = chunkPtr->identifier;
-			chunkEval = eval;
+	AppUpClientDaemonPolicyState(node, clientDaemonPtr, &state);
+	return AppUpPolicyEverything(&state);
+}
+
+/*
+ * Next chunk by the policy configured for daemon
+ */
+int AppUpClientDaemonGNDCPolicy(
+		Node *node,
+		AppDataUpClientDaemon* clientDaemonPtr) {
+	AppUpPolicyState state;
+
+	AppUpClientDaemonPolicyState(node, clientDaemonPtr, &state);
+	return clientDaemonPtr->policyFunc(&state);
+}
+
+/*
+ * Value of uploading the rest of a chunk per second of airtime
+ */
+float AppUpClientDaemonChunkValue(
+		Node* node,
+		AppDataUpClientDaemon* clientDaemonPtr,
+		AppUpClientDaemonDataChunkStr* chunkPtr) {
+	float currentTime = (double)node->getNodeTime() / SECOND;
+	float estUpTime;
+
+	if(clientDaemonPtr->currentRate <= 0.0) return 0.0;
+	estUpTime = AppUpClientDaemonChunkSizeLeft(chunkPtr)
+			/ clientDaemonPtr->currentRate;
+	if(estUpTime < 1.0) estUpTime = 1.0;
+	return chunkPtr->priority
+			* AppUpObjectiveF(currentTime + estUpTime - chunkPtr->deadline)
+			/ estUpTime;
+}
+
+/*
+ * Pause ongoing upload if policy now prefers a much more valuable chunk
+ * Paused chunk is marked partial and resumes from server offset later
+ */
+bool AppUpClientDaemonCheckPreemption(
+		Node* node,
+		AppDataUpClientDaemon* clientDaemonPtr) {
+	char clockInSecond[MAX_STRING_LENGTH];
+	char daemonRecFileName[MAX_STRING_LENGTH];
+	ofstream daemonRecFile;
+	AppDataUpClient* clientPtr = clientDaemonPtr->sendingClient;
+	AppUpClientDaemonDataChunkStr* ongoingPtr;
+	AppUpClientDaemonDataChunkStr* urgentPtr;
+	clocktype timeNow = node->getNodeTime();
+	float ongoingValue;
+	float urgentValue;
+	int urgentId;
+
+#ifdef APP_UP_PREEMPTION
+	if(clientDaemonPtr->nodeType != APP_UP_NODE_MDC) return false;
+	if(clientDaemonPtr->handoffPeer != 0) return false;
+	if(clientPtr == NULL || clientPtr->preempted) return false;
+	ongoingPtr = clientPtr->dataChunk;
+	if(ongoingPtr == NULL || (ongoingPtr->dirty & 1) == 0) return false;
+	if(clientDaemonPtr->lastPreemptTime > 0 && timeNow
+			< clientDaemonPtr->lastPreemptTime
+				+ (clocktype)(APP_UP_PREEMPT_HOLD_TIME * SECOND)) {
+		return false;
+	}
+
+	// Not worth it if ongoing upload is about to finish
+	if(clientDaemonPtr->currentRate <= 0.0
+			|| (clientPtr->itemLeft / 1024) / clientDaemonPtr->currentRate
+				< APP_UP_PREEMPT_MIN_TIME_LEFT) {
+		return false;
+	}
+
+	// Ongoing chunk is still marked working, so policy picks another one
+	urgentId = clientDaemonPtr->getNextDataChunk(node, clientDaemonPtr);
+	if(urgentId <= 0) return false;
+	for(urgentPtr = clientDaemonPtr->dataChunks;
+			urgentPtr;
+			urgentPtr = urgentPtr->next) {
+		if(urgentPtr->identifier == urgentId) {
+			break;
 		}
 	}
-	if(chunkId > 0) return chunkId;
+	assert(urgentPtr);
+
+	ongoingValue = AppUpClientDaemonChunkValue(
+			node, clientDaemonPtr, ongoingPtr);
+	urgentValue = AppUpClientDaemonChunkValue(
+			node, clientDaemonPtr, urgentPtr);
+	if(urgentValue <= ongoingValue * (1 + APP_UP_PREEMPT_HYSTERESIS)) {
+		return false;
+	}
+
+	printf("UP client daemon: %s preempted data chunk, "
+			"identifier=%d value=%.4f by identifier=%d value=%.4f\n",
+			node->hostname,
+			ongoingPtr->identifier,
+			ongoingValue,
+			urgentId,
+			urgentValue);
+	TIME_PrintClockInSecond(timeNow, clockInSecond);
+	sprintf(daemonRecFileName, "daemon_%s.out", node->hostname);
+	daemonRecFile.open(daemonRecFileName, ios::app);
+	daemonRecFile << "MDC" << " "
+			<< node->hostname
+			<< " " << "PMPT DATA" << " "
+			<< ongoingPtr->identifier
+			<< " " << "AT TIME" << " "
+			<< clockInSecond
+			<< std::endl;
+	daemonRecFile.close();
+
+	clientPtr->preempted = true;
+	clientDaemonPtr->sendingClient = NULL;
+	clientDaemonPtr->sending -= 1;
+	clientDaemonPtr->lastPreemptTime = timeNow;
+
+	// Dispatch before releasing ongoing chunk so it is not picked again
+	AppUpClientDaemonSendNextDataChunk(node, clientDaemonPtr, 0);
+	ongoingPtr->partial = 1;
+	ongoingPtr->dirty &= -2; // Reset work bit
+	return true;
+#else
+	return false;
+#endif
+}
+
+/*
+ * Segment size in KB that fills what is left of the predicted contact,
+ * 0 if chunks are not segmented
+ */
+int AppUpClientDaemonSegmentTarget(
+		Node* node,
+		AppDataUpClientDaemon* clientDaemonPtr) {
+	int joinedAId = clientDaemonPtr->joinedAId;
+	int sizeSegment;
+	double contactLeft;
+
+#ifdef APP_UP_SEGMENTATION
+	if(clientDaemonPtr->nodeType != APP_UP_NODE_MDC) return 0;
+	if(joinedAId < 1 || clientDaemonPtr->specs->count(joinedAId) < 1) {
+		return 0;
+	}
+	if(clientDaemonPtr->currentRate <= 0.0) return 0;
+
+	contactLeft = AppUpClientDaemonEstCompTime(node, clientDaemonPtr, joinedAId)
+			- (double)node->getNodeTime() / SECOND;
+	sizeSegment = (int)(clientDaemonPtr->currentRate * contactLeft
+			* APP_UP_SEGMENT_FILL_RATIO);
+	if(sizeSegment < APP_UP_SEGMENT_SIZE_MIN) {
+		sizeSegment = APP_UP_SEGMENT_SIZE_MIN;
+	}
+	return sizeSegment;
+#else
+	return 0;
+#endif
+}
+
+/*
+ * Size of next segment of a chunk in KB, or 0 to send the rest of it
+ */
+int AppUpClientDaemonSegmentSize(
+		Node* node,
+		AppDataUpClientDaemon* clientDaemonPtr,
+		AppUpClientDaemonDataChunkStr* chunkPtr) {
+	int sizeSegment = AppUpClientDaemonSegmentTarget(node, clientDaemonPtr);
+
+	if(sizeSegment >= AppUpClientDaemonChunkSizeLeft(chunkPtr)) return 0;
+	return sizeSegment;
+}
+
+int AppUpClientDaemonChunkSizeLeft(
+		AppUpClientDaemonDataChunkStr* chunkPtr) {
+	return AppUpPolicyChunkSizeLeft(chunkPtr);
+}
+
+/*
+ * Size in KB that the next upload of a chunk will carry
+ */
+int AppUpClientDaemonChunkSizeNext(
+		Node* node,
+		AppDataUpClientDaemon* clientDaemonPtr,
+		AppUpClientDaemonDataChunkStr* chunkPtr) {
+	int sizeSegment = AppUpClientDaemonSegmentSize(
+			node,
+			clientDaemonPtr,
+			chunkPtr);
+
+	if(sizeSegment > 0) return sizeSegment;
+	return AppUpClientDaemonChunkSizeLeft(chunkPtr);
+}
+
+/*
+ * Open connection for chunk, reusing client of last failed attempt
+ */
+AppDataUpClient* AppUpClientDaemonStartClient(
+		Node* node,
+		AppDataUpClientDaemon* clientDaemonPtr,
+		AppUpClientDaemonDataChunkStr* chunkPtr,
+		int waitTime) {
+	AppDataUpClient* clientPtr = clientDaemonPtr->idleClient;
+	char sourceString[MAX_STRING_LENGTH];
+	char destString[MAX_STRING_LENGTH];
+	NodeAddress sourceNodeId;
+	Address sourceAddr;
+	NodeAddress destNodeId;
+	Address destAddr;
+
+	NodeAddress serverNodeId = clientDaemonPtr->handoffPeer != 0
+			? clientDaemonPtr->handoffPeer : clientDaemonPtr->destNodeId;
+
+#ifdef APP_UP_DATA_SITE_BURST
+	if(clientDaemonPtr->burstClient) {
+		clientPtr = clientDaemonPtr->burstClient;
+		clientDaemonPtr->burstClient = NULL;
+		AppUpClientSendNext(node, clientPtr, chunkPtr);
+		return clientPtr;
+	}
+#endif
+	clientDaemonPtr->idleClient = NULL;
+	if(clientPtr && clientPtr->destNodeId == serverNodeId) {
+		AppUpClientReopen(node, clientPtr, chunkPtr, waitTime);
+#ifdef APP_UP_DATA_SITE_BURST
+		clientPtr->burst =
+				clientDaemonPtr->nodeType == APP_UP_NODE_DATA_SITE;
+#endif
+		return clientPtr;
+	}
+
+	sscanf(clientDaemonPtr->inputString->c_str(),
+			"%*s %s %s",
+			sourceString,
+			destString);
+	sprintf(destString, "%u", serverNodeId);
+	IO_AppParseSourceAndDestStrings(
+			clientDaemonPtr->firstNode,
+			clientDaemonPtr->inputString->c_str(),
+			sourceString,
+			&sourceNodeId,
+			&sourceAddr,
+			destString,
+			&destNodeId,
+			&destAddr);
+	clientPtr = AppUpClientInit(
+			node,
+			sourceAddr,
+			destAddr,
+			clientDaemonPtr->applicationName->c_str(),
+			sourceString,
+			clientDaemonPtr->nodeType,
+			waitTime,
+			chunkPtr,
+			clientDaemonPtr->daemonId);
+#ifdef APP_UP_DATA_SITE_BURST
+	clientPtr->burst = clientDaemonPtr->nodeType == APP_UP_NODE_DATA_SITE;
+#endif
+	return clientPtr;
+}
+
+/*
+ * Retry after exponential backoff with jitter
+ */
+void AppUpClientDaemonScheduleRetry(
+		Node* node,
+		AppDataUpClientDaemon* clientDaemonPtr,
+		int chunkIdentifier) {
+	Message* msg;
+	ActionData acnData;
+	AppUpRetryInfo retryInfo;
+	double delay = APP_UP_RETRY_DELAY_BASE;
+
+	for(int i = 0;
+			i < clientDaemonPtr->connAttempted && delay < APP_UP_RETRY_DELAY_MAX;
+			++i) {
+		delay *= 2;
+	}
+	if(delay > APP_UP_RETRY_DELAY_MAX) delay = APP_UP_RETRY_DELAY_MAX;
+	delay *= AppUpUniDist(
+			1 - APP_UP_RETRY_JITTER,
+			1 + APP_UP_RETRY_JITTER,
+			RANDOM_erand(clientDaemonPtr->retrySeed));
+
+	clientDaemonPtr->retryId += 1;
+	retryInfo.retryId = clientDaemonPtr->retryId;
+	retryInfo.chunkIdentifier = chunkIdentifier;
+
+	msg = MESSAGE_Alloc(node,
+			APP_LAYER,
+			APP_UP_CLIENT_DAEMON,
+			MSG_APP_UP_RetryTimer);
+	MESSAGE_SetInstanceId(msg, clientDaemonPtr->daemonId);
+	MESSAGE_InfoAlloc(node, msg, sizeof(AppUpRetryInfo));
+	memcpy(MESSAGE_ReturnInfo(msg), &retryInfo, sizeof(AppUpRetryInfo));
+
+	printf("UP client daemon: %s will retry in %.2fs, "
+			"retryId=%d connAttempted=%d\n",
+			node->hostname,
+			delay,
+			retryInfo.retryId,
+			clientDaemonPtr->connAttempted);
 
-	// If this is last opportunity, upload everything
-	if(AppUpClientDaemonIsAtLastA(node, clientDaemonPtr))
-		chunkId = AppUpClientDaemonGNDCEverything(node, clientDaemonPtr);
-	return chunkId;
+	//Trace Information
+	acnData.actionType = SEND;
+	acnData.actionComment = NO_COMMENT;
+	TRACE_PrintTrace(node, msg, TRACE_APPLICATION_LAYER,
+			PACKET_OUT, &acnData);
+	MESSAGE_Send(node, msg, (clocktype)(delay * SECOND));
 }
 
 void AppUpClientDaemonSendNextDataChunk(
@@ -2732,6 +3917,13 @@ void AppUpClientDaemonSendNextDataChunk(
 
 	TIME_PrintClockInSecond(node->getNodeTime(), clockInSecond);
 	chunkIdToSend = getNextDataChunk(node, clientDaemonPtr);
+	if(chunkIdToSend <= 0 && !clientDaemonPtr->test
+			&& AppUpClientDaemonDwellExtend(node, clientDaemonPtr)) {
+		// Keep using a good AP for chunks policy did not choose here
+		chunkIdToSend = AppUpClientDaemonGNDCEverything(
+				node,
+				clientDaemonPtr);
+	}
 	if(chunkIdToSend > 0) {
 		AppUpClientDaemonDataChunkStr* chunkPtr;
 
@@ -2744,24 +3936,31 @@ void AppUpClientDaemonSendNextDataChunk(
 		}
 		assert(chunkPtr);
 		chunkPtr->dirty |= 1; // Set work bit
+		chunkPtr->sizeSegment = AppUpClientDaemonSegmentSize(
+				node,
+				clientDaemonPtr,
+				chunkPtr);
 //		MEM_free(chunkHeader);
 
 		clientDaemonPtr->sending += 1;
 		printf("UP client daemon: %s will try to connect, "
-				"waitTime=%d sending=%d\n",
+				"waitTime=%d sending=%d sizeDone=%d sizeSegment=%d\n",
 				node->hostname,
 				waitTime,
-				clientDaemonPtr->sending);
+				clientDaemonPtr->sending,
+				chunkPtr->sizeDone,
+				chunkPtr->sizeSegment);
 //		TIME_PrintClockInSecond(node->getNodeTime(), clockInSecond);
-		AppUpClientInit(
-				node,
-				sourceAddr,
-				destAddr,
-				clientDaemonPtr->applicationName->c_str(),
-				sourceString,
-				clientDaemonPtr->nodeType,
-				waitTime,
-				chunkPtr);
+		if(clientDaemonPtr->nodeType == APP_UP_NODE_MDC
+				&& clientDaemonPtr->linkModel == APP_UP_LINK_ABSTRACT) {
+			AppUpClientDaemonAbstractStart(node, clientDaemonPtr, chunkPtr);
+		} else {
+			clientDaemonPtr->sendingClient = AppUpClientDaemonStartClient(
+					node,
+					clientDaemonPtr,
+					chunkPtr,
+					waitTime);
+		}
 		if(clientDaemonPtr->nodeType == APP_UP_NODE_MDC) {
 			daemonRecFile.open(daemonRecFileName, ios::app);
 			daemonRecFile << "MDC" << " "
@@ -2785,93 +3984,2038 @@ void AppUpClientDaemonSendNextDataChunk(
 	}
 }
 
-void AppUpClientDaemonSendNextDataChunk(
+void AppUpClientDaemonSendNextDataChunk(
+		Node* node,
+		AppDataUpClientDaemon* clientDaemonPtr,
+		int waitTime) {
+	char sourceString[MAX_STRING_LENGTH];
+	char destString[MAX_STRING_LENGTH];
+	NodeAddress sourceNodeId;
+	Address sourceAddr;
+	NodeAddress destNodeId;
+	Address destAddr;
+	char sourceAddrStr[MAX_STRING_LENGTH];
+	char destAddrStr[MAX_STRING_LENGTH];
+	char daemonRecFileName[MAX_STRING_LENGTH];
+
+	sscanf(clientDaemonPtr->inputString->c_str(),
+			"%*s %s %s",
+			sourceString,
+			destString);
+	IO_AppParseSourceAndDestStrings(
+			clientDaemonPtr->firstNode,
+			clientDaemonPtr->inputString->c_str(),
+			sourceString,
+			&sourceNodeId,
+			&sourceAddr,
+			destString,
+			&destNodeId,
+			&destAddr);
+	sprintf(daemonRecFileName, "daemon_%s.out", node->hostname);
+	AppUpClientDaemonSendNextDataChunk(
+			node,
+			clientDaemonPtr,
+			clientDaemonPtr->getNextDataChunk,
+			sourceAddr,
+			destAddr,
+			sourceString,
+			waitTime,
+			daemonRecFileName);
+}
+
+/*
+ * Expected upload rate at an AP in KB/s
+ * Prefer measured rate of current contact, then history, then prior
+ */
+float AppUpClientDaemonExpectedRate(
+		Node* node,
+		AppDataUpClientDaemon* clientDaemonPtr,
+		int aId) {
+	if(aId < 1) return 0.0;
+	if(aId == clientDaemonPtr->joinedAId
+			&& clientDaemonPtr->currentRate > 0.0) {
+		return clientDaemonPtr->currentRate;
+	}
+	if(clientDaemonPtr->historyRates->count(aId) > 0
+			&& clientDaemonPtr->historyRates->at(aId) > 0.0) {
+		return clientDaemonPtr->historyRates->at(aId);
+	}
+	if(clientDaemonPtr->specs->count(aId) > 0) {
+		return clientDaemonPtr->specs->at(aId)->estRate;
+	}
+	return 0.0;
+}
+
+/*
+ * Objective gained per second of staying at AP with current backlog
+ */
+float AppUpClientDaemonDwellGain(
+		Node* node,
+		AppDataUpClientDaemon* clientDaemonPtr,
+		int aId) {
+	float rate = AppUpClientDaemonExpectedRate(node, clientDaemonPtr, aId);
+	float currentTime = (double)node->getNodeTime() / SECOND;
+	float sumValue = 0.0;
+	int sumSize = 0;
+
+	if(rate <= 0.0) return 0.0;
+	for(AppUpClientDaemonDataChunkStr* chunkPtr = clientDaemonPtr->dataChunks;
+			chunkPtr;
+			chunkPtr = chunkPtr->next) {
+		int sizeLeft = AppUpClientDaemonChunkSizeLeft(chunkPtr);
+
+		if((chunkPtr->dirty & 2) != 0 || sizeLeft <= 0) continue;
+		sumValue += chunkPtr->priority * AppUpObjectiveF(
+				currentTime + sizeLeft / rate - chunkPtr->deadline);
+		sumSize += sizeLeft;
+	}
+	if(sumSize <= 0) return 0.0;
+	return rate * sumValue / sumSize;
+}
+
+/*
+ * Objective lost per second of delay by chunks planned at later APs
+ */
+float AppUpClientDaemonDwellCost(
+		Node* node,
+		AppDataUpClientDaemon* clientDaemonPtr,
+		int aId) {
+	map<int, int>* plan = clientDaemonPtr->plan;
+	float cost = 0.0;
+
+	for(AppUpClientDaemonDataChunkStr* chunkPtr = clientDaemonPtr->dataChunks;
+			chunkPtr;
+			chunkPtr = chunkPtr->next) {
+		int planAId;
+		float delay;
+
+		if((chunkPtr->dirty & 2) != 0) continue;
+		if(plan->count(chunkPtr->identifier) < 1) continue;
+		planAId = plan->at(chunkPtr->identifier);
+		if(planAId == aId || clientDaemonPtr->specs->count(planAId) < 1) {
+			continue;
+		}
+		delay = AppUpClientDaemonEstCompTime(node, clientDaemonPtr, planAId)
+				- chunkPtr->deadline;
+		if(delay > 0) { // Derivative of objective function
+			cost += chunkPtr->priority * AppUpObjectiveF(delay)
+					* log(2.0) / APP_UP_OBJECTIVE_F_HALFLIFE;
+		}
+	}
+	return cost;
+}
+
+void AppUpClientDaemonRecordDwell(
+		Node* node,
+		AppDataUpClientDaemon* clientDaemonPtr,
+		const char* decision,
+		int aId,
+		float gain,
+		float cost) {
+	char clockInSecond[MAX_STRING_LENGTH];
+	char daemonRecFileName[MAX_STRING_LENGTH];
+	ofstream daemonRecFile;
+
+	printf("UP client daemon: %s dwell decision at AP, "
+			"identifier=%d decision=%s gain=%.4f cost=%.4f\n",
+			node->hostname,
+			aId,
+			decision,
+			gain,
+			cost);
+	TIME_PrintClockInSecond(node->getNodeTime(), clockInSecond);
+	sprintf(daemonRecFileName, "daemon_%s.out", node->hostname);
+	daemonRecFile.open(daemonRecFileName, ios::app);
+	daemonRecFile << "MDC" << " "
+			<< node->hostname
+			<< " " << "DWEL " << decision << " "
+			<< aId
+			<< " " << "AT TIME" << " "
+			<< clockInSecond
+			<< std::endl;
+	daemonRecFile.close();
+}
+
+/*
+ * Timeout in seconds for waiting at an AP stop
+ * Longer where staying pays off, shorter where it only delays later APs
+ */
+int AppUpClientDaemonDwellTimeout(
+		Node* node,
+		AppDataUpClientDaemon* clientDaemonPtr,
+		int timeout) {
+	AppUpPathStop* stopNext = clientDaemonPtr->path;
+	int aId;
+	float gain;
+	float cost;
+
+#ifdef APP_UP_DWELL_CONTROL
+	if(clientDaemonPtr->nodeType != APP_UP_NODE_MDC) return timeout;
+	if(stopNext == NULL || stopNext->lsAId->size() < 1) return timeout;
+
+	aId = stopNext->lsAId->begin()->first;
+	gain = AppUpClientDaemonDwellGain(node, clientDaemonPtr, aId);
+	cost = AppUpClientDaemonDwellCost(node, clientDaemonPtr, aId);
+	if(gain > cost) {
+		timeout = (int)(timeout * APP_UP_DWELL_EXTEND_FACTOR);
+		if(timeout > APP_UP_DWELL_TIMEOUT_MAX) {
+			timeout = APP_UP_DWELL_TIMEOUT_MAX;
+		}
+		AppUpClientDaemonRecordDwell(node, clientDaemonPtr,
+				"LONG", aId, gain, cost);
+	} else {
+		timeout = (int)(timeout * APP_UP_DWELL_SHORTEN_FACTOR);
+		if(timeout < APP_UP_DWELL_TIMEOUT_MIN) {
+			timeout = APP_UP_DWELL_TIMEOUT_MIN;
+		}
+		AppUpClientDaemonRecordDwell(node, clientDaemonPtr,
+				"SHRT", aId, gain, cost);
+	}
+	return timeout;
+#else
+	return timeout;
+#endif
+}
+
+/*
+ * Whether to keep uploading at current AP after policy has nothing left
+ */
+bool AppUpClientDaemonDwellExtend(
+		Node* node,
+		AppDataUpClientDaemon* clientDaemonPtr) {
+	AppUpPathStop* stopNext = clientDaemonPtr->path;
+	int joinedAId = clientDaemonPtr->joinedAId;
+	float gain;
+	float cost;
+
+#ifdef APP_UP_DWELL_CONTROL
+	if(clientDaemonPtr->nodeType != APP_UP_NODE_MDC) return false;
+	if(joinedAId < 1 || stopNext == NULL) return false;
+	if(stopNext->lsAId->count(joinedAId) < 1) return false;
+	if(node->mobilityData->current->speed > 0) return false;
+	if(node->getNodeTime() - clientDaemonPtr->stopArriveTime
+			> (clocktype)APP_UP_DWELL_EXTEND_MAX * SECOND) {
+		return false;
+	}
+
+	gain = AppUpClientDaemonDwellGain(node, clientDaemonPtr, joinedAId);
+	cost = AppUpClientDaemonDwellCost(node, clientDaemonPtr, joinedAId);
+	if(gain <= cost) return false;
+	AppUpClientDaemonRecordDwell(node, clientDaemonPtr,
+			"EXTD", joinedAId, gain, cost);
+	return true;
+#else
+	return false;
+#endif
+}
+
+void AppUpClientDaemonSetNextPathTimer(
+		Node* node,
+		clocktype interval,
+		bool init) {
+	Message* msg;
+	ActionData acnData;
+
+	msg = MESSAGE_Alloc(node,
+			APP_LAYER,
+			APP_UP_CLIENT_DAEMON,
+			MSG_APP_UP_PathTimer);
+	MESSAGE_SetInstanceId(msg, AppUpClientDaemonGetMdc(node)->daemonId);
+	MESSAGE_InfoAlloc(node, msg, sizeof(bool));
+	memcpy(MESSAGE_ReturnInfo(msg), &init, sizeof(bool));
+
+	//Trace Information
+	acnData.actionType = SEND;
+	acnData.actionComment = NO_COMMENT;
+	TRACE_PrintTrace(node, msg, TRACE_APPLICATION_LAYER,
+			PACKET_OUT, &acnData);
+	MESSAGE_Send(node, msg, interval);
+}
+
+void AppUpClientDaemonSetNextPathStopTimeout(
+		Node* node,
+		AppDataUpClientDaemon* clientDaemonPtr,
+		clocktype interval) {
+	Message* msg;
+	ActionData acnData;
+
+	msg = MESSAGE_Alloc(node,
+			APP_LAYER,
+			APP_UP_CLIENT_DAEMON,
+			MSG_APP_UP_PathStopTimeout);
+	MESSAGE_SetInstanceId(msg, clientDaemonPtr->daemonId);
+	MESSAGE_InfoAlloc(node, msg, sizeof(int));
+	memcpy(MESSAGE_ReturnInfo(msg),
+			&clientDaemonPtr->timeoutId,
+			sizeof(int));
+
+	printf("UP client daemon: %s set this stop's timeout, timeoutId=%d\n",
+			node->hostname,
+			clientDaemonPtr->timeoutId);
+
+	//Trace Information
+	acnData.actionType = SEND;
+	acnData.actionComment = NO_COMMENT;
+	TRACE_PrintTrace(node, msg, TRACE_APPLICATION_LAYER,
+			PACKET_OUT, &acnData);
+	MESSAGE_Send(node, msg, interval);
+}
+
+float AppUpContactStatUpdate(float mean, int* num, float value) {
+	*num += 1;
+	return mean + (value - mean) / *num;
+}
+
+/*
+ * Distance from MDC to AP, negative if position of AP is unknown
+ */
+CoordinateType AppUpClientDaemonDistanceToA(
+		Node* node,
+		AppDataUpClientDaemon* clientDaemonPtr,
+		int aId) {
+	Coordinates crds;
+	CoordinateType distance = (CoordinateType)0;
+	CoordinateRepresentationType coordinateSystemType =
+			(CoordinateRepresentationType)
+			node->partitionData->terrainData->getCoordinateSystem();
+
+	if(clientDaemonPtr->apPositions->count(aId) < 1) return -1;
+	MOBILITY_ReturnCoordinates(node, &crds);
+	COORD_CalcDistance(coordinateSystemType,
+			&crds,
+			&clientDaemonPtr->apPositions->at(aId),
+			&distance);
+	return distance;
+}
+
+void AppUpClientDaemonObserveJoin(
+		Node* node,
+		AppDataUpClientDaemon* clientDaemonPtr,
+		int aId) {
+	CoordinateType distance =
+			AppUpClientDaemonDistanceToA(node, clientDaemonPtr, aId);
+	AppUpContactStat* global = &clientDaemonPtr->contactGlobal;
+	AppUpContactStat* stat;
+
+	if(distance < 0) return;
+	if(clientDaemonPtr->contactStats->count(aId) < 1) {
+		AppUpContactStat statInit;
+
+		memset(&statInit, 0, sizeof(AppUpContactStat));
+		clientDaemonPtr->contactStats->insert(
+				pair<int, AppUpContactStat>(aId, statInit));
+	}
+	stat = &clientDaemonPtr->contactStats->at(aId);
+	clientDaemonPtr->contactPredictionTime = -1;
+	stat->joinRadius = AppUpContactStatUpdate(
+			stat->joinRadius, &stat->numJoin, distance);
+	global->joinRadius = AppUpContactStatUpdate(
+			global->joinRadius, &global->numJoin, distance);
+}
+
+/*
+ * Learn leave radius when contact ends on the move, dwell time otherwise
+ */
+void AppUpClientDaemonObserveLeave(
+		Node* node,
+		AppDataUpClientDaemon* clientDaemonPtr,
+		int aId) {
+	CoordinateType distance =
+			AppUpClientDaemonDistanceToA(node, clientDaemonPtr, aId);
+	AppUpContactStat* global = &clientDaemonPtr->contactGlobal;
+	AppUpContactStat* stat;
+
+	if(distance < 0 || clientDaemonPtr->contactStats->count(aId) < 1) return;
+	stat = &clientDaemonPtr->contactStats->at(aId);
+	clientDaemonPtr->contactPredictionTime = -1;
+	if(distance > APP_UP_PATH_TOL) {
+		stat->leaveRadius = AppUpContactStatUpdate(
+				stat->leaveRadius, &stat->numLeave, distance);
+		global->leaveRadius = AppUpContactStatUpdate(
+				global->leaveRadius, &global->numLeave, distance);
+	} else if(clientDaemonPtr->stopArriveTime > 0) {
+		float dwell = (double)(node->getNodeTime()
+				- clientDaemonPtr->stopArriveTime) / SECOND;
+
+		stat->dwellTime = AppUpContactStatUpdate(
+				stat->dwellTime, &stat->numDwell, dwell);
+		global->dwellTime = AppUpContactStatUpdate(
+				global->dwellTime, &global->numDwell, dwell);
+	}
+}
+
+/*
+ * Predict contacts with all APs ahead from remaining path, speed and
+ * learned geometry in one walk of the path
+ * Kept until time, speed or next stop change, or contact stats are updated
+ */
+void AppUpClientDaemonPredictContacts(
+		Node* node,
+		AppDataUpClientDaemon* clientDaemonPtr) {
+	map<int, AppUpContactPrediction>* predictions =
+			clientDaemonPtr->contactPredictions;
+	AppUpContactStat* global = &clientDaemonPtr->contactGlobal;
+	float currentTime = (double)node->getNodeTime() / SECOND;
+	float arriveTime = currentTime;
+	double speed = node->mobilityData->current->speed;
+	double speedIn = speed;
+	Coordinates crdsPrev;
+	CoordinateRepresentationType coordinateSystemType =
+			(CoordinateRepresentationType)
+			node->partitionData->terrainData->getCoordinateSystem();
+	AppUpPathStop* ptrStop;
+
+	if(clientDaemonPtr->contactPredictionTime == node->getNodeTime()
+			&& clientDaemonPtr->contactPredictionPath == clientDaemonPtr->path
+			&& clientDaemonPtr->contactPredictionSpeed == speed) {
+		return;
+	}
+	clientDaemonPtr->contactPredictionTime = node->getNodeTime();
+	clientDaemonPtr->contactPredictionPath = clientDaemonPtr->path;
+	clientDaemonPtr->contactPredictionSpeed = speed;
+	predictions->clear();
+
+	// Walk remaining legs, predicting each AP at the first stop it is at
+	MOBILITY_ReturnCoordinates(node, &crdsPrev);
+	for(ptrStop = clientDaemonPtr->path; ptrStop; ptrStop = ptrStop->next) {
+		CoordinateType distance = (CoordinateType)0;
+		double legSpeed;
+		double speedOut = 0.0;
+		float stopTime;
+
+		COORD_CalcDistance(coordinateSystemType,
+				&crdsPrev,
+				&ptrStop->crds,
+				&distance);
+		if(ptrStop == clientDaemonPtr->path && speed > 0) {
+			legSpeed = speed;
+		} else if(ptrStop->t > 0) {
+			legSpeed = distance / ptrStop->t;
+		} else {
+			legSpeed = APP_UP_SPEED_MAX;
+		}
+		if(distance > APP_UP_PATH_TOL && legSpeed > 0) {
+			arriveTime += distance / legSpeed;
+			speedIn = legSpeed;
+		}
+		crdsPrev = ptrStop->crds;
+
+		stopTime = arriveTime;
+		if(ptrStop == clientDaemonPtr->path && speed == 0
+				&& clientDaemonPtr->stopArriveTime > 0) { // Waiting at AP
+			stopTime = (double)clientDaemonPtr->stopArriveTime / SECOND;
+		}
+		if(ptrStop->next) {
+			COORD_CalcDistance(coordinateSystemType,
+					&ptrStop->crds,
+					&ptrStop->next->crds,
+					&distance);
+			if(ptrStop->next->t > 0) speedOut = distance / ptrStop->next->t;
+		}
+		for(map<int, int>::iterator it = ptrStop->lsAId->begin();
+				it != ptrStop->lsAId->end();
+				++it) {
+			AppUpContactStat* stat = NULL;
+			AppUpContactPrediction prediction;
+			float joinRadius = APP_UP_CONTACT_RADIUS_DEFAULT;
+			float leaveRadius;
+			float dwell = APP_UP_PATH_STOP_TIMEOUT;
+
+			if(predictions->count(it->first) > 0) continue;
+			if(clientDaemonPtr->contactStats->count(it->first) > 0) {
+				stat = &clientDaemonPtr->contactStats->at(it->first);
+			}
+			if(stat && stat->numJoin > 0) joinRadius = stat->joinRadius;
+			else if(global->numJoin > 0) joinRadius = global->joinRadius;
+			leaveRadius = joinRadius;
+			if(stat && stat->numLeave > 0) leaveRadius = stat->leaveRadius;
+			else if(global->numLeave > 0) leaveRadius = global->leaveRadius;
+			if(stat && stat->numDwell > 0) dwell = stat->dwellTime;
+			else if(global->numDwell > 0) dwell = global->dwellTime;
+
+			prediction.startTime = stopTime;
+			if(speedIn > 0) prediction.startTime -= joinRadius / speedIn;
+			prediction.endTime = stopTime + dwell;
+			if(speedOut > 0) prediction.endTime += leaveRadius / speedOut;
+			(*predictions)[it->first] = prediction;
+		}
+		if(ptrStop->lsAId->size() > 0 || ptrStop->lsDId->size() > 0) {
+			arriveTime += global->numDwell > 0
+					? global->dwellTime : APP_UP_PATH_STOP_TIMEOUT;
+		}
+	}
+}
+
+/*
+ * Predicted contact with AP, returns false if AP is not ahead on path
+ */
+bool AppUpClientDaemonPredictContact(
+		Node* node,
+		AppDataUpClientDaemon* clientDaemonPtr,
+		int aId,
+		float* startTime,
+		float* endTime) {
+	map<int, AppUpContactPrediction>::iterator it;
+
+	AppUpClientDaemonPredictContacts(node, clientDaemonPtr);
+	it = clientDaemonPtr->contactPredictions->find(aId);
+	if(it == clientDaemonPtr->contactPredictions->end()) return false;
+	*startTime = it->second.startTime;
+	*endTime = it->second.endTime;
+	return true;
+}
+
+/*
+ * Time by which contact with AP is expected to end
+ * Blends prediction into spec as observations accumulate
+ */
+float AppUpClientDaemonEstCompTime(
+		Node* node,
+		AppDataUpClientDaemon* clientDaemonPtr,
+		int aId) {
+	float specCompTime = 0.0;
+	float startTime;
+	float endTime;
+	int numObs = clientDaemonPtr->contactGlobal.numJoin
+			+ clientDaemonPtr->contactGlobal.numDwell;
+	float weight;
+
+	if(clientDaemonPtr->specs->count(aId) > 0) {
+		specCompTime = clientDaemonPtr->specs->at(aId)->estCompTime;
+	}
+#ifdef APP_UP_CONTACT_PREDICTION
+	if(!AppUpClientDaemonPredictContact(
+			node,
+			clientDaemonPtr,
+			aId,
+			&startTime,
+			&endTime)) {
+		return specCompTime;
+	}
+	if(specCompTime <= 0.0) return endTime;
+	weight = numObs / (numObs + APP_UP_CONTACT_PRIOR_WEIGHT);
+	return weight * endTime + (1 - weight) * specCompTime;
+#else
+	return specCompTime;
+#endif
+}
+
+/*
+ * AP identifier from the last two bytes of its BSS address
+ */
+int AppUpBssAddrToAId(Mac802Address* bssAddr) {
+	char macAdder[24];
+	int bssAddrArray[6];
+
+	MacDot11MacAddressToStr(macAdder, bssAddr);
+	sscanf(macAdder, "[%x-%x-%x-%x-%x-%x]",
+			bssAddrArray + 0,
+			bssAddrArray + 1,
+			bssAddrArray + 2,
+			bssAddrArray + 3,
+			bssAddrArray + 4,
+			bssAddrArray + 5);
+	// Calculation of identifier must be consistent with generator
+	return bssAddrArray[4] * 256 + bssAddrArray[5];
+}
+
+/*
+ * Give up on AP as soon as MAC reports the link gone
+ * Ongoing upload is abandoned and resumes at a later contact
+ */
+void AppUpClientDaemonLinkLost(
+		Node* node,
+		AppDataUpClientDaemon* clientDaemonPtr,
+		int aId,
+		int reason) {
+	char clockInSecond[MAX_STRING_LENGTH];
+	char daemonRecFileName[MAX_STRING_LENGTH];
+	ofstream daemonRecFile;
+	bool completed = true;
+
+	clientDaemonPtr->linkUp = false;
+	clientDaemonPtr->retryId += 1; // Cancel pending retries
+	if(aId != clientDaemonPtr->joinedAId || aId < 1) return;
+
+	printf("\033[1;33m"
+			"UP client daemon: %s lost link to AP, "
+			"identifier=%d reason=%d sending=%d\n"
+			"\033[0m",
+			node->hostname,
+			aId,
+			reason,
+			clientDaemonPtr->sending);
+
+	if(clientDaemonPtr->sendingClient) { // Close without reporting
+		clientDaemonPtr->sendingClient->preempted = true;
+		clientDaemonPtr->sendingClient = NULL;
+		clientDaemonPtr->sending -= 1;
+	} else if(clientDaemonPtr->linkTransfer.chunkIdentifier >= 0) {
+		clientDaemonPtr->linkTransfer.chunkIdentifier = -1;
+		clientDaemonPtr->sending -= 1;
+	}
+	clientDaemonPtr->connAttempted = APP_UP_OPEN_CONN_ATTEMPT_MAX;
+
+	TIME_PrintClockInSecond(node->getNodeTime(), clockInSecond);
+	sprintf(daemonRecFileName, "daemon_%s.out", node->hostname);
+	daemonRecFile.open(daemonRecFileName, ios::app);
+	daemonRecFile << "MDC" << " "
+			<< node->hostname
+			<< " " << "LOST AP" << " "
+			<< aId
+			<< " " << "AT TIME" << " "
+			<< clockInSecond
+			<< std::endl;
+	daemonRecFile.close();
+
+	for(AppUpPathStop* ptrStop = clientDaemonPtr->path;
+			ptrStop;
+			ptrStop = ptrStop->next) {
+		if(ptrStop->lsAId->count(aId) > 0) {
+			completed = ptrStop->lsAId->at(aId) == APP_UP_PLAN_TASK_COMP;
+			break;
+		}
+	}
+	if(!completed) {
+		AppUpClientDaemonCompAtA(
+				node,
+				clientDaemonPtr,
+				aId,
+				clientDaemonPtr->currentSizeTotal <= 0);
+	}
+#ifdef APP_UP_CONTACT_TIMELINE
+	AppUpClientDaemonTimelineClose(node, clientDaemonPtr);
+#endif
+	clientDaemonPtr->joinedAId = -1;
+}
+
+/*
+ * Contact with AP begins, from MAC join or abstract link
+ */
+void AppUpClientDaemonJoinA(
+		Node* node,
+		AppDataUpClientDaemon* clientDaemonPtr,
+		int aId,
+		clocktype scanStart,
+		clocktype authStart,
+		clocktype assocStart) {
+	clientDaemonPtr->joinedAId = aId;
+	AppUpClientDaemonObserveJoin(
+			node,
+			clientDaemonPtr,
+			aId);
+	clientDaemonPtr->contactJoinTime = node->getNodeTime();
+	clientDaemonPtr->contactFirstByte = (clocktype)0;
+	clientDaemonPtr->contactBusy = (clocktype)0;
+	clientDaemonPtr->contactBytes = 0;
+#ifdef APP_UP_CLOUD_DEDUP
+	AppUpClientDaemonSyncDeliveries(node, clientDaemonPtr);
+#endif
+#ifdef APP_UP_CONTACT_TIMELINE
+	AppUpClientDaemonTimelineJoin(
+			node,
+			clientDaemonPtr,
+			aId,
+			scanStart,
+			authStart,
+			assocStart);
+#endif
+
+	AppUpPathStop* nextStop = clientDaemonPtr->path;
+	int joinedAId = clientDaemonPtr->joinedAId;
+
+	// Initialize dynamic statistics
+	clientDaemonPtr->currentRate = 0.0;
+	if(clientDaemonPtr->specs->count(joinedAId) > 0) {
+		clientDaemonPtr->currentRate =
+				clientDaemonPtr->specs->at(joinedAId)->estRate;
+	}
+	clientDaemonPtr->ratePrior = clientDaemonPtr->currentRate;
+	clientDaemonPtr->currentSizeTotal = 0;
+	clientDaemonPtr->currentTimeTotal = (clocktype)0;
+
+	// Mark corresponding task as going
+	assert(nextStop);
+	if(nextStop->lsAId->count(joinedAId) > 0) {
+		nextStop->lsAId->at(joinedAId) =
+				APP_UP_PLAN_TASK_WAIT;
+	} else { // Connected to another AP
+		for(AppUpPathStop* ptrStop = nextStop;
+				ptrStop;
+				ptrStop = ptrStop->next) {
+			if(ptrStop->lsAId->count(joinedAId) > 0) {
+				ptrStop->lsAId->at(joinedAId) =
+						APP_UP_PLAN_TASK_WAIT;
+				break;
+			}
+		}
+	}
+}
+
+/*
+ * Drop chunks the cloud already holds, as pushed to MDC on AP contact
+ * Chunks in an ongoing upload are left to finish
+ */
+void AppUpClientDaemonSyncDeliveries(
+		Node* node,
+		AppDataUpClientDaemon* clientDaemonPtr) {
+	char clockInSecond[MAX_STRING_LENGTH];
+	char daemonRecFileName[MAX_STRING_LENGTH];
+	ofstream daemonRecFile;
+	AppUpNodeData* cloudData;
+	Node* cloudNode;
+
+	cloudNode = MAPPING_GetNodePtrFromHash(
+			node->partitionData->nodeIdHash,
+			clientDaemonPtr->destNodeId);
+	if(cloudNode == NULL) return; // Not on this partition
+	cloudData = (AppUpNodeData*)cloudNode->appData.upData;
+	if(cloudData == NULL || cloudData->deliveries->empty()) return;
+
+	TIME_PrintClockInSecond(node->getNodeTime(), clockInSecond);
+	sprintf(daemonRecFileName, "daemon_%s.out", node->hostname);
+	daemonRecFile.open(daemonRecFileName, ios::app);
+	for(AppUpClientDaemonDataChunkStr* chunkPtr = clientDaemonPtr->dataChunks;
+			chunkPtr;
+			chunkPtr = chunkPtr->next) {
+		if(chunkPtr->dirty != 0
+				|| cloudData->deliveries->count(chunkPtr->identifier) == 0) {
+			continue;
+		}
+		chunkPtr->dirty |= 2; // Set finish bit
+		printf("UP client daemon: %s skipped data chunk held by cloud, "
+				"identifier=%d\n",
+				node->hostname,
+				chunkPtr->identifier);
+		daemonRecFile << "MDC" << " "
+				<< node->hostname
+				<< " " << "SKIP DATA" << " "
+				<< chunkPtr->identifier
+				<< " " << "AT TIME" << " "
+				<< clockInSecond
+				<< std::endl;
+	}
+	daemonRecFile.close();
+}
+
+void AppUpClientDaemonSetNextHandoffTimer(
+		Node* node,
+		AppDataUpClientDaemon* clientDaemonPtr) {
+	Message* msg;
+	ActionData acnData;
+
+	msg = MESSAGE_Alloc(node,
+			APP_LAYER,
+			APP_UP_CLIENT_DAEMON,
+			MSG_APP_UP_HandoffTimer);
+	MESSAGE_SetInstanceId(msg, clientDaemonPtr->daemonId);
+
+	//Trace Information
+	acnData.actionType = SEND;
+	acnData.actionComment = NO_COMMENT;
+	TRACE_PrintTrace(node, msg, TRACE_APPLICATION_LAYER,
+			PACKET_OUT, &acnData);
+	MESSAGE_Send(node, msg, (clocktype)(APP_UP_HANDOFF_CHECK * SECOND));
+}
+
+/*
+ * KB that APs ahead are predicted to take beyond pending chunks,
+ * negative if the path cannot carry all of them
+ */
+float AppUpClientDaemonUploadSpare(
+		Node* node,
+		AppDataUpClientDaemon* clientDaemonPtr) {
+	AppUpPlanSnapshot snapshot;
+	float spare = 0.0;
+
+	AppUpClientDaemonPlanSnapshot(node, clientDaemonPtr, &snapshot);
+	for(size_t a = 0; a < snapshot.aps.size(); ++a) {
+		spare += snapshot.aps[a].capacity;
+	}
+	for(size_t c = 0; c < snapshot.chunks.size(); ++c) {
+		spare -= snapshot.chunks[c].sizeLeft;
+	}
+	return spare;
+}
+
+/*
+ * MDC daemon of peer by node identifier, NULL if not an MDC here
+ */
+AppDataUpClientDaemon* AppUpClientDaemonGetHandoffPeer(
+		Node* node,
+		NodeAddress peerId,
+		Node** peerNode) {
+	*peerNode = MAPPING_GetNodePtrFromHash(
+			node->partitionData->nodeIdHash,
+			peerId);
+	if(*peerNode == NULL) return NULL;
+	return AppUpClientDaemonGetMdc(*peerNode);
+}
+
+/*
+ * MDCs reach each other only through the BSS of an AP both are joined to
+ */
+bool AppUpClientDaemonHandoffReachable(
+		Node* node,
+		AppDataUpClientDaemon* clientDaemonPtr,
+		Node* peerNode,
+		AppDataUpClientDaemon* peerPtr) {
+	Coordinates crds;
+	Coordinates peerCrds;
+	CoordinateType distance;
+	CoordinateRepresentationType coordinateSystemType =
+			(CoordinateRepresentationType)
+			node->partitionData->terrainData->getCoordinateSystem();
+
+	if(!clientDaemonPtr->linkUp || !peerPtr->linkUp
+			|| clientDaemonPtr->joinedAId <= 0
+			|| peerPtr->joinedAId != clientDaemonPtr->joinedAId) {
+		return false;
+	}
+	MOBILITY_ReturnCoordinates(node, &crds);
+	MOBILITY_ReturnCoordinates(peerNode, &peerCrds);
+	COORD_CalcDistance(coordinateSystemType, &crds, &peerCrds, &distance);
+	return distance <= APP_UP_HANDOFF_RANGE;
+}
+
+/*
+ * While idle at an AP, hand the excess to the MDC sharing it with most
+ * spare, less what other MDCs have reserved there
+ */
+void AppUpClientDaemonHandoffCheck(
+		Node* node,
+		AppDataUpClientDaemon* clientDaemonPtr) {
+	Node* peerNode = NULL;
+	AppDataUpClientDaemon* peerBest = NULL;
+	float peerSpareBest = 0.0;
+	float spare;
+	clocktype currentTime = node->getNodeTime();
+
+	if(clientDaemonPtr->handoffPeer != 0
+			|| clientDaemonPtr->sending > 0
+			|| clientDaemonPtr->joinedAId <= 0) {
+		return;
+	}
+	AppUpClientDaemonRecordContactTimes(clientDaemonPtr);
+	spare = AppUpClientDaemonUploadSpare(node, clientDaemonPtr);
+	if(spare >= 0.0) return; // Own APs suffice
+
+	for(Node* nodePtr = node->partitionData->firstNode;
+			nodePtr != NULL;
+			nodePtr = nodePtr->nextNodeData) {
+		AppDataUpClientDaemon* peerPtr = AppUpClientDaemonGetMdc(nodePtr);
+		map<NodeAddress, AppUpHandoffPeer>::iterator itPeer;
+		float peerSpare;
+
+		if(nodePtr == node || peerPtr == NULL || peerPtr->path == NULL) {
+			continue;
+		}
+		itPeer = clientDaemonPtr->handoffPeers->find(nodePtr->nodeId);
+		if(itPeer != clientDaemonPtr->handoffPeers->end()
+				&& (itPeer->second.numFail >= APP_UP_HANDOFF_FAIL_MAX
+						|| itPeer->second.retryTime > currentTime)) {
+			continue; // Backing off
+		}
+		if(!AppUpClientDaemonHandoffReachable(
+				node,
+				clientDaemonPtr,
+				nodePtr,
+				peerPtr)) {
+			continue;
+		}
+		peerSpare = AppUpClientDaemonUploadSpare(nodePtr, peerPtr)
+				- peerPtr->handoffReserved;
+		if(peerSpare > peerSpareBest) {
+			peerSpareBest = peerSpare;
+			peerNode = nodePtr;
+			peerBest = peerPtr;
+		}
+	}
+	if(peerNode == NULL) return;
+
+	clientDaemonPtr->handoffPeer = peerNode->nodeId;
+	clientDaemonPtr->handoffBudget =
+			-spare < peerSpareBest ? -spare : peerSpareBest;
+	peerBest->handoffReserved += clientDaemonPtr->handoffBudget;
+	printf("UP client daemon: %s hands off to %s, "
+			"spare=%.1f peerSpare=%.1f\n",
+			node->hostname,
+			peerNode->hostname,
+			spare,
+			peerSpareBest);
+	AppUpClientDaemonHandoffNext(node, clientDaemonPtr);
+}
+
+/*
+ * Release what is left of the reservation on peer and end handoff
+ */
+void AppUpClientDaemonHandoffEnd(
+		Node* node,
+		AppDataUpClientDaemon* clientDaemonPtr) {
+	Node* peerNode;
+	AppDataUpClientDaemon* peerPtr = AppUpClientDaemonGetHandoffPeer(
+			node,
+			clientDaemonPtr->handoffPeer,
+			&peerNode);
+
+	if(peerPtr) {
+		peerPtr->handoffReserved -= clientDaemonPtr->handoffBudget;
+		if(peerPtr->handoffReserved < 0.0) peerPtr->handoffReserved = 0.0;
+	}
+	clientDaemonPtr->handoffPeer = 0;
+	clientDaemonPtr->handoffBudget = 0.0;
+}
+
+/*
+ * Send the most urgent whole chunk that fits what peer can still take
+ * Returns false and ends handoff if none is left
+ */
+bool AppUpClientDaemonHandoffNext(
+		Node* node,
+		AppDataUpClientDaemon* clientDaemonPtr) {
+	char clockInSecond[MAX_STRING_LENGTH];
+	char daemonRecFileName[MAX_STRING_LENGTH];
+	ofstream daemonRecFile;
+	AppUpClientDaemonDataChunkStr* chunkNext = NULL;
+
+	for(AppUpClientDaemonDataChunkStr* chunkPtr = clientDaemonPtr->dataChunks;
+			chunkPtr;
+			chunkPtr = chunkPtr->next) {
+		if(chunkPtr->dirty != 0
+				|| chunkPtr->partial
+				|| chunkPtr->sizeDone > 0
+				|| chunkPtr->size > clientDaemonPtr->handoffBudget) {
+			continue;
+		}
+		if(chunkNext == NULL || chunkPtr->deadline < chunkNext->deadline) {
+			chunkNext = chunkPtr;
+		}
+	}
+	if(chunkNext == NULL) {
+		AppUpClientDaemonHandoffEnd(node, clientDaemonPtr);
+		return false;
+	}
+
+	chunkNext->dirty |= 1; // Set work bit
+	chunkNext->sizeSegment = 0; // Peer takes whole chunks only
+	clientDaemonPtr->sending += 1;
+	clientDaemonPtr->sendingClient = AppUpClientDaemonStartClient(
+			node,
+			clientDaemonPtr,
+			chunkNext,
+			0);
+
+	TIME_PrintClockInSecond(node->getNodeTime(), clockInSecond);
+	sprintf(daemonRecFileName, "daemon_%s.out", node->hostname);
+	daemonRecFile.open(daemonRecFileName, ios::app);
+	daemonRecFile << "MDC" << " "
+			<< node->hostname
+			<< " " << "PREP HAND" << " "
+			<< chunkNext->identifier
+			<< " " << "AT TIME" << " "
+			<< clockInSecond
+			<< std::endl;
+	daemonRecFile.close();
+	return true;
+}
+
+/*
+ * Chunk reached peer, which now owns it, or connection to peer failed
+ * A failed peer is backed off exponentially and dropped after
+ * APP_UP_HANDOFF_FAIL_MAX failures in a row
+ * Uploads at the AP resume once handoff ends
+ */
+void AppUpClientDaemonHandoffDone(
+		Node* node,
+		AppDataUpClientDaemon* clientDaemonPtr,
+		int chunkIdentifier,
+		bool delivered) {
+	char clockInSecond[MAX_STRING_LENGTH];
+	char daemonRecFileName[MAX_STRING_LENGTH];
+	ofstream daemonRecFile;
+	AppUpClientDaemonDataChunkStr* chunkPtr;
+	Node* peerNode;
+	AppDataUpClientDaemon* peerPtr = AppUpClientDaemonGetHandoffPeer(
+			node,
+			clientDaemonPtr->handoffPeer,
+			&peerNode);
+	AppUpHandoffPeer* peerStat =
+			&(*clientDaemonPtr->handoffPeers)[clientDaemonPtr->handoffPeer];
+
+	for(chunkPtr = clientDaemonPtr->dataChunks;
+			chunkPtr;
+			chunkPtr = chunkPtr->next) {
+		if(chunkPtr->identifier == chunkIdentifier) break;
+	}
+	if(chunkPtr) {
+		chunkPtr->dirty = delivered ? 2 : 0;
+		if(delivered) { // Taken out of reservation
+			clientDaemonPtr->handoffBudget -= chunkPtr->size;
+			if(clientDaemonPtr->handoffBudget < 0.0) {
+				clientDaemonPtr->handoffBudget = 0.0;
+			}
+			if(peerPtr) {
+				peerPtr->handoffReserved -= chunkPtr->size;
+				if(peerPtr->handoffReserved < 0.0) {
+					peerPtr->handoffReserved = 0.0;
+				}
+			}
+		}
+	}
+	if(delivered) {
+		peerStat->numFail = 0;
+		peerStat->retryTime = (clocktype)0;
+	} else {
+		double backoff = APP_UP_HANDOFF_CHECK * (1 << peerStat->numFail);
+
+		if(backoff > APP_UP_HANDOFF_BACKOFF_MAX) {
+			backoff = APP_UP_HANDOFF_BACKOFF_MAX;
+		}
+		peerStat->numFail += 1;
+		peerStat->retryTime =
+				node->getNodeTime() + (clocktype)(backoff * SECOND);
+	}
+
+	TIME_PrintClockInSecond(node->getNodeTime(), clockInSecond);
+	sprintf(daemonRecFileName, "daemon_%s.out", node->hostname);
+	daemonRecFile.open(daemonRecFileName, ios::app);
+	daemonRecFile << "MDC" << " "
+			<< node->hostname
+			<< " " << (delivered ? "HAND DATA" : "HAND FAIL") << " "
+			<< chunkIdentifier
+			<< " " << "AT TIME" << " "
+			<< clockInSecond
+			<< std::endl;
+	daemonRecFile.close();
+
+	if(delivered
+			&& peerPtr
+			&& AppUpClientDaemonHandoffReachable(
+					node,
+					clientDaemonPtr,
+					peerNode,
+					peerPtr)
+			&& AppUpClientDaemonHandoffNext(node, clientDaemonPtr)) {
+		return;
+	}
+	if(clientDaemonPtr->handoffPeer != 0) {
+		AppUpClientDaemonHandoffEnd(node, clientDaemonPtr);
+	}
+	if(clientDaemonPtr->joinedAId > 0) {
+		AppUpClientDaemonSendNextDataChunk(
+				node,
+				clientDaemonPtr,
+				(clocktype)0);
+	}
+}
+
+/*
+ * Chunk handed off by another MDC goes to the next AP on own path
+ */
+void AppUpClientDaemonAdoptChunk(
+		Node* node,
+		AppDataUpClientDaemon* clientDaemonPtr,
+		int chunkIdentifier) {
+	char clockInSecond[MAX_STRING_LENGTH];
+	char daemonRecFileName[MAX_STRING_LENGTH];
+	ofstream daemonRecFile;
+
+	if(clientDaemonPtr->plan->count(chunkIdentifier) > 0) return;
+	for(AppUpPathStop* ptrStop = clientDaemonPtr->path;
+			ptrStop;
+			ptrStop = ptrStop->next) {
+		for(map<int, int>::iterator it = ptrStop->lsAId->begin();
+				it != ptrStop->lsAId->end();
+				++it) {
+			if(it->second == APP_UP_PLAN_TASK_COMP) continue;
+			(*clientDaemonPtr->plan)[chunkIdentifier] = it->first;
+			printf("UP client daemon: %s took over data chunk, "
+					"identifier=%d aId=%d\n",
+					node->hostname,
+					chunkIdentifier,
+					it->first);
+
+			TIME_PrintClockInSecond(node->getNodeTime(), clockInSecond);
+			sprintf(daemonRecFileName, "daemon_%s.out", node->hostname);
+			daemonRecFile.open(daemonRecFileName, ios::app);
+			daemonRecFile << "MDC" << " "
+					<< node->hostname
+					<< " " << "TAKE DATA" << " "
+					<< chunkIdentifier
+					<< " " << "AT TIME" << " "
+					<< clockInSecond
+					<< std::endl;
+			daemonRecFile.close();
+			return;
+		}
+	}
+}
+
+/*
+ * Rate curve file: number of points, then "distance rate" lines
+ * in meters and KB/s with increasing distance
+ */
+bool AppUpLinkRateCurveLoad(
+		const char* fileName,
+		map<double, float>* curve) {
+	ifstream curveFile;
+	int numPoints = 0;
+	int linesRead = 0;
+	double distance;
+	float rate;
+
+	curveFile.open(fileName);
+	if(!curveFile.is_open()) return false;
+	curveFile >> numPoints;
+	while(curveFile >> distance >> rate) {
+		if(distance >= 0 && rate >= 0) {
+			(*curve)[distance] = rate;
+		}
+		++linesRead;
+	}
+	curveFile.close();
+	return linesRead == numPoints && curve->size() > 0;
+}
+
+void AppUpClientDaemonInitLinkModel(
+		Node* node,
+		AppDataUpClientDaemon* clientDaemonPtr,
+		const NodeInput* nodeInput) {
+	char buf[MAX_STRING_LENGTH];
+	BOOL wasFound = FALSE;
+
+	if(nodeInput == NULL) return;
+	IO_ReadString(node->nodeId,
+			ANY_ADDRESS,
+			nodeInput,
+			"UP-LINK-MODEL",
+			&wasFound,
+			buf);
+	if(!wasFound || strcmp(buf, "FULL") == 0) return;
+	if(strcmp(buf, "ABSTRACT") != 0) {
+		char errorString[MAX_STRING_LENGTH];
+
+		sprintf(errorString,
+				"Wrong UP-LINK-MODEL: %s\n"
+				"UP-LINK-MODEL FULL | ABSTRACT\n",
+				buf);
+		ERROR_ReportError(errorString);
+	}
+
+	clientDaemonPtr->linkModel = APP_UP_LINK_ABSTRACT;
+	clientDaemonPtr->linkRateCurve = new std::map<double, float>;
+	IO_ReadString(node->nodeId,
+			ANY_ADDRESS,
+			nodeInput,
+			"UP-LINK-RATE-CURVE-FILE",
+			&wasFound,
+			buf);
+	if(wasFound) {
+		if(!AppUpLinkRateCurveLoad(buf, clientDaemonPtr->linkRateCurve)) {
+			char errorString[MAX_STRING_LENGTH];
+
+			sprintf(errorString,
+					"Cannot read UP-LINK-RATE-CURVE-FILE %s\n",
+					buf);
+			ERROR_ReportError(errorString);
+		}
+	} else {
+		for(int i = 0; i < APP_UP_ABSTRACT_CURVE_POINTS; i++) {
+			(*clientDaemonPtr->linkRateCurve)[
+					APP_UP_ABSTRACT_CURVE_DISTANCE[i]] =
+							APP_UP_ABSTRACT_CURVE_RATE[i];
+		}
+	}
+	printf("UP client daemon: %s uses abstract link, range=%.1f\n",
+			node->hostname,
+			clientDaemonPtr->linkRateCurve->rbegin()->first);
+	AppUpClientDaemonSetNextAbstractTimer(node, clientDaemonPtr);
+}
+
+/*
+ * Rate in KB/s at distance from AP, linear between curve points
+ * and 0 beyond the last one
+ */
+float AppUpClientDaemonAbstractRate(
+		AppDataUpClientDaemon* clientDaemonPtr,
+		CoordinateType distance) {
+	map<double, float>* curve = clientDaemonPtr->linkRateCurve;
+	map<double, float>::iterator hi;
+	map<double, float>::iterator lo;
+
+	if(distance < 0 || distance > curve->rbegin()->first) return 0.0;
+	hi = curve->lower_bound(distance);
+	if(hi == curve->begin()) return hi->second;
+	lo = hi;
+	--lo;
+	return lo->second + (hi->second - lo->second)
+			* (distance - lo->first) / (hi->first - lo->first);
+}
+
+/*
+ * Next tick comes early when ongoing upload completes before it
+ */
+void AppUpClientDaemonSetNextAbstractTimer(
+		Node* node,
+		AppDataUpClientDaemon* clientDaemonPtr) {
+	AppUpAbstractTransfer* transfer = &clientDaemonPtr->linkTransfer;
+	Message* msg;
+	ActionData acnData;
+	double delay = APP_UP_ABSTRACT_TICK;
+
+	if(transfer->chunkIdentifier >= 0 && clientDaemonPtr->linkRate > 0) {
+		double timeLeft = (transfer->itemLength - transfer->sizeSent)
+				/ (clientDaemonPtr->linkRate * 1024.0);
+
+		if(transfer->progressTime > node->getNodeTime()) {
+			timeLeft += (double)(transfer->progressTime
+					- node->getNodeTime()) / SECOND;
+		}
+		if(timeLeft < delay) delay = timeLeft;
+	}
+
+	clientDaemonPtr->linkTickId += 1;
+	msg = MESSAGE_Alloc(node,
+			APP_LAYER,
+			APP_UP_CLIENT_DAEMON,
+			MSG_APP_UP_AbstractLinkTimer);
+	MESSAGE_SetInstanceId(msg, clientDaemonPtr->daemonId);
+	MESSAGE_InfoAlloc(node, msg, sizeof(int));
+	memcpy(MESSAGE_ReturnInfo(msg),
+			&clientDaemonPtr->linkTickId,
+			sizeof(int));
+
+	//Trace Information
+	acnData.actionType = SEND;
+	acnData.actionComment = NO_COMMENT;
+	TRACE_PrintTrace(node, msg, TRACE_APPLICATION_LAYER,
+			PACKET_OUT, &acnData);
+	MESSAGE_Send(node, msg, (clocktype)ceil(delay * SECOND));
+}
+
+/*
+ * Upload chunk over abstract link, in place of a TCP session
+ */
+void AppUpClientDaemonAbstractStart(
+		Node* node,
+		AppDataUpClientDaemon* clientDaemonPtr,
+		AppUpClientDaemonDataChunkStr* chunkPtr) {
+	AppUpAbstractTransfer* transfer = &clientDaemonPtr->linkTransfer;
+	Int32 itemEnd;
+
+	AppUpItemRange(chunkPtr, &transfer->itemOffset, &itemEnd);
+	transfer->itemLength = itemEnd - transfer->itemOffset;
+	transfer->chunkIdentifier = chunkPtr ? chunkPtr->identifier : 0;
+	if(chunkPtr) {
+		memcpy(&transfer->dataChunk,
+				chunkPtr,
+				sizeof(AppUpClientDaemonDataChunkStr));
+	} else {
+		memset(&transfer->dataChunk,
+				0,
+				sizeof(AppUpClientDaemonDataChunkStr));
+	}
+	transfer->sizeSent = 0.0;
+	transfer->startTime = node->getNodeTime();
+	transfer->progressTime = transfer->startTime
+			+ (clocktype)(APP_UP_ABSTRACT_SESSION_OVERHEAD * SECOND);
+	AppUpClientDaemonSetNextAbstractTimer(node, clientDaemonPtr);
+}
+
+/*
+ * Report upload as the UP client would, and record it at the server
+ */
+void AppUpClientDaemonAbstractDeliver(
+		Node* node,
+		AppDataUpClientDaemon* clientDaemonPtr) {
+	AppUpAbstractTransfer* transfer = &clientDaemonPtr->linkTransfer;
+	Message* msg;
+	ActionData acnData;
+	int infoSize = sizeof(int) + sizeof(clocktype) + sizeof(Int32) * 2;
+	int packetSize = sizeof(AppUpClientDaemonDataChunkStr);
+	clocktype uploadTime = node->getNodeTime() - transfer->startTime;
+	Node* serverNode;
+
+	serverNode = MAPPING_GetNodePtrFromHash(
+			node->partitionData->nodeIdHash,
+			clientDaemonPtr->destNodeId);
+	if(serverNode && transfer->chunkIdentifier > 0) {
+		AppUpServerRecordAbstract(
+				serverNode,
+				&transfer->dataChunk,
+				transfer->itemOffset + transfer->itemLength
+						>= transfer->dataChunk.size * 1024,
+				node->nodeId);
+	}
+
+	msg = MESSAGE_Alloc(node,
+			APP_LAYER,
+			APP_UP_CLIENT_DAEMON,
+			MSG_APP_UP_DataChunkDelivered);
+	MESSAGE_SetInstanceId(msg, clientDaemonPtr->daemonId);
+	MESSAGE_InfoAlloc(node, msg, infoSize);
+	memcpy(MESSAGE_ReturnInfo(msg),
+			&transfer->chunkIdentifier, sizeof(int));
+	memcpy(MESSAGE_ReturnInfo(msg) + sizeof(int),
+			&uploadTime, sizeof(clocktype));
+	memcpy(MESSAGE_ReturnInfo(msg) + sizeof(int)
+			+ sizeof(clocktype),
+			&transfer->itemOffset, sizeof(Int32));
+	memcpy(MESSAGE_ReturnInfo(msg) + sizeof(int)
+			+ sizeof(clocktype) + sizeof(Int32),
+			&transfer->itemLength, sizeof(Int32));
+	if(transfer->chunkIdentifier > 0) {
+		MESSAGE_PacketAlloc(node, msg, packetSize, TRACE_UP);
+		memcpy(MESSAGE_ReturnPacket(msg),
+				&transfer->dataChunk,
+				packetSize);
+	}
+	transfer->chunkIdentifier = -1;
+
+	//Trace Information
+	acnData.actionType = SEND;
+	acnData.actionComment = NO_COMMENT;
+	TRACE_PrintTrace(node, msg, TRACE_APPLICATION_LAYER,
+			PACKET_OUT, &acnData);
+	MESSAGE_Send(node, msg, (clocktype)0);
+}
+
+/*
+ * Advance abstract link: account bytes of ongoing upload, lose AP out
+ * of range, and join nearest AP in range after the join delay
+ */
+void AppUpClientDaemonAbstractTick(
+		Node* node,
+		AppDataUpClientDaemon* clientDaemonPtr) {
+	AppUpAbstractTransfer* transfer = &clientDaemonPtr->linkTransfer;
+	clocktype timeNow = node->getNodeTime();
+	int joinedAId = clientDaemonPtr->joinedAId;
+
+	if(transfer->chunkIdentifier >= 0 && timeNow > transfer->progressTime) {
+		transfer->sizeSent += clientDaemonPtr->linkRate * 1024.0
+				* (timeNow - transfer->progressTime) / SECOND;
+		transfer->progressTime = timeNow;
+	}
+
+	if(joinedAId > 0) {
+		CoordinateType distance = AppUpClientDaemonDistanceToA(
+				node,
+				clientDaemonPtr,
+				joinedAId);
+		float rate = AppUpClientDaemonAbstractRate(clientDaemonPtr, distance);
+
+		if(rate <= 0) {
+			AppUpClientDaemonLinkLost(
+					node,
+					clientDaemonPtr,
+					joinedAId,
+					-1); // Out of range
+		} else {
+			clientDaemonPtr->linkRate = rate * AppUpUniDist(
+					1 - APP_UP_ABSTRACT_RATE_JITTER,
+					1 + APP_UP_ABSTRACT_RATE_JITTER,
+					RANDOM_erand(clientDaemonPtr->linkSeed));
+			if(transfer->chunkIdentifier >= 0
+					&& transfer->sizeSent + 1 >= transfer->itemLength) {
+				AppUpClientDaemonAbstractDeliver(node, clientDaemonPtr);
+			}
+		}
+	} else if(clientDaemonPtr->path) {
+		int nearestAId = -1;
+		CoordinateType nearestDistance = 0;
+
+		for(map<int, Coordinates>::iterator it =
+					clientDaemonPtr->apPositions->begin();
+				it != clientDaemonPtr->apPositions->end();
+				++it) {
+			CoordinateType distance = AppUpClientDaemonDistanceToA(
+					node,
+					clientDaemonPtr,
+					it->first);
+
+			if(AppUpClientDaemonAbstractRate(clientDaemonPtr, distance) > 0
+					&& (nearestAId < 0 || distance < nearestDistance)) {
+				nearestAId = it->first;
+				nearestDistance = distance;
+			}
+		}
+		if(nearestAId != clientDaemonPtr->linkCandidateAId) {
+			clientDaemonPtr->linkCandidateAId = nearestAId;
+			clientDaemonPtr->linkCandidateTime = timeNow;
+		} else if(nearestAId > 0 && timeNow
+				>= clientDaemonPtr->linkCandidateTime
+					+ (clocktype)(APP_UP_ABSTRACT_JOIN_DELAY * SECOND)) {
+			printf("\033[1;36m"
+					"UP client daemon: %s joined AP over abstract link, "
+					"identifier=%d distance=%.1f\n"
+					"\033[0m",
+					node->hostname,
+					nearestAId,
+					nearestDistance);
+			clientDaemonPtr->connAttempted = 0;
+			clientDaemonPtr->linkUp = true;
+			clientDaemonPtr->linkCandidateAId = -1;
+			clientDaemonPtr->linkRate = AppUpClientDaemonAbstractRate(
+					clientDaemonPtr,
+					nearestDistance);
+			AppUpClientDaemonJoinA(
+					node,
+					clientDaemonPtr,
+					nearestAId,
+					clientDaemonPtr->linkCandidateTime,
+					timeNow,
+					timeNow);
+			if(clientDaemonPtr->sending < 1) {
+				if(clientDaemonPtr->test) {
+					clientDaemonPtr->sending += 1;
+					AppUpClientDaemonAbstractStart(node, clientDaemonPtr, NULL);
+				} else {
+					AppUpClientDaemonSendNextDataChunk(
+							node,
+							clientDaemonPtr,
+							0);
+				}
+			}
+		}
+	}
+	if(clientDaemonPtr->path || clientDaemonPtr->joinedAId > 0) {
+		AppUpClientDaemonSetNextAbstractTimer(node, clientDaemonPtr);
+	}
+}
+
+/*
+ * Open timeline of a new contact, MAC phases come with the join
+ * A contact still open is closed first
+ */
+void AppUpClientDaemonTimelineJoin(
+		Node* node,
+		AppDataUpClientDaemon* clientDaemonPtr,
+		int aId,
+		clocktype scanStart,
+		clocktype authStart,
+		clocktype assocStart) {
+	AppUpContactTimeline* timeline = &clientDaemonPtr->timeline;
+	clocktype prevLeave;
+
+	AppUpClientDaemonTimelineClose(node, clientDaemonPtr);
+	prevLeave = timeline->prevLeave;
+	memset(timeline, 0, sizeof(AppUpContactTimeline));
+	timeline->prevLeave = prevLeave;
+	timeline->aId = aId;
+	timeline->joinTime = node->getNodeTime();
+	timeline->assocStart = assocStart;
+	// Phases started before last contact ended were skipped in this join
+	timeline->authStart = authStart >= prevLeave ? authStart : assocStart;
+	timeline->scanStart = scanStart >= prevLeave && scanStart > 0
+			&& scanStart <= timeline->authStart
+			? scanStart : timeline->authStart;
+}
+
+void AppUpClientDaemonTimelineSession(
+		Node* node,
+		AppDataUpClientDaemon* clientDaemonPtr,
+		AppDataUpClient* clientPtr,
+		clocktype uploadTime,
+		Int64 itemLength) {
+	AppUpContactTimeline* timeline = &clientDaemonPtr->timeline;
+
+	if(timeline->joinTime <= 0) return;
+	if(clientPtr && clientPtr->tranStart > clientPtr->openStart
+			&& clientPtr->openStart >= timeline->joinTime) {
+		timeline->handshake += clientPtr->tranStart - clientPtr->openStart;
+	}
+	timeline->transfer += uploadTime;
+	timeline->bytes += itemLength;
+}
+
+void AppUpClientDaemonTimelineComp(
+		Node* node,
+		AppDataUpClientDaemon* clientDaemonPtr) {
+	AppUpContactTimeline* timeline = &clientDaemonPtr->timeline;
+
+	if(timeline->joinTime <= 0 || timeline->compTime > 0) return;
+	timeline->compTime = node->getNodeTime();
+}
+
+/*
+ * Break down a finished contact into phases
+ */
+void AppUpClientDaemonTimelineClose(
+		Node* node,
+		AppDataUpClientDaemon* clientDaemonPtr) {
+	AppUpContactTimeline* timeline = &clientDaemonPtr->timeline;
+	clocktype phases[APP_UP_TIMELINE_NUM];
+	clocktype leaveTime = node->getNodeTime();
+	clocktype compTime;
+	char timelineRecFileName[MAX_STRING_LENGTH];
+	char clockInSecond[MAX_STRING_LENGTH];
+	ofstream timelineRecFile;
+	int i;
+
+	if(timeline->joinTime <= 0) return;
+	compTime = timeline->compTime > 0 ? timeline->compTime : leaveTime;
+
+	phases[APP_UP_TIMELINE_SCAN] = timeline->authStart - timeline->scanStart;
+	phases[APP_UP_TIMELINE_AUTH] = timeline->assocStart - timeline->authStart;
+	phases[APP_UP_TIMELINE_ASSOC] = timeline->joinTime - timeline->assocStart;
+	phases[APP_UP_TIMELINE_HANDSHAKE] = timeline->handshake;
+	phases[APP_UP_TIMELINE_TRANSFER] = timeline->transfer;
+	phases[APP_UP_TIMELINE_IDLE] = compTime - timeline->joinTime
+			- timeline->handshake - timeline->transfer;
+	phases[APP_UP_TIMELINE_STOP_TIMEOUT] = leaveTime - compTime;
+	for(i = 0; i < APP_UP_TIMELINE_NUM; i++) {
+		if(phases[i] < 0) phases[i] = 0;
+		if(clientDaemonPtr->timelineHists) {
+			AppUpHistogramAdd(
+					&clientDaemonPtr->timelineHists[i],
+					(double)phases[i] / SECOND);
+		}
+	}
+
+	TIME_PrintClockInSecond(leaveTime, clockInSecond);
+	sprintf(timelineRecFileName, "up_timeline_%s.csv", node->hostname);
+	timelineRecFile.open(timelineRecFileName, ios::app);
+	timelineRecFile << node->hostname
+			<< "," << timeline->aId
+			<< "," << (double)timeline->joinTime / SECOND;
+	for(i = 0; i < APP_UP_TIMELINE_NUM; i++) {
+		timelineRecFile << "," << (double)phases[i] / SECOND;
+	}
+	timelineRecFile << "," << clockInSecond
+			<< "," << timeline->bytes / 1024.0 << std::endl;
+	timelineRecFile.close();
+
+	memset(timeline, 0, sizeof(AppUpContactTimeline));
+	timeline->prevLeave = leaveTime;
+}
+
+void AppUpClientDaemonTimelinePrint(
+		Node* node,
+		AppDataUpClientDaemon* clientDaemonPtr) {
+	const char* phaseNames[APP_UP_TIMELINE_NUM] = {
+		"scan",
+		"auth",
+		"assoc",
+		"handshake",
+		"transfer",
+		"idle",
+		"stopTimeout"
+	};
+	int i;
+
+	if(clientDaemonPtr->timelineHists == NULL) return;
+	for(i = 0; i < APP_UP_TIMELINE_NUM; i++) {
+		AppUpHistogramPrint(
+				node,
+				"client daemon",
+				phaseNames[i],
+				&clientDaemonPtr->timelineHists[i]);
+	}
+}
+
+AppUpStats* AppUpStatsNew() {
+	AppUpStats* stats;
+
+	stats = (AppUpStats*)MEM_malloc(sizeof(AppUpStats));
+	memset(stats, 0, sizeof(AppUpStats));
+	stats->aps = new std::map<int, AppUpStatsAccessPoint>;
+	AppUpHistogramInit(&stats->sizeHist, APP_UP_HIST_UNIT_SIZE);
+	AppUpHistogramInit(&stats->timeHist, APP_UP_HIST_UNIT_TIME);
+	AppUpHistogramInit(&stats->rateHist, APP_UP_HIST_UNIT_RATE);
+	return stats;
+}
+
+void AppUpStatsDelete(AppUpStats* stats) {
+	if(stats == NULL) return;
+	delete stats->aps;
+	MEM_free(stats);
+}
+
+void AppUpHistogramInit(AppUpHistogram* hist, double unit) {
+	memset(hist, 0, sizeof(AppUpHistogram));
+	hist->unit = unit;
+}
+
+/*
+ * Values below 2^(SUB_BITS+1) units get a bucket each,
+ * every further power of two is split into 2^SUB_BITS buckets
+ */
+int AppUpHistogramIndex(double units) {
+	int shift;
+
+	if(units < (2 << APP_UP_HIST_SUB_BITS)) return (int)units;
+	shift = ilogb(units) - APP_UP_HIST_SUB_BITS;
+	if(shift > APP_UP_HIST_SHIFT_MAX) return APP_UP_HIST_BUCKETS - 1;
+	return (shift << APP_UP_HIST_SUB_BITS) + (int)ldexp(units, -shift);
+}
+
+double AppUpHistogramLowerBound(int index, double* width) {
+	int shift;
+
+	if(index < (2 << APP_UP_HIST_SUB_BITS)) {
+		*width = 1.0;
+		return index;
+	}
+	shift = (index >> APP_UP_HIST_SUB_BITS) - 1;
+	*width = ldexp(1.0, shift);
+	return ldexp((double)(index - (shift << APP_UP_HIST_SUB_BITS)), shift);
+}
+
+void AppUpHistogramAdd(AppUpHistogram* hist, double value) {
+	if(value * 0 != 0.0) return; // Skip inf or NaN
+	if(value < 0) value = 0;
+	if(hist->count == 0 || value < hist->min) hist->min = value;
+	if(hist->count == 0 || value > hist->max) hist->max = value;
+	hist->count += 1;
+	hist->sum += value;
+	hist->buckets[AppUpHistogramIndex(value / hist->unit)] += 1;
+}
+
+/*
+ * Percentile in [0, 100], middle of the bucket holding that rank
+ */
+double AppUpHistogramPercentile(AppUpHistogram* hist, double percentile) {
+	Int64 rank;
+	Int64 seen = 0;
+	double lower;
+	double width;
+	double value;
+	int i;
+
+	if(hist->count == 0) return 0.0;
+	rank = (Int64)ceil(percentile / 100.0 * hist->count);
+	if(rank < 1) rank = 1;
+	for(i = 0; i < APP_UP_HIST_BUCKETS; i++) {
+		seen += hist->buckets[i];
+		if(seen >= rank) break;
+	}
+	lower = AppUpHistogramLowerBound(i, &width);
+	value = (lower + width / 2) * hist->unit;
+	if(value < hist->min) value = hist->min;
+	if(value > hist->max) value = hist->max;
+	return value;
+}
+
+/*
+ * Add one finished session to running totals
+ * Every APP_UP_STATS_SESSION_SAMPLE-th session is also written out
+ */
+void AppUpStatsRecordSession(
+		Node* node,
+		AppUpStats* stats,
+		const char* role,
+		int chunkIdentifier,
+		int aId,
+		Int32 bytes,
+		clocktype time) {
+	double timeInSecond = (double)time / SECOND;
+
+	if(stats == NULL) return;
+
+	stats->sessions += 1;
+	stats->bytes += bytes;
+	stats->time += time;
+	AppUpHistogramAdd(&stats->sizeHist, bytes / 1024.0);
+	AppUpHistogramAdd(&stats->timeHist, timeInSecond);
+	if(time > 0) {
+		AppUpHistogramAdd(&stats->rateHist, bytes / 1024.0 / timeInSecond);
+	}
+	if(aId > 0) {
+		AppUpStatsAccessPoint* ap = &(*stats->aps)[aId];
+
+		ap->sessions += 1;
+		ap->bytes += bytes;
+		ap->time += time;
+	}
+
+#ifdef APP_UP_STATS_SESSION_SAMPLE
+	if(stats->sessions % APP_UP_STATS_SESSION_SAMPLE == 0) {
+		char sessionRecFileName[MAX_STRING_LENGTH];
+		char clockInSecond[MAX_STRING_LENGTH];
+		ofstream sessionRecFile;
+
+		TIME_PrintClockInSecond(node->getNodeTime(), clockInSecond);
+		sprintf(sessionRecFileName, "up_sessions_%s.out", node->hostname);
+		sessionRecFile.open(sessionRecFileName, ios::app);
+		sessionRecFile << role << " "
+				<< node->hostname
+				<< " " << "SESSION" << " "
+				<< chunkIdentifier
+				<< " " << aId
+				<< " " << bytes
+				<< " " << timeInSecond
+				<< " " << "AT TIME" << " "
+				<< clockInSecond
+				<< std::endl;
+		sessionRecFile.close();
+	}
+#endif
+}
+
+void AppUpStatsRecordDeadline(
+		AppUpStats* stats,
+		bool met) {
+	if(stats == NULL) return;
+
+	stats->chunksFinished += 1;
+	if(met) stats->deadlinesMet += 1;
+}
+
+void AppUpHistogramPrint(
+		Node* node,
+		const char* role,
+		const char* name,
+		AppUpHistogram* hist) {
+	if(hist->count == 0) return;
+	printf("UP %s: %s %s n=%lld mean=%.3f min=%.3f "
+			"p50=%.3f p90=%.3f p99=%.3f max=%.3f\n",
+			role,
+			node->hostname,
+			name,
+			(long long)hist->count,
+			hist->sum / hist->count,
+			hist->min,
+			AppUpHistogramPercentile(hist, 50),
+			AppUpHistogramPercentile(hist, 90),
+			AppUpHistogramPercentile(hist, 99),
+			hist->max);
+}
+
+/*
+ * One CSV row, summary followed by non-empty buckets as lower:count
+ * so that runs can be merged bucket by bucket
+ */
+void AppUpHistogramWrite(
+		ofstream& histFile,
+		Node* node,
+		const char* policyName,
+		int aId,
+		const char* name,
+		AppUpHistogram* hist) {
+	double lower;
+	double width;
+	int i;
+
+	if(hist->count == 0) return;
+	histFile << node->hostname
+			<< "," << policyName
+			<< "," << aId
+			<< "," << name
+			<< "," << hist->unit
+			<< "," << hist->count
+			<< "," << hist->sum / hist->count
+			<< "," << hist->min
+			<< "," << AppUpHistogramPercentile(hist, 50)
+			<< "," << AppUpHistogramPercentile(hist, 90)
+			<< "," << AppUpHistogramPercentile(hist, 99)
+			<< "," << hist->max
+			<< ",";
+	for(i = 0; i < APP_UP_HIST_BUCKETS; i++) {
+		if(hist->buckets[i] == 0) continue;
+		lower = AppUpHistogramLowerBound(i, &width);
+		histFile << " " << lower * hist->unit << ":" << hist->buckets[i];
+	}
+	histFile << std::endl;
+}
+
+void AppUpHistogramWriteHeader(ofstream& histFile) {
+	histFile << "host,policy,ap,metric,unit,count,mean,min,"
+			"p50,p90,p99,max,buckets"
+			<< std::endl;
+}
+
+void AppUpStatsWrite(
+		Node* node,
+		AppUpStats* stats,
+		const char* role,
+		const char* fileName) {
+	ofstream histFile;
+
+	histFile.open(fileName, ios::trunc);
+	AppUpHistogramWriteHeader(histFile);
+	AppUpHistogramWrite(histFile, node, role, -1,
+			"sizeKB", &stats->sizeHist);
+	AppUpHistogramWrite(histFile, node, role, -1,
+			"sessionTime", &stats->timeHist);
+	AppUpHistogramWrite(histFile, node, role, -1,
+			"rateKBps", &stats->rateHist);
+	histFile.close();
+}
+
+const char* AppUpPolicyName(AppUpAdaptionPolicy policy) {
+	const AppUpPolicyEntry* entry = AppUpPolicyFindById(policy);
+
+	return entry ? entry->name : "-";
+}
+
+const char* APP_UP_INSTRUMENT_NAMES[APP_UP_INSTRUMENT_NUM] = {
+	"uploadTime",
+	"contactGoodput",
+	"joinToFirstByte",
+	"idleTime"
+};
+
+void AppUpClientDaemonInstrument(
+		Node* node,
+		AppDataUpClientDaemon* clientDaemonPtr,
+		int aId,
+		AppUpInstrumentMetric metric,
+		double value) {
+	pair<int, int> key(clientDaemonPtr->policy, aId);
+	AppUpInstrument* instrument;
+
+	if(clientDaemonPtr->instruments == NULL) return;
+	if(clientDaemonPtr->instruments->count(key) < 1) {
+		instrument = (AppUpInstrument*)MEM_malloc(sizeof(AppUpInstrument));
+		AppUpHistogramInit(
+				&instrument->hists[APP_UP_INSTRUMENT_UPLOAD_TIME],
+				APP_UP_HIST_UNIT_TIME);
+		AppUpHistogramInit(
+				&instrument->hists[APP_UP_INSTRUMENT_CONTACT_GOODPUT],
+				APP_UP_HIST_UNIT_RATE);
+		AppUpHistogramInit(
+				&instrument->hists[APP_UP_INSTRUMENT_JOIN_TO_FIRST_BYTE],
+				APP_UP_HIST_UNIT_TIME);
+		AppUpHistogramInit(
+				&instrument->hists[APP_UP_INSTRUMENT_IDLE_TIME],
+				APP_UP_HIST_UNIT_TIME);
+		clientDaemonPtr->instruments->insert(
+				pair<pair<int, int>, AppUpInstrument*>(key, instrument));
+	}
+	instrument = clientDaemonPtr->instruments->at(key);
+	AppUpHistogramAdd(&instrument->hists[metric], value);
+}
+
+/*
+ * Close contact accounting when daemon leaves AP
+ */
+void AppUpClientDaemonInstrumentContact(
+		Node* node,
+		AppDataUpClientDaemon* clientDaemonPtr,
+		int aId) {
+	double contactTime;
+
+	if(clientDaemonPtr->contactJoinTime <= 0 || aId < 1) return;
+	contactTime = (double)(node->getNodeTime()
+			- clientDaemonPtr->contactJoinTime) / SECOND;
+	if(contactTime > 0) {
+		AppUpClientDaemonInstrument(
+				node,
+				clientDaemonPtr,
+				aId,
+				APP_UP_INSTRUMENT_CONTACT_GOODPUT,
+				clientDaemonPtr->contactBytes / 1024.0 / contactTime);
+	}
+	AppUpClientDaemonInstrument(
+			node,
+			clientDaemonPtr,
+			aId,
+			APP_UP_INSTRUMENT_IDLE_TIME,
+			contactTime
+					- (double)clientDaemonPtr->contactBusy / SECOND);
+	clientDaemonPtr->contactJoinTime = (clocktype)0;
+}
+
+void AppUpClientDaemonDeleteInstruments(
+		AppDataUpClientDaemon* clientDaemonPtr) {
+	map<pair<int, int>, AppUpInstrument*>::iterator it;
+
+	if(clientDaemonPtr->instruments == NULL) return;
+	for(it = clientDaemonPtr->instruments->begin();
+			it != clientDaemonPtr->instruments->end();
+			it++) {
+		MEM_free(it->second);
+	}
+	delete clientDaemonPtr->instruments;
+	clientDaemonPtr->instruments = NULL;
+}
+
+void AppUpClientDaemonWriteInstruments(
+		Node* node,
+		AppDataUpClientDaemon* clientDaemonPtr) {
+	char histFileName[MAX_STRING_LENGTH];
+	ofstream histFile;
+	map<pair<int, int>, AppUpInstrument*>::iterator it;
+	int metric;
+
+	if(clientDaemonPtr->instruments == NULL
+			|| clientDaemonPtr->instruments->empty()) {
+		return;
+	}
+	sprintf(histFileName, "%s%s.csv",
+			APP_UP_HIST_FILE_PREFIX, node->hostname);
+	histFile.open(histFileName, ios::trunc);
+	AppUpHistogramWriteHeader(histFile);
+	for(it = clientDaemonPtr->instruments->begin();
+			it != clientDaemonPtr->instruments->end();
+			it++) {
+		for(metric = 0; metric < APP_UP_INSTRUMENT_NUM; metric++) {
+			AppUpHistogramWrite(
+					histFile,
+					node,
+					AppUpPolicyName((AppUpAdaptionPolicy)it->first.first),
+					it->first.second,
+					APP_UP_INSTRUMENT_NAMES[metric],
+					&it->second->hists[metric]);
+		}
+	}
+	histFile.close();
+}
+
+void AppUpStatsPrint(
 		Node* node,
-		AppDataUpClientDaemon* clientDaemonPtr,
-		int waitTime) {
-	char sourceString[MAX_STRING_LENGTH];
-	char destString[MAX_STRING_LENGTH];
-	NodeAddress sourceNodeId;
-	Address sourceAddr;
-	NodeAddress destNodeId;
-	Address destAddr;
-	char sourceAddrStr[MAX_STRING_LENGTH];
-	char destAddrStr[MAX_STRING_LENGTH];
-	char daemonRecFileName[MAX_STRING_LENGTH];
+		AppUpStats* stats,
+		const char* role) {
+	std::map<int, AppUpStatsAccessPoint>::iterator it;
 
-	sscanf(clientDaemonPtr->inputString->c_str(),
-			"%*s %s %s",
-			sourceString,
-			destString);
-	IO_AppParseSourceAndDestStrings(
-			clientDaemonPtr->firstNode,
-			clientDaemonPtr->inputString->c_str(),
-			sourceString,
-			&sourceNodeId,
-			&sourceAddr,
-			destString,
-			&destNodeId,
-			&destAddr);
-	sprintf(daemonRecFileName, "daemon_%s.out", node->hostname);
-	AppUpClientDaemonSendNextDataChunk(
-			node,
-			clientDaemonPtr,
-			clientDaemonPtr->getNextDataChunk,
-			sourceAddr,
-			destAddr,
-			sourceString,
-			waitTime,
-			daemonRecFileName);
-}
+	if(stats == NULL) return;
 
-void AppUpClientDaemonSetNextPathTimer(
-		Node* node,
-		clocktype interval,
-		bool init) {
-	Message* msg;
-	ActionData acnData;
+	printf("UP %s: %s stats sessions=%lld failed=%lld bytes=%lld "
+			"time=%.2f deadlineHitRatio=%.3f (%lld/%lld)\n",
+			role,
+			node->hostname,
+			(long long)stats->sessions,
+			(long long)stats->sessionsFailed,
+			(long long)stats->bytes,
+			(double)stats->time / SECOND,
+			stats->chunksFinished > 0
+					? (double)stats->deadlinesMet / stats->chunksFinished
+					: 0.0,
+			(long long)stats->deadlinesMet,
+			(long long)stats->chunksFinished);
+	AppUpHistogramPrint(node, role, "sizeKB", &stats->sizeHist);
+	AppUpHistogramPrint(node, role, "uploadTime", &stats->timeHist);
+	AppUpHistogramPrint(node, role, "rateKBps", &stats->rateHist);
+	for(it = stats->aps->begin(); it != stats->aps->end(); it++) {
+		printf("UP %s: %s stats AP identifier=%d sessions=%lld "
+				"bytes=%lld rate=%.2f\n",
+				role,
+				node->hostname,
+				it->first,
+				(long long)it->second.sessions,
+				(long long)it->second.bytes,
+				it->second.time > 0
+						? it->second.bytes / 1024.0
+								/ ((double)it->second.time / SECOND)
+						: 0.0);
+	}
+}
 
-	msg = MESSAGE_Alloc(node,
-			APP_LAYER,
-			APP_UP_CLIENT_DAEMON,
-			MSG_APP_UP_PathTimer);
-	MESSAGE_InfoAlloc(node, msg, sizeof(bool));
-	memcpy(MESSAGE_ReturnInfo(msg), &init, sizeof(bool));
+/*
+ * Turn PHY rate and RSS reported by MAC into an expected goodput in KB/s
+ */
+float AppUpRateHintToGoodput(double phyRate, double rssMean) {
+	float goodput = phyRate / 8 / 1024 * APP_UP_RATE_HINT_EFFICIENCY;
 
-	//Trace Information
-	acnData.actionType = SEND;
-	acnData.actionComment = NO_COMMENT;
-	TRACE_PrintTrace(node, msg, TRACE_APPLICATION_LAYER,
-			PACKET_OUT, &acnData);
-	MESSAGE_Send(node, msg, interval);
+	if(rssMean < APP_UP_RATE_HINT_RSS_LOW) {
+		goodput *= APP_UP_RATE_HINT_RSS_LOW_FACTOR;
+	}
+	return goodput;
 }
 
-void AppUpClientDaemonSetNextPathStopTimeout(
+/*
+ * Seed rate of current contact until first measurement comes in
+ * Latest hint is blended against the prior of the contact, so that
+ * repeated hints do not wash the prior out
+ */
+void AppUpClientDaemonApplyRateHint(
 		Node* node,
 		AppDataUpClientDaemon* clientDaemonPtr,
-		clocktype interval) {
-	Message* msg;
-	ActionData acnData;
+		double phyRate,
+		double rssMean) {
+	float goodput = AppUpRateHintToGoodput(phyRate, rssMean);
+
+	if(goodput <= 0.0) return;
+	clientDaemonPtr->rateHint = goodput;
+	if(clientDaemonPtr->currentSizeTotal > 0) return; // Measured already
+
+	if(clientDaemonPtr->ratePrior > 0.0) {
+		clientDaemonPtr->currentRate =
+				clientDaemonPtr->ratePrior * (1 - APP_UP_RATE_HINT_WEIGHT)
+				+ goodput * APP_UP_RATE_HINT_WEIGHT;
+	} else {
+		clientDaemonPtr->currentRate = goodput;
+	}
+	printf("UP client daemon: %s received rate hint, "
+			"phyRate=%.0f rssMean=%.1f goodput=%.2f currentRate=%.2f\n",
+			node->hostname,
+			phyRate,
+			rssMean,
+			goodput,
+			clientDaemonPtr->currentRate);
+}
 
-	msg = MESSAGE_Alloc(node,
-			APP_LAYER,
-			APP_UP_CLIENT_DAEMON,
-			MSG_APP_UP_PathStopTimeout);
-	MESSAGE_InfoAlloc(node, msg, sizeof(int));
-	memcpy(MESSAGE_ReturnInfo(msg),
-			&clientDaemonPtr->timeoutId,
-			sizeof(int));
+bool AppUpClientDaemonHasBacklog(
+		Node* node,
+		AppDataUpClientDaemon* clientDaemonPtr) {
+	for(AppUpClientDaemonDataChunkStr* chunkPtr = clientDaemonPtr->dataChunks;
+			chunkPtr;
+			chunkPtr = chunkPtr->next) {
+		if((chunkPtr->dirty & 2) == 0
+				&& AppUpClientDaemonChunkSizeLeft(chunkPtr) > 0) {
+			return true;
+		}
+	}
+	return false;
+}
 
-	printf("UP client daemon: %s set this stop's timeout, timeoutId=%d\n",
-			node->hostname,
-			clientDaemonPtr->timeoutId);
+/*
+ * Speed for next step of current leg
+ * Slow down in AP coverage with backlog as long as rest of leg can still
+ * be covered at maximum speed, otherwise catch up with leg's time budget
+ */
+double AppUpClientDaemonSpeedControl(
+		Node* node,
+		AppDataUpClientDaemon* clientDaemonPtr,
+		CoordinateType distance,
+		double speed) {
+	double timeLeft;
+	double speedReq;
+	double speedNew;
+	CoordinateType step = APP_UP_PATH_SIMU_DISTANCE;
+
+#ifdef APP_UP_SPEED_CONTROL
+	if(clientDaemonPtr->legBudget <= 0.0) return speed;
+
+	timeLeft = clientDaemonPtr->legBudget
+			- (double)(node->getNodeTime() - clientDaemonPtr->legStartTime)
+			/ SECOND;
+	if(timeLeft > APP_UP_PATH_TOL) {
+		speedReq = distance / timeLeft;
+	} else {
+		speedReq = APP_UP_SPEED_MAX;
+	}
+	if(step > distance) step = distance;
+
+	if(clientDaemonPtr->joinedAId > 0
+			&& AppUpClientDaemonHasBacklog(node, clientDaemonPtr)) {
+		speedNew = speed * APP_UP_SPEED_SLOW_FACTOR;
+		if(speedNew < APP_UP_SPEED_MIN) speedNew = APP_UP_SPEED_MIN;
+		// Rest of leg must stay feasible after this slow step
+		if(step / speedNew + (distance - step) / APP_UP_SPEED_MAX
+				> timeLeft) {
+			speedNew = speedReq;
+		}
+	} else { // Build up slack for next coverage area
+		speedNew = clientDaemonPtr->legBaseSpeed * APP_UP_SPEED_FAST_FACTOR;
+		if(speedNew < speedReq) speedNew = speedReq;
+	}
+	if(speedNew > APP_UP_SPEED_MAX) speedNew = APP_UP_SPEED_MAX;
+	if(speedNew < APP_UP_SPEED_MIN) speedNew = APP_UP_SPEED_MIN;
 
-	//Trace Information
-	acnData.actionType = SEND;
-	acnData.actionComment = NO_COMMENT;
-	TRACE_PrintTrace(node, msg, TRACE_APPLICATION_LAYER,
-			PACKET_OUT, &acnData);
-	MESSAGE_Send(node, msg, interval);
+	if(fabs(speedNew - speed) > APP_UP_PATH_TOL) {
+		printf("UP client daemon: %s changed speed from %.1f to %.1f, "
+				"distance=%.1f timeLeft=%.1f\n",
+				node->hostname,
+				speed,
+				speedNew,
+				distance,
+				timeLeft);
+	}
+	return speedNew;
+#else
+	return speed;
+#endif
 }
 
 void AppUpClientDaemonMobilityModelProcess(
@@ -2907,7 +6051,7 @@ void AppUpClientDaemonMobilityModelProcess(
 	}
 	if(clientDaemonPtr->path == NULL) {
 		printf("\033[1;33m"
-				"UP client daemon: %s will terminate the simulator\n"
+				"UP client daemon: %s finished its path\n"
 				"\033[0m",
 				node->hostname);
 		Message* msg;
@@ -2917,6 +6061,7 @@ void AppUpClientDaemonMobilityModelProcess(
 				APP_LAYER,
 				APP_UP_CLIENT_DAEMON,
 				MSG_APP_UP_TerminationTimer);
+		MESSAGE_SetInstanceId(msg, clientDaemonPtr->daemonId);
 //		MESSAGE_InfoAlloc(node, msg, sizeof(bool));
 
 		//Trace Information
@@ -2946,6 +6091,8 @@ void AppUpClientDaemonMobilityModelProcess(
 					crdsStop, orntPrep, 0.);
 			AppUpClientDaemonSetNextPathTimer(node, timeStay, false);
 		} else { // Arrived
+			clientDaemonPtr->stopArriveTime = timeNow;
+			clientDaemonPtr->contactPredictionTime = -1;
 			printf("\033[1;33m"
 					"UP client daemon: %s arrived at (%.1f, %.1f, %.1f)\n"
 					"\033[0m",
@@ -2975,6 +6122,11 @@ void AppUpClientDaemonMobilityModelProcess(
 
 						if(stopNext->lsDId->size() > 0) {
 							timeout = APP_UP_PATH_STOP_TIMEOUT_2;
+						} else {
+							timeout = AppUpClientDaemonDwellTimeout(
+									node,
+									clientDaemonPtr,
+									timeout);
 						}
 						printf("UP client daemon: %s will try to wait, "
 								"sending=%d joinedAId=%d\n",
@@ -3017,6 +6169,9 @@ void AppUpClientDaemonMobilityModelProcess(
 			}
 
 			speed = distance / tMoveAct;
+			clientDaemonPtr->legStartTime = timeNow;
+			clientDaemonPtr->legBudget = tMoveAct;
+			clientDaemonPtr->legBaseSpeed = speed;
 			printf("UP client daemon: %s started to move at speed %.1f\n",
 					node->hostname,
 					speed);
@@ -3026,7 +6181,11 @@ void AppUpClientDaemonMobilityModelProcess(
 					crdsStop.cartesian.y,
 					crdsStop.cartesian.z);
 		} else { /* Keep moving */
-			speed = node->mobilityData->current->speed;
+			speed = AppUpClientDaemonSpeedControl(
+					node,
+					clientDaemonPtr,
+					distance,
+					node->mobilityData->current->speed);
 		}
 		if(distance > APP_UP_PATH_SIMU_DISTANCE + APP_UP_PATH_TOL) {
 			crdsNext = crds;
@@ -3083,6 +6242,9 @@ bool AppUpClientDaemonCheckStop(
 			clientDaemonPtr->timeoutId += 1;
 			if(clientDaemonPtr->joinedAId > 0 &&
 					stopNext->lsAId->count(clientDaemonPtr->joinedAId) > 0) {
+#ifdef APP_UP_CONTACT_TIMELINE
+				AppUpClientDaemonTimelineClose(node, clientDaemonPtr);
+#endif
 				clientDaemonPtr->joinedAId = -1;
 			}
 
@@ -3106,6 +6268,340 @@ bool AppUpClientDaemonCheckStop(
 	return completed;
 }
 
+/*
+ * Contact time with AP implied by the plan, 0 if nothing is planned there
+ */
+float AppUpClientDaemonPlanContactTime(
+		AppDataUpClientDaemon* clientDaemonPtr,
+		int aId) {
+	map<int, int>* plan = clientDaemonPtr->plan;
+	float load = 0.0;
+
+	if(clientDaemonPtr->specs->count(aId) < 1) return 0.0;
+	for(AppUpClientDaemonDataChunkStr* chunkPtr = clientDaemonPtr->dataChunks;
+			chunkPtr;
+			chunkPtr = chunkPtr->next) {
+		if(plan->count(chunkPtr->identifier) > 0
+				&& plan->at(chunkPtr->identifier) == aId) {
+			load += chunkPtr->size;
+		}
+	}
+	return load / clientDaemonPtr->specs->at(aId)->estRate;
+}
+
+/*
+ * Contact time implied by the plan, taken when AP is first seen
+ */
+void AppUpClientDaemonRecordContactTimes(
+		AppDataUpClientDaemon* clientDaemonPtr) {
+	map<int, float>* contactTimes = clientDaemonPtr->contactTimes;
+
+	for(map<int, AppUpAccessPointSpec*>::iterator it =
+			clientDaemonPtr->specs->begin();
+			it != clientDaemonPtr->specs->end();
+			++it) {
+		float contactTime;
+
+		if(contactTimes->count(it->first) > 0) continue;
+		contactTime = AppUpClientDaemonPlanContactTime(
+				clientDaemonPtr,
+				it->first);
+		if(contactTime > 0) {
+			contactTimes->insert(pair<int, float>(it->first, contactTime));
+		}
+	}
+}
+
+/*
+ * Capture pending chunks and remaining APs for planning
+ * Leaves daemon as is, so it also serves to read a peer MDC
+ */
+void AppUpClientDaemonPlanSnapshot(
+		Node* node,
+		AppDataUpClientDaemon* clientDaemonPtr,
+		AppUpPlanSnapshot* snapshot) {
+	map<int, int>* plan = clientDaemonPtr->plan;
+	map<int, float>* contactTimes = clientDaemonPtr->contactTimes;
+	float currentTime = (double)node->getNodeTime() / SECOND;
+	float sumActRate = 0.0;
+	float sumEstRate = 0.0;
+	float rateCoef = 1.0;
+
+	snapshot->currentTime = currentTime;
+	snapshot->chunks.clear();
+	snapshot->aps.clear();
+
+	for(AppUpClientDaemonDataChunkStr* chunkPtr = clientDaemonPtr->dataChunks;
+			chunkPtr;
+			chunkPtr = chunkPtr->next) {
+		AppUpPlanChunk chunk;
+
+		if((chunkPtr->dirty & 2) != 0) continue;
+		chunk.identifier = chunkPtr->identifier;
+		chunk.sizeLeft = AppUpClientDaemonChunkSizeLeft(chunkPtr);
+		chunk.deadline = chunkPtr->deadline;
+		chunk.priority = chunkPtr->priority;
+		chunk.planAId = -1;
+		if(plan->count(chunk.identifier) > 0) {
+			chunk.planAId = plan->at(chunk.identifier);
+		}
+		snapshot->chunks.push_back(chunk);
+	}
+
+	// Correct priors by how measured rates compared so far
+	for(map<int, float>::iterator it = clientDaemonPtr->historyRates->begin();
+			it != clientDaemonPtr->historyRates->end();
+			++it) {
+		if(it->second > 0.0 && clientDaemonPtr->specs->count(it->first) > 0) {
+			sumActRate += it->second;
+			sumEstRate += clientDaemonPtr->specs->at(it->first)->estRate;
+		}
+	}
+	if(sumEstRate > 0.0) rateCoef = sumActRate / sumEstRate;
+
+	for(AppUpPathStop* ptrStop = clientDaemonPtr->path;
+			ptrStop;
+			ptrStop = ptrStop->next) {
+		for(map<int, int>::iterator it = ptrStop->lsAId->begin();
+				it != ptrStop->lsAId->end();
+				++it) {
+			AppUpPlanAccessPoint ap;
+			AppUpAccessPointSpec* specPtr;
+			float contactTime = 0.0;
+			float compTime;
+			float rate;
+
+			if(it->second == APP_UP_PLAN_TASK_COMP) continue;
+			if(clientDaemonPtr->specs->count(it->first) < 1) continue;
+			specPtr = clientDaemonPtr->specs->at(it->first);
+			compTime = AppUpClientDaemonEstCompTime(
+					node,
+					clientDaemonPtr,
+					it->first);
+			if(contactTimes->count(it->first) > 0) {
+				contactTime = contactTimes->at(it->first);
+			} else { // Not recorded yet
+				contactTime = AppUpClientDaemonPlanContactTime(
+						clientDaemonPtr,
+						it->first);
+			}
+#ifdef APP_UP_CONTACT_PREDICTION
+			// No more than the predicted contact window of an AP ahead
+			if(it->first != clientDaemonPtr->joinedAId
+					&& clientDaemonPtr->contactPredictions->count(it->first)
+							> 0) {
+				AppUpContactPrediction* prediction =
+						&clientDaemonPtr->contactPredictions->at(it->first);
+
+				if(contactTime > compTime - prediction->startTime) {
+					contactTime = compTime - prediction->startTime;
+				}
+			}
+#endif
+			rate = specPtr->estRate * rateCoef;
+			if(it->first == clientDaemonPtr->joinedAId) {
+				if(clientDaemonPtr->currentRate > 0.0) {
+					rate = clientDaemonPtr->currentRate;
+				}
+				if(contactTime > compTime - currentTime) {
+					contactTime = compTime - currentTime;
+				}
+			}
+			if(contactTime < 0.0) contactTime = 0.0;
+
+			ap.aId = it->first;
+			ap.capacity = rate * contactTime;
+			ap.compTime = compTime;
+			snapshot->aps.push_back(ap);
+		}
+	}
+}
+
+/*
+ * Write new assignments into plan, returns number of changed chunks
+ */
+int AppUpClientDaemonPlanApply(
+		Node* node,
+		AppDataUpClientDaemon* clientDaemonPtr,
+		map<int, int>* planNew) {
+	map<int, int>* plan = clientDaemonPtr->plan;
+	int numChanged = 0;
+
+	for(map<int, int>::iterator it = planNew->begin();
+			it != planNew->end();
+			++it) {
+		if(it->second < 1) { // Fits nowhere, left to opportunity
+			numChanged += plan->erase(it->first);
+			continue;
+		}
+		if(plan->count(it->first) > 0 && plan->at(it->first) == it->second) {
+			continue;
+		}
+		(*plan)[it->first] = it->second;
+		++numChanged;
+	}
+	return numChanged;
+}
+
+void AppUpClientDaemonRecordReplan(
+		Node* node,
+		AppDataUpClientDaemon* clientDaemonPtr,
+		const char* reason,
+		int numChunks,
+		int numChanged,
+		double computeTime) {
+	char clockInSecond[MAX_STRING_LENGTH];
+	char daemonRecFileName[MAX_STRING_LENGTH];
+	ofstream daemonRecFile;
+
+	printf("UP client daemon: %s re-planned, reason=%s chunks=%d "
+			"changed=%d computeTime=%.3fms\n",
+			node->hostname,
+			reason,
+			numChunks,
+			numChanged,
+			computeTime * 1000);
+	TIME_PrintClockInSecond(node->getNodeTime(), clockInSecond);
+	sprintf(daemonRecFileName, "daemon_%s.out", node->hostname);
+	daemonRecFile.open(daemonRecFileName, ios::app);
+	daemonRecFile << "MDC" << " "
+			<< node->hostname
+			<< " " << "REPL " << reason << " "
+			<< numChanged
+			<< " " << "AT TIME" << " "
+			<< clockInSecond
+			<< std::endl;
+	daemonRecFile.close();
+}
+
+/*
+ * Worker thread, plans on its own copy and touches nothing else
+ */
+void* AppUpAsyncPlanWorker(void* arg) {
+	AppUpAsyncPlanJob* job = (AppUpAsyncPlanJob*)arg;
+	clock_t clockStart = clock();
+
+	AppUpPlanCompute(&job->snapshot, &job->planNew);
+	job->computeTime = (double)(clock() - clockStart) / CLOCKS_PER_SEC;
+	return NULL;
+}
+
+/*
+ * Join worker of job and drop it from the jobs in flight
+ */
+void AppUpClientDaemonReplanJoin(
+		AppDataUpClientDaemon* clientDaemonPtr,
+		AppUpAsyncPlanJob* job) {
+	vector<AppUpAsyncPlanJob*>* jobs = clientDaemonPtr->replanJobs;
+
+	pthread_join(job->thread, NULL);
+	for(size_t i = 0; i < jobs->size(); i++) {
+		if((*jobs)[i] == job) {
+			jobs->erase(jobs->begin() + i);
+			break;
+		}
+	}
+}
+
+/*
+ * Hand snapshot of current generation to a worker thread
+ * The result is due at a fixed delay, independent of the worker's speed
+ * Returns false if no thread could be started
+ */
+bool AppUpClientDaemonReplanAsync(
+		Node* node,
+		AppDataUpClientDaemon* clientDaemonPtr,
+		const char* reason) {
+	AppUpAsyncPlanJob* job = new AppUpAsyncPlanJob;
+	Message* msg;
+	int ret;
+
+	job->daemonId = clientDaemonPtr->daemonId;
+	job->generation = clientDaemonPtr->replanGeneration;
+	job->computeTime = 0.0;
+	strncpy(job->reason, reason, sizeof(job->reason) - 1);
+	job->reason[sizeof(job->reason) - 1] = '\0';
+	AppUpClientDaemonPlanSnapshot(node, clientDaemonPtr, &job->snapshot);
+
+	ret = pthread_create(&job->thread, NULL, AppUpAsyncPlanWorker, job);
+	if(ret != 0) {
+		printf("UP client daemon: %s failed to start planning thread, "
+				"error=%d\n",
+				node->hostname,
+				ret);
+		delete job;
+		return false;
+	}
+	clientDaemonPtr->replanJobs->push_back(job);
+
+	msg = MESSAGE_Alloc(node,
+			APP_LAYER,
+			APP_UP_CLIENT_DAEMON,
+			MSG_APP_UP_ReplanResult);
+	MESSAGE_SetInstanceId(msg, clientDaemonPtr->daemonId);
+	MESSAGE_InfoAlloc(node, msg, sizeof(AppUpAsyncPlanJob*));
+	memcpy(MESSAGE_ReturnInfo(msg), &job, sizeof(AppUpAsyncPlanJob*));
+	MESSAGE_Send(node,
+			msg,
+			(clocktype)(APP_UP_REPLAN_ASYNC_DELAY * SECOND));
+	printf("UP client daemon: %s started planning, generation=%d\n",
+			node->hostname,
+			job->generation);
+	return true;
+}
+
+void AppUpClientDaemonReplan(
+		Node* node,
+		AppDataUpClientDaemon* clientDaemonPtr,
+		const char* reason) {
+	AppUpPlanSnapshot snapshot;
+	map<int, int> planNew;
+	clock_t clockStart;
+	int numChanged;
+
+#ifdef APP_UP_REPLAN
+	if(clientDaemonPtr->nodeType != APP_UP_NODE_MDC) return;
+	if(clientDaemonPtr->test || clientDaemonPtr->specs->size() < 1) return;
+
+	clientDaemonPtr->replanGeneration += 1;
+	AppUpClientDaemonRecordContactTimes(clientDaemonPtr);
+#ifdef APP_UP_REPLAN_ASYNC
+	if(AppUpClientDaemonReplanAsync(node, clientDaemonPtr, reason)) return;
+#endif
+	clockStart = clock();
+	AppUpClientDaemonPlanSnapshot(node, clientDaemonPtr, &snapshot);
+	AppUpPlanCompute(&snapshot, &planNew);
+	numChanged = AppUpClientDaemonPlanApply(node, clientDaemonPtr, &planNew);
+	AppUpClientDaemonRecordReplan(
+			node,
+			clientDaemonPtr,
+			reason,
+			snapshot.chunks.size(),
+			numChanged,
+			(double)(clock() - clockStart) / CLOCKS_PER_SEC);
+#endif
+}
+
+/*
+ * Re-plan once per contact when measured rate strays from prior
+ */
+void AppUpClientDaemonCheckRateDeviation(
+		Node* node,
+		AppDataUpClientDaemon* clientDaemonPtr) {
+	int joinedAId = clientDaemonPtr->joinedAId;
+	float estRate;
+
+	if(joinedAId < 1 || clientDaemonPtr->replanAId == joinedAId) return;
+	if(clientDaemonPtr->specs->count(joinedAId) < 1) return;
+	estRate = clientDaemonPtr->specs->at(joinedAId)->estRate;
+	if(fabs(clientDaemonPtr->currentRate - estRate)
+			< estRate * APP_UP_REPLAN_RATE_DEVIATION) {
+		return;
+	}
+	clientDaemonPtr->replanAId = joinedAId;
+	AppUpClientDaemonReplan(node, clientDaemonPtr, "RATE");
+}
+
 void AppUpClientDaemonCompAtA(
 		Node* node,
 		AppDataUpClientDaemon* clientDaemonPtr,
@@ -3120,6 +6616,11 @@ void AppUpClientDaemonCompAtA(
 	TIME_PrintClockInSecond(node->getNodeTime(), clockInSecond);
 
 	assert(nextStop);
+	AppUpClientDaemonObserveLeave(node, clientDaemonPtr, joinedAId);
+	AppUpClientDaemonInstrumentContact(node, clientDaemonPtr, joinedAId);
+#ifdef APP_UP_CONTACT_TIMELINE
+	AppUpClientDaemonTimelineComp(node, clientDaemonPtr);
+#endif
 	if(nextStop->lsAId->count(joinedAId) > 0) {
 		printf("UP client daemon: %s -> %d (%.1f, %.1f, %.1f)\n",
 				node->hostname,
@@ -3141,11 +6642,15 @@ void AppUpClientDaemonCompAtA(
 		}
 	}
 	clientDaemonPtr->timeoutId += 1;
+	clientDaemonPtr->retryId += 1;
 
 	for(AppUpClientDaemonDataChunkStr* chunkPtr =
 			clientDaemonPtr->dataChunks;
 			chunkPtr;
 			chunkPtr = chunkPtr->next) {
+		if(chunkPtr->dirty == 1) { // Cut off in this contact
+			chunkPtr->partial = 1;
+		}
 		chunkPtr->dirty &= -2; // Reset work bit
 	}
 
@@ -3170,10 +6675,15 @@ void AppUpClientDaemonCompAtA(
 			(double)clientDaemonPtr->currentTimeTotal / SECOND,
 			actRate);
 
+	AppUpClientDaemonReplan(node, clientDaemonPtr, "COMP");
+
 	AppUpClientDaemonSetNextPathStopTimeout(
 			node,
 			clientDaemonPtr,
-			APP_UP_PATH_STOP_TIMEOUT * SECOND);
+			AppUpClientDaemonDwellTimeout(
+					node,
+					clientDaemonPtr,
+					APP_UP_PATH_STOP_TIMEOUT) * SECOND);
 
 	printf("\033[1;32m"
 			"UP client daemon: %s completed with AP, "
@@ -1,6 +1,10 @@
 #ifndef _UP_APP_H
 #define _UP_APP_H
 
+#include <vector>
+
+#include "app_up_policy.h"
+
 // typedef struct struct_app_up_data {
 // 	char type;
 // } UpData;
@@ -11,21 +15,122 @@ typedef enum enum_app_up_node_type {
 	APP_UP_NODE_DATA_SITE
 } AppUpNodeType;
 
-typedef struct struct_app_up_client_daemon_data_chunk_str {
-	int         identifier;
-	int         size; // KB
-	int         deadline;
-	float       priority;
-	char        dirty;
-	struct_app_up_client_daemon_data_chunk_str* next;
-} AppUpClientDaemonDataChunkStr;
-
 typedef struct struct_app_up_server_item_data {
 	Int32       sizeExpected;
 	Int32       sizeReceived;
+	Int32       sizeResumed; // Prefix received in earlier connections
 	AppUpClientDaemonDataChunkStr dataChunk;
 } AppUpServerItemData;
 
+// Received prefix of a data chunk persisted across connections
+typedef struct struct_app_up_server_received_range {
+	Int32       sizeExpected;
+	Int32       sizeReceived;
+} AppUpServerReceivedRange;
+
+// Log-linear buckets, 2^SUB_BITS per power of two above 2^(SUB_BITS+1)
+#define APP_UP_HIST_SUB_BITS 4
+#define APP_UP_HIST_SHIFT_MAX 36
+#define APP_UP_HIST_BUCKETS \
+		((APP_UP_HIST_SHIFT_MAX + 2) << APP_UP_HIST_SUB_BITS)
+
+// HDR-style histogram, relative error within 2^-SUB_BITS above unit
+typedef struct struct_app_up_histogram {
+	double      unit; // Smallest discernible value
+	Int64       count;
+	double      sum;
+	double      min;
+	double      max;
+	Int64       buckets[APP_UP_HIST_BUCKETS];
+} AppUpHistogram;
+
+typedef enum enum_app_up_instrument_metric {
+	APP_UP_INSTRUMENT_UPLOAD_TIME, // Seconds per session
+	APP_UP_INSTRUMENT_CONTACT_GOODPUT, // KB/s over contact
+	APP_UP_INSTRUMENT_JOIN_TO_FIRST_BYTE, // Seconds
+	APP_UP_INSTRUMENT_IDLE_TIME, // Seconds per contact
+	APP_UP_INSTRUMENT_NUM
+} AppUpInstrumentMetric;
+
+// Histograms of one AP under one policy
+typedef struct struct_app_up_instrument {
+	AppUpHistogram hists[APP_UP_INSTRUMENT_NUM];
+} AppUpInstrument;
+
+typedef enum enum_app_up_timeline_phase {
+	APP_UP_TIMELINE_SCAN,
+	APP_UP_TIMELINE_AUTH,
+	APP_UP_TIMELINE_ASSOC,
+	APP_UP_TIMELINE_HANDSHAKE,
+	APP_UP_TIMELINE_TRANSFER,
+	APP_UP_TIMELINE_IDLE, // Waiting for next chunk decision
+	APP_UP_TIMELINE_STOP_TIMEOUT, // AP done, waiting to leave
+	APP_UP_TIMELINE_NUM
+} AppUpTimelinePhase;
+
+// Timestamps of one contact, joinTime is 0 when no contact is open
+typedef struct struct_app_up_contact_timeline {
+	int         aId;
+	clocktype   scanStart;
+	clocktype   authStart;
+	clocktype   assocStart;
+	clocktype   joinTime;
+	clocktype   compTime; // AP task completed, 0 if not yet
+	clocktype   handshake;
+	clocktype   transfer;
+	Int64       bytes; // Delivered in upload sessions
+	clocktype   prevLeave; // End of last contact, kept across contacts
+} AppUpContactTimeline;
+
+typedef struct struct_app_up_stats_access_point {
+	Int64       sessions;
+	Int64       bytes;
+	clocktype   time;
+} AppUpStatsAccessPoint;
+
+// Running upload statistics of a daemon or of the servers on a node
+typedef struct struct_app_up_stats {
+	Int64       sessions;
+	Int64       sessionsFailed;
+	Int64       bytes;
+	clocktype   time;
+	Int64       chunksFinished;
+	Int64       deadlinesMet;
+	AppUpHistogram sizeHist; // KB
+	AppUpHistogram timeHist; // Seconds
+	AppUpHistogram rateHist; // KB/s
+	map<int, AppUpStatsAccessPoint>* aps;
+} AppUpStats;
+
+// First delivery of a data chunk at the cloud
+typedef struct struct_app_up_delivery {
+	clocktype   time;
+	NodeAddress source; // MDC that delivered it
+	int         size; // KB
+	int         numDuplicates; // Later complete receipts
+} AppUpDelivery;
+
+struct struct_app_up_server_str;
+struct struct_app_up_client_daemon_str;
+struct struct_app_up_async_plan_job;
+
+// Node-wide UP state shared by all UP instances on a node
+typedef struct struct_app_up_node_data {
+	map<int, AppUpServerReceivedRange>* receivedRanges;
+	AppUpStats* serverStats;
+	map<int, AppUpDelivery>* deliveries; // Cloud only, by chunk id
+	// Indexed by daemonId, which is the instanceId of daemon events
+	vector<struct_app_up_client_daemon_str*>* daemons;
+	struct_app_up_client_daemon_str* mdcDaemon; // Drives node mobility
+	// Server sessions come from slabs and return to the pool on close
+	// Open sessions indexed by connectionId, which TCP hands out densely
+	vector<struct_app_up_server_str*>* servers;
+	int         numServers; // Open
+	struct_app_up_server_str* serverFree;
+	vector<struct_app_up_server_str*>* serverSlabs;
+	bool        serverRegistered; // One app entry finalizes all sessions
+} AppUpNodeData;
+
 typedef struct struct_app_up_client_packet_list {
 	char*       payload;
 	Int32       packetSize;
@@ -45,7 +150,9 @@ typedef struct struct_app_up_server_str {
 	bool        sessionIsClosed;
 	clocktype   sessionStart;
 	clocktype   sessionFinish;
-	STAT_AppStatistics* stats;
+	clocktype   itemStart; // Header of current item arrived
+	bool        itemOpen; // Data header seen, item not reported yet
+	struct_app_up_server_str* nextFree; // In pool of node
 } AppDataUpServer;
 
 typedef struct struct_app_up_client_str {
@@ -65,19 +172,38 @@ typedef struct struct_app_up_client_str {
 	bool        sessionIsClosed;
 	clocktype   sessionStart;
 	clocktype   sessionFinish;
-	STAT_AppStatistics* stats;
 	std::string* applicationName;
 	AppUpClientDaemonDataChunkStr* dataChunk;
+	clocktype   openStart; // Connection requested
 	clocktype   tranStart;
+	Int32       itemOffset; // First byte sent in this session
+	Int32       itemEnd; // Byte after the last one sent in this session
+	Int32       itemLeft; // Virtual payload not yet handed to transport
+	bool        preempted;
+	int         daemonId; // Daemon notified of the outcome
+	bool        burst; // Session stays open for the next item
 } AppDataUpClient;
 
+typedef struct struct_app_up_connection_failed_info {
+	int         chunkIdentifier;
+	int         uniqueId; // Client to reuse for retry
+} AppUpConnectionFailedInfo;
+
+typedef struct struct_app_up_retry_info {
+	int         retryId;
+	int         chunkIdentifier;
+} AppUpRetryInfo;
+
 typedef enum enum_app_up_message_type {
-	APP_UP_MSG_DATA = APP_UP_NODE_DATA_SITE
+	APP_UP_MSG_DATA = APP_UP_NODE_DATA_SITE,
+	APP_UP_MSG_RESUME_QUERY,
+	APP_UP_MSG_RESUME_REPLY
 } AppUpMessageType;
 
 typedef struct struct_app_up_message_header {
 	AppUpMessageType type;
 	Int32       itemSize;
+	Int32       itemOffset; // Bytes already received by server
 	AppUpClientDaemonDataChunkStr dataChunk;
 } AppUpMessageHeader;
 
@@ -87,16 +213,6 @@ typedef enum enum_app_up_plan_task_status {
 	APP_UP_PLAN_TASK_COMP
 } AppUpPlanTaskStatus;
 
-typedef enum enum_app_up_adaption_policy {
-	APP_UP_ADAPTION_UNINITIALIZED = -1,
-	APP_UP_ADAPTION_EVERYTHING,
-	APP_UP_ADAPTION_OPPORTUNITY = APP_UP_ADAPTION_EVERYTHING,
-	APP_UP_ADAPTION_STRICT_PLAN,
-	APP_UP_ADAPTION_TIMELINE,
-	APP_UP_ADAPTION_ADAPTIVE_GP,
-	APP_UP_ADAPTION_CONTROL_TH
-} AppUpAdaptionPolicy;
-
 typedef struct struct_app_up_path_stop {
 	double      t;
 	Coordinates crds;
@@ -105,12 +221,49 @@ typedef struct struct_app_up_path_stop {
 	struct_app_up_path_stop* next;
 } AppUpPathStop;
 
-typedef struct struct_app_up_access_point_spec {
-	int         estRate;
-	float       estCompTime;
-} AppUpAccessPointSpec;
+typedef struct struct_app_up_rate_model_entry {
+	double      n; // Decayed number of contacts
+	double      mean; // KB/s
+	double      m2; // Sum of squared differences from mean
+} AppUpRateModelEntry;
+
+typedef struct struct_app_up_contact_prediction {
+	float       startTime; // Seconds, join
+	float       endTime; // Seconds, leave
+} AppUpContactPrediction;
+
+typedef struct struct_app_up_handoff_peer {
+	int         numFail; // Failed attempts in a row
+	clocktype   retryTime; // Not tried again before
+} AppUpHandoffPeer;
+
+typedef struct struct_app_up_contact_stat {
+	float       joinRadius; // Meters from AP when joined
+	int         numJoin;
+	float       leaveRadius; // Meters from AP when contact ended
+	int         numLeave;
+	float       dwellTime; // Seconds at AP stop
+	int         numDwell;
+} AppUpContactStat;
+
+typedef enum enum_app_up_link_model {
+	APP_UP_LINK_FULL, // 802.11 association and TCP
+	APP_UP_LINK_ABSTRACT // Contacts and transfers from rate curve
+} AppUpLinkModel;
+
+// Upload in progress over abstract link, chunkIdentifier -1 if none
+typedef struct struct_app_up_abstract_transfer {
+	int         chunkIdentifier; // 0 for test data
+	Int32       itemOffset;
+	Int32       itemLength;
+	double      sizeSent; // Bytes
+	clocktype   startTime; // Session opened
+	clocktype   progressTime; // Bytes are accounted up to here
+	AppUpClientDaemonDataChunkStr dataChunk;
+} AppUpAbstractTransfer;
 
 typedef struct struct_app_up_client_daemon_str {
+	int         daemonId; // Index on node
 	Node*       firstNode;
 	NodeAddress sourceNodeId;
 	NodeAddress destNodeId;
@@ -128,27 +281,81 @@ typedef struct struct_app_up_client_daemon_str {
 	int         sending; // Number of data chunks prepared for sending
 	int (*getNextDataChunk)(Node*, struct_app_up_client_daemon_str*);
 	AppUpAdaptionPolicy policy;
+	AppUpPolicyFunc policyFunc; // From APP_UP_POLICIES
 	map<int, AppUpAccessPointSpec*>* specs;
 	float       currentRate;
 	map<int, float>* historyRates;
 	int         currentSizeTotal;
 	clocktype   currentTimeTotal;
 	int         lastAId;
+	AppDataUpClient* sendingClient; // Carries ongoing data chunk
+	clocktype   lastPreemptTime;
+	clocktype   stopArriveTime;
+	clocktype   legStartTime;
+	double      legBudget; // Seconds to reach next stop
+	double      legBaseSpeed;
+	map<int, float>* contactTimes; // Seconds per AP implied by plan
+	int         replanAId; // AP of last rate triggered re-plan
+	int         replanGeneration; // Results of older generations are stale
+	// Planning threads not joined yet, joined when result is due or at end
+	vector<struct_app_up_async_plan_job*>* replanJobs;
+	map<int, Coordinates>* apPositions; // Stop of each AP on path
+	map<int, AppUpContactStat>* contactStats;
+	AppUpContactStat contactGlobal;
+	map<int, AppUpContactPrediction>* contactPredictions; // APs ahead
+	clocktype   contactPredictionTime; // -1 if predictions are stale
+	AppUpPathStop* contactPredictionPath; // Next stop when predicted
+	double      contactPredictionSpeed;
+	float       rateHint; // KB/s, from MAC of current contact
+	float       ratePrior; // KB/s, spec rate of current contact
+	std::string* rateModelFile; // UP-RATE-MODEL-FILE, NULL if not kept
+	bool        linkUp; // Associated with an AP according to MAC
+	AppDataUpClient* idleClient; // Failed to connect, reused for retry
+	int         retryId; // Pending retries of older ids are cancelled
+	RandomSeed  retrySeed; // Jitter of retries
+	AppUpStats* stats;
+	map<pair<int, int>, AppUpInstrument*>* instruments; // (policy, AP)
+	clocktype   contactJoinTime;
+	clocktype   contactFirstByte;
+	clocktype   contactBusy; // Time spent in upload sessions
+	Int64       contactBytes;
+	AppUpContactTimeline timeline;
+	AppUpHistogram* timelineHists; // Per phase, over all contacts
+	AppUpLinkModel linkModel;
+	map<double, float>* linkRateCurve; // Meters to KB/s, last is range
+	int         linkCandidateAId; // In range, not joined yet
+	clocktype   linkCandidateTime;
+	float       linkRate; // KB/s over current interval
+	int         linkTickId; // Pending ticks of older ids are stale
+	RandomSeed  linkSeed; // Rate jitter of abstract link
+	AppUpAbstractTransfer linkTransfer;
+	bool        pathDone; // Path finished and termination wait elapsed
+	NodeAddress handoffPeer; // MDC taking over chunks, 0 if none
+	float       handoffBudget; // KB peer can still take
+	float       handoffReserved; // KB promised to MDCs handing off here
+	map<NodeAddress, AppUpHandoffPeer>* handoffPeers; // Failed peers
+	AppDataUpClient* burstClient; // Open session offered to next chunk
 } AppDataUpClientDaemon;
 
+typedef struct struct_app_up_async_plan_job {
+	pthread_t   thread;
+	int         daemonId;
+	int         generation;
+	char        reason[8];
+	AppUpPlanSnapshot snapshot;
+	map<int, int> planNew;
+	double      computeTime; // Seconds of CPU time
+} AppUpAsyncPlanJob;
+
 typedef int (*AppUpClientDaemonGetNextDataChunkType)(
 		Node*,
 		AppDataUpClientDaemon*);
 
-float AppUpObjectiveF(float delay);
-
-const float APP_UP_OBJECTIVE_F_HALFLIFE = 30.0;
-
 void AppUpServerInit(
 	Node *node,
 	Address serverAddr);
 
-void AppUpClientInit(
+AppDataUpClient* AppUpClientInit(
 	Node* node,
 	Address clientAddr,
 	Address serverAddr,
@@ -156,8 +363,38 @@ void AppUpClientInit(
 	char* sourceString,
 	AppUpNodeType nodeType,
 	int waitTime,
+	AppUpClientDaemonDataChunkStr* chunk,
+	int daemonId);
+
+void AppUpItemRange(
+	AppUpClientDaemonDataChunkStr* chunk,
+	Int32* itemOffset,
+	Int32* itemEnd);
+
+void AppUpClientSetDataChunk(
+	AppDataUpClient* clientPtr,
+	AppUpClientDaemonDataChunkStr* chunk);
+
+void AppUpClientReopen(
+	Node* node,
+	AppDataUpClient* clientPtr,
+	AppUpClientDaemonDataChunkStr* chunk,
+	int waitTime);
+
+void AppUpClientOpenConnection(
+	Node* node,
+	AppDataUpClient* clientPtr,
+	int waitTime);
+
+void AppUpClientSendNext(
+	Node* node,
+	AppDataUpClient* clientPtr,
 	AppUpClientDaemonDataChunkStr* chunk);
 
+void AppUpClientBurstEnd(
+	Node* node,
+	AppDataUpClient* clientPtr);
+
 void AppLayerUpServer(Node *node, Message *packet);
 void AppLayerUpClient(Node *node, Message *packet);
 void AppUpServerFinalize(Node *node, AppInfo *appInfo);
@@ -174,7 +411,7 @@ AppDataUpClient* AppUpClientNewUpClient(
 	const char* appName,
 	AppUpNodeType nodeType);
 
-void AppUpServerPrintStats(Node *node, AppDataUpServer *serverPtr);
+void AppUpServerPrintStats(Node *node);
 void AppUpClientPrintStats(Node *node, AppDataUpClient *clientPtr);
 
 void AppUpClientAddAddressInformation(
@@ -182,6 +419,10 @@ void AppUpClientAddAddressInformation(
 	AppDataUpClient* clientPtr);
 
 AppDataUpServer* AppUpServerGetUpServer(Node *node, int connId);
+
+AppDataUpServer* AppUpServerAlloc(Node* node);
+
+void AppUpServerRelease(Node* node, AppDataUpServer* serverPtr);
 AppDataUpClient* AppUpClientGetUpClient(Node *node, int connId);
 AppDataUpClient* AppUpClientGetClientPtr(
 	Node* node,
@@ -212,6 +453,8 @@ void AppUpClientSendItem(
 
 char* AppUpClientNewVirtualDataItem(
 		Int32 itemSize,
+		Int32 itemOffset,
+		Int32 itemLength,
 		Int32& fullSize,
 		int identifier,
 		int deadline,
@@ -223,6 +466,23 @@ void AppUpClientSendVirtualItem(
 		char* item,
 		Int32 itemSize);
 
+void AppUpClientSendNextVirtualBlock(
+		Node* node,
+		AppDataUpClient *clientPtr);
+
+void AppUpClientSendResumeQuery(
+		Node* node,
+		AppDataUpClient* clientPtr);
+
+void AppUpServerSendResumeReply(
+		Node* node,
+		AppDataUpServer* serverPtr);
+
+void AppUpServerUpdateReceivedRange(
+		Node* node,
+		AppDataUpServer* serverPtr);
+
+AppUpNodeData* AppUpGetNodeData(Node* node);
 
 AppDataUpClient*
 AppUpClientUpdateUpClient(
@@ -243,7 +503,8 @@ void AppUpClientDaemonInit(
 		NodeAddress destNodeId,
 		char* inputString,
 		char* appName,
-		AppUpNodeType nodeType);
+		AppUpNodeType nodeType,
+		const NodeInput* nodeInput);
 
 AppDataUpClientDaemon* AppUpClientNewUpClientDaemon(
 		Node* node,
@@ -257,8 +518,50 @@ AppDataUpClientDaemon* AppUpClientNewUpClientDaemon(
 void AppLayerUpClientDaemon(Node *node, Message *packet);
 void AppUpClientDaemonFinalize(Node *node, AppInfo *appInfo);
 
+void AppUpRateModelMerge(
+		AppUpRateModelEntry* a,
+		const AppUpRateModelEntry* b);
+
+bool AppUpRateModelLoad(
+		const char* fileName,
+		map<int, AppUpRateModelEntry>* model);
+
+bool AppUpRateModelSave(
+		const char* fileName,
+		map<int, AppUpRateModelEntry>* model);
+
+void AppUpClientDaemonInitRateModel(
+		Node* node,
+		AppDataUpClientDaemon* clientDaemonPtr,
+		const NodeInput* nodeInput);
+
+void AppUpClientDaemonLoadRateModel(
+		Node* node,
+		AppDataUpClientDaemon* clientDaemonPtr);
+
+void AppUpClientDaemonStoreRateModel(
+		Node* node,
+		AppDataUpClientDaemon* clientDaemonPtr);
+
 AppDataUpClientDaemon* AppUpClientGetUpClientDaemon(Node *node);
 
+AppDataUpClientDaemon* AppUpClientDaemonGet(Node* node, int daemonId);
+
+AppDataUpClientDaemon* AppUpClientDaemonGetMdc(Node* node);
+
+void AppUpClientDaemonFanOut(Node* node, Message* msg);
+
+void AppUpClientDaemonJoinMdc(
+		Node* node,
+		AppDataUpClientDaemon* clientDaemonPtr,
+		int mdcId);
+
+void AppUpClientDaemonCheckPartitions(
+		Node* node,
+		AppDataUpClientDaemon* clientDaemonPtr);
+
+bool AppUpClientDaemonAllDone(Node* node);
+
 const int APP_UP_MDC_TEST_DATA_SIZE = 1024; // KB
 const CoordinateType APP_UP_WIRELESS_CLOSE_RANGE = (CoordinateType)0;
 const int APP_UP_WIRELESS_AP_WAIT_TIME = 5;
@@ -269,35 +572,49 @@ const CoordinateType APP_UP_PATH_SIMU_DISTANCE = (CoordinateType)1;
 //const clocktype APP_UP_PATH_SIMU_TIME = 100 * MILLI_SECOND;
 const int APP_UP_PATH_STOP_TIMEOUT = 15;
 const int APP_UP_PATH_STOP_TIMEOUT_2 = APP_UP_OPEN_CONN_ATTEMPT_MAX * 3;
-const float APP_UP_GNDC_TIMELINE_GRACE_PERIOD = 60.0;
-const float APP_UP_GNDC_ADAPTIVE_GRACE_PERIOD = 10.0;
-const float APP_UP_GNDC_RATE_STEP = 50.0; // KB/s
 const int APP_UP_TERMINATION_WAIT_TIME = 60;
-const float APP_UP_CONTROL_THEORY_K1 = 2e-6;
-const float APP_UP_CONTROL_THEORY_K3 = 1e-4;
+
+void AppUpClientDaemonPolicyState(
+		Node* node,
+		AppDataUpClientDaemon* clientDaemonPtr,
+		AppUpPolicyState* state);
 
 int AppUpClientDaemonGNDCEverything(
 		Node *node,
 		AppDataUpClientDaemon* clientDaemonPtr);
 
-int AppUpClientDaemonGNDCStrictPlan(
+const AppUpClientDaemonGetNextDataChunkType
+    AppUpClientDaemonGNDCOpportunity = AppUpClientDaemonGNDCEverything;
+
+int AppUpClientDaemonGNDCPolicy(
 		Node *node,
 		AppDataUpClientDaemon* clientDaemonPtr);
 
-int AppUpClientDaemonGNDCTimeline(
-		Node *node,
+float AppUpClientDaemonChunkValue(
+		Node* node,
+		AppDataUpClientDaemon* clientDaemonPtr,
+		AppUpClientDaemonDataChunkStr* chunkPtr);
+
+bool AppUpClientDaemonCheckPreemption(
+		Node* node,
 		AppDataUpClientDaemon* clientDaemonPtr);
 
-int AppUpClientDaemonGNDCAdaptiveGP(
-		Node *node,
+int AppUpClientDaemonSegmentTarget(
+		Node* node,
 		AppDataUpClientDaemon* clientDaemonPtr);
 
-const AppUpClientDaemonGetNextDataChunkType
-    AppUpClientDaemonGNDCOpportunity = AppUpClientDaemonGNDCEverything;
+int AppUpClientDaemonSegmentSize(
+		Node* node,
+		AppDataUpClientDaemon* clientDaemonPtr,
+		AppUpClientDaemonDataChunkStr* chunkPtr);
 
-int AppUpClientDaemonGNDCControlTh(
-		Node *node,
-		AppDataUpClientDaemon* clientDaemonPtr);
+int AppUpClientDaemonChunkSizeLeft(
+		AppUpClientDaemonDataChunkStr* chunkPtr);
+
+int AppUpClientDaemonChunkSizeNext(
+		Node* node,
+		AppDataUpClientDaemon* clientDaemonPtr,
+		AppUpClientDaemonDataChunkStr* chunkPtr);
 
 void AppUpClientDaemonSendNextDataChunk(
 		Node* node,
@@ -314,6 +631,49 @@ void AppUpClientDaemonSendNextDataChunk(
 		AppDataUpClientDaemon* clientDaemonPtr,
 		int waitTime);
 
+AppDataUpClient* AppUpClientDaemonStartClient(
+		Node* node,
+		AppDataUpClientDaemon* clientDaemonPtr,
+		AppUpClientDaemonDataChunkStr* chunkPtr,
+		int waitTime);
+
+void AppUpClientDaemonScheduleRetry(
+		Node* node,
+		AppDataUpClientDaemon* clientDaemonPtr,
+		int chunkIdentifier);
+
+float AppUpClientDaemonExpectedRate(
+		Node* node,
+		AppDataUpClientDaemon* clientDaemonPtr,
+		int aId);
+
+float AppUpClientDaemonDwellGain(
+		Node* node,
+		AppDataUpClientDaemon* clientDaemonPtr,
+		int aId);
+
+float AppUpClientDaemonDwellCost(
+		Node* node,
+		AppDataUpClientDaemon* clientDaemonPtr,
+		int aId);
+
+void AppUpClientDaemonRecordDwell(
+		Node* node,
+		AppDataUpClientDaemon* clientDaemonPtr,
+		const char* decision,
+		int aId,
+		float gain,
+		float cost);
+
+int AppUpClientDaemonDwellTimeout(
+		Node* node,
+		AppDataUpClientDaemon* clientDaemonPtr,
+		int timeout);
+
+bool AppUpClientDaemonDwellExtend(
+		Node* node,
+		AppDataUpClientDaemon* clientDaemonPtr);
+
 void AppUpClientDaemonSetNextPathTimer(
 		Node* node,
 		clocktype interval,
@@ -324,6 +684,262 @@ void AppUpClientDaemonSetNextPathStopTimeout(
 		AppDataUpClientDaemon* clientDaemonPtr,
 		clocktype interval);
 
+float AppUpContactStatUpdate(float mean, int* num, float value);
+
+CoordinateType AppUpClientDaemonDistanceToA(
+		Node* node,
+		AppDataUpClientDaemon* clientDaemonPtr,
+		int aId);
+
+void AppUpClientDaemonObserveJoin(
+		Node* node,
+		AppDataUpClientDaemon* clientDaemonPtr,
+		int aId);
+
+void AppUpClientDaemonObserveLeave(
+		Node* node,
+		AppDataUpClientDaemon* clientDaemonPtr,
+		int aId);
+
+void AppUpClientDaemonPredictContacts(
+		Node* node,
+		AppDataUpClientDaemon* clientDaemonPtr);
+
+bool AppUpClientDaemonPredictContact(
+		Node* node,
+		AppDataUpClientDaemon* clientDaemonPtr,
+		int aId,
+		float* startTime,
+		float* endTime);
+
+float AppUpClientDaemonEstCompTime(
+		Node* node,
+		AppDataUpClientDaemon* clientDaemonPtr,
+		int aId);
+
+int AppUpBssAddrToAId(Mac802Address* bssAddr);
+
+void AppUpClientDaemonLinkLost(
+		Node* node,
+		AppDataUpClientDaemon* clientDaemonPtr,
+		int aId,
+		int reason);
+
+AppUpStats* AppUpStatsNew();
+
+void AppUpStatsDelete(AppUpStats* stats);
+
+void AppUpHistogramInit(AppUpHistogram* hist, double unit);
+
+int AppUpHistogramIndex(double units);
+
+double AppUpHistogramLowerBound(int index, double* width);
+
+void AppUpHistogramAdd(AppUpHistogram* hist, double value);
+
+double AppUpHistogramPercentile(AppUpHistogram* hist, double percentile);
+
+void AppUpHistogramPrint(
+		Node* node,
+		const char* role,
+		const char* name,
+		AppUpHistogram* hist);
+
+void AppUpStatsWrite(
+		Node* node,
+		AppUpStats* stats,
+		const char* role,
+		const char* fileName);
+
+const char* AppUpPolicyName(AppUpAdaptionPolicy policy);
+
+void AppUpClientDaemonInstrument(
+		Node* node,
+		AppDataUpClientDaemon* clientDaemonPtr,
+		int aId,
+		AppUpInstrumentMetric metric,
+		double value);
+
+void AppUpClientDaemonInstrumentContact(
+		Node* node,
+		AppDataUpClientDaemon* clientDaemonPtr,
+		int aId);
+
+void AppUpClientDaemonDeleteInstruments(
+		AppDataUpClientDaemon* clientDaemonPtr);
+
+void AppUpClientDaemonWriteInstruments(
+		Node* node,
+		AppDataUpClientDaemon* clientDaemonPtr);
+
+void AppUpClientDaemonJoinA(
+		Node* node,
+		AppDataUpClientDaemon* clientDaemonPtr,
+		int aId,
+		clocktype scanStart,
+		clocktype authStart,
+		clocktype assocStart);
+
+bool AppUpLinkRateCurveLoad(
+		const char* fileName,
+		map<double, float>* curve);
+
+void AppUpClientDaemonInitLinkModel(
+		Node* node,
+		AppDataUpClientDaemon* clientDaemonPtr,
+		const NodeInput* nodeInput);
+
+float AppUpClientDaemonAbstractRate(
+		AppDataUpClientDaemon* clientDaemonPtr,
+		CoordinateType distance);
+
+void AppUpClientDaemonSetNextAbstractTimer(
+		Node* node,
+		AppDataUpClientDaemon* clientDaemonPtr);
+
+void AppUpClientDaemonAbstractStart(
+		Node* node,
+		AppDataUpClientDaemon* clientDaemonPtr,
+		AppUpClientDaemonDataChunkStr* chunkPtr);
+
+void AppUpClientDaemonAbstractDeliver(
+		Node* node,
+		AppDataUpClientDaemon* clientDaemonPtr);
+
+void AppUpServerRecordAbstract(
+		Node* node,
+		AppUpClientDaemonDataChunkStr* chunk,
+		bool finished,
+		NodeAddress source);
+
+bool AppUpServerRecordDelivery(
+		Node* node,
+		AppUpClientDaemonDataChunkStr* chunk,
+		NodeAddress source);
+
+void AppUpServerPrintDeliveries(Node* node);
+
+void AppUpServerReportItem(
+		Node* node,
+		AppDataUpServer* serverPtr);
+
+void AppUpServerRecordItemStats(
+		Node* node,
+		AppDataUpServer* serverPtr);
+
+void AppUpClientDaemonSyncDeliveries(
+		Node* node,
+		AppDataUpClientDaemon* clientDaemonPtr);
+
+void AppUpClientDaemonSetNextHandoffTimer(
+		Node* node,
+		AppDataUpClientDaemon* clientDaemonPtr);
+
+float AppUpClientDaemonUploadSpare(
+		Node* node,
+		AppDataUpClientDaemon* clientDaemonPtr);
+
+AppDataUpClientDaemon* AppUpClientDaemonGetHandoffPeer(
+		Node* node,
+		NodeAddress peerId,
+		Node** peerNode);
+
+bool AppUpClientDaemonHandoffReachable(
+		Node* node,
+		AppDataUpClientDaemon* clientDaemonPtr,
+		Node* peerNode,
+		AppDataUpClientDaemon* peerPtr);
+
+void AppUpClientDaemonHandoffCheck(
+		Node* node,
+		AppDataUpClientDaemon* clientDaemonPtr);
+
+void AppUpClientDaemonHandoffEnd(
+		Node* node,
+		AppDataUpClientDaemon* clientDaemonPtr);
+
+bool AppUpClientDaemonHandoffNext(
+		Node* node,
+		AppDataUpClientDaemon* clientDaemonPtr);
+
+void AppUpClientDaemonHandoffDone(
+		Node* node,
+		AppDataUpClientDaemon* clientDaemonPtr,
+		int chunkIdentifier,
+		bool delivered);
+
+void AppUpClientDaemonAdoptChunk(
+		Node* node,
+		AppDataUpClientDaemon* clientDaemonPtr,
+		int chunkIdentifier);
+
+void AppUpClientDaemonAbstractTick(
+		Node* node,
+		AppDataUpClientDaemon* clientDaemonPtr);
+
+void AppUpClientDaemonTimelineJoin(
+		Node* node,
+		AppDataUpClientDaemon* clientDaemonPtr,
+		int aId,
+		clocktype scanStart,
+		clocktype authStart,
+		clocktype assocStart);
+
+void AppUpClientDaemonTimelineSession(
+		Node* node,
+		AppDataUpClientDaemon* clientDaemonPtr,
+		AppDataUpClient* clientPtr,
+		clocktype uploadTime,
+		Int64 itemLength);
+
+void AppUpClientDaemonTimelineComp(
+		Node* node,
+		AppDataUpClientDaemon* clientDaemonPtr);
+
+void AppUpClientDaemonTimelineClose(
+		Node* node,
+		AppDataUpClientDaemon* clientDaemonPtr);
+
+void AppUpClientDaemonTimelinePrint(
+		Node* node,
+		AppDataUpClientDaemon* clientDaemonPtr);
+
+void AppUpStatsRecordSession(
+		Node* node,
+		AppUpStats* stats,
+		const char* role,
+		int chunkIdentifier,
+		int aId,
+		Int32 bytes,
+		clocktype time);
+
+void AppUpStatsRecordDeadline(
+		AppUpStats* stats,
+		bool met);
+
+void AppUpStatsPrint(
+		Node* node,
+		AppUpStats* stats,
+		const char* role);
+
+float AppUpRateHintToGoodput(double phyRate, double rssMean);
+
+void AppUpClientDaemonApplyRateHint(
+		Node* node,
+		AppDataUpClientDaemon* clientDaemonPtr,
+		double phyRate,
+		double rssMean);
+
+bool AppUpClientDaemonHasBacklog(
+		Node* node,
+		AppDataUpClientDaemon* clientDaemonPtr);
+
+double AppUpClientDaemonSpeedControl(
+		Node* node,
+		AppDataUpClientDaemon* clientDaemonPtr,
+		CoordinateType distance,
+		double speed);
+
 void AppUpClientDaemonMobilityModelProcess(
 		Node* node,
 		AppDataUpClientDaemon* clientDaemonPtr,
@@ -334,6 +950,51 @@ bool AppUpClientDaemonCheckStop(
 		AppDataUpClientDaemon* clientDaemonPtr,
 		bool timeoutFlag);
 
+float AppUpClientDaemonPlanContactTime(
+		AppDataUpClientDaemon* clientDaemonPtr,
+		int aId);
+
+void AppUpClientDaemonRecordContactTimes(
+		AppDataUpClientDaemon* clientDaemonPtr);
+
+void AppUpClientDaemonPlanSnapshot(
+		Node* node,
+		AppDataUpClientDaemon* clientDaemonPtr,
+		AppUpPlanSnapshot* snapshot);
+
+int AppUpClientDaemonPlanApply(
+		Node* node,
+		AppDataUpClientDaemon* clientDaemonPtr,
+		map<int, int>* planNew);
+
+void AppUpClientDaemonRecordReplan(
+		Node* node,
+		AppDataUpClientDaemon* clientDaemonPtr,
+		const char* reason,
+		int numChunks,
+		int numChanged,
+		double computeTime);
+
+void* AppUpAsyncPlanWorker(void* arg);
+
+void AppUpClientDaemonReplanJoin(
+		AppDataUpClientDaemon* clientDaemonPtr,
+		AppUpAsyncPlanJob* job);
+
+bool AppUpClientDaemonReplanAsync(
+		Node* node,
+		AppDataUpClientDaemon* clientDaemonPtr,
+		const char* reason);
+
+void AppUpClientDaemonReplan(
+		Node* node,
+		AppDataUpClientDaemon* clientDaemonPtr,
+		const char* reason);
+
+void AppUpClientDaemonCheckRateDeviation(
+		Node* node,
+		AppDataUpClientDaemon* clientDaemonPtr);
+
 void AppUpClientDaemonCompAtA(
 		Node* node,
 		AppDataUpClientDaemon* clientDaemonPtr,
@@ -354,6 +1015,121 @@ bool AppUpClientDaemonIsAtLastA(Node* node,
 // Dynamic data half range, must be greater than 1e-4 and less than 1
 #define APP_UP_DATA_HALF_RANGE_PERCENT (0.5)
 
+// Split chunks at MDC into segments that fit the predicted contact
+//#define APP_UP_SEGMENTATION
+const int APP_UP_SEGMENT_SIZE_MIN = 1024; // KB
+const float APP_UP_SEGMENT_FILL_RATIO = 0.8;
+
+// Let urgent chunks preempt ongoing upload at MDC
+//#define APP_UP_PREEMPTION
+const float APP_UP_PREEMPT_HYSTERESIS = 0.5; // Required relative value gain
+const float APP_UP_PREEMPT_HOLD_TIME = 10.0; // Between two preemptions
+const float APP_UP_PREEMPT_MIN_TIME_LEFT = 2.0;
+const Int32 APP_UP_CLIENT_SEND_BLOCK_SIZE = 1024 * 1024;
+
+// Adapt time spent at AP stops to backlog and cost to later stops
+//#define APP_UP_DWELL_CONTROL
+const float APP_UP_DWELL_EXTEND_FACTOR = 2.0;
+const float APP_UP_DWELL_SHORTEN_FACTOR = 0.5;
+const int APP_UP_DWELL_TIMEOUT_MIN = 5;
+const int APP_UP_DWELL_TIMEOUT_MAX = 60;
+const int APP_UP_DWELL_EXTEND_MAX = 300; // Since arrival at stop
+
+// Adjust speed between stops within each leg's time budget
+//#define APP_UP_SPEED_CONTROL
+const double APP_UP_SPEED_MIN = 0.5; // m/s
+const double APP_UP_SPEED_MAX = 30.0; // m/s
+const double APP_UP_SPEED_SLOW_FACTOR = 0.5;
+const double APP_UP_SPEED_FAST_FACTOR = 1.5;
+
+// Re-assign pending chunks to remaining APs as measured rates come in
+//#define APP_UP_REPLAN
+const float APP_UP_REPLAN_RATE_DEVIATION = 0.3;
+
+// Plan on a worker thread, the result is applied on the simulation
+// thread at a fixed delay from the request so that runs stay repeatable,
+// only used with APP_UP_REPLAN
+//#define APP_UP_REPLAN_ASYNC
+const double APP_UP_REPLAN_ASYNC_DELAY = 0.1; // Seconds
+
+// Predict contact end from path and learned join/leave radii
+//#define APP_UP_CONTACT_PREDICTION
+const float APP_UP_CONTACT_RADIUS_DEFAULT = 100.0; // Meters
+const float APP_UP_CONTACT_PRIOR_WEIGHT = 3.0; // Observations
+
+// Per-AP rate summaries kept across runs in UP-RATE-MODEL-FILE, if given
+#define APP_UP_RATE_MODEL_MAGIC "UP-RATE-MODEL"
+const int APP_UP_RATE_MODEL_VERSION = 1;
+const double APP_UP_RATE_MODEL_DECAY = 0.9; // Per stored run
+const double APP_UP_RATE_MODEL_PRIOR_WEIGHT = 1.0; // Spec as observations
+const double APP_UP_RATE_MODEL_N_MAX = 20.0;
+
+// Goodput prior from PHY rate and RSS reported by MAC
+const float APP_UP_RATE_HINT_EFFICIENCY = 0.5; // MAC, IP and TCP overhead
+const double APP_UP_RATE_HINT_RSS_LOW = -85.0; // dBm
+const float APP_UP_RATE_HINT_RSS_LOW_FACTOR = 0.5;
+const float APP_UP_RATE_HINT_WEIGHT = 0.5; // Against spec prior
+
+// Backoff of connection retries, in seconds
+const double APP_UP_RETRY_DELAY_BASE = 0.5;
+const double APP_UP_RETRY_DELAY_MAX = 8.0;
+const double APP_UP_RETRY_JITTER = 0.25; // Fraction of delay
+
+// Random streams of a daemon, apart from rand() that drives the path
+enum {
+	APP_UP_SEED_RETRY,
+	APP_UP_SEED_LINK,
+	APP_UP_SEED_STREAMS
+};
+
+// Server sessions allocated at once when the pool runs dry
+const int APP_UP_SERVER_SLAB_SIZE = 64;
+
+// Every n-th session is written to up_sessions_<host>.out,
+// uncomment to enable
+//#define APP_UP_STATS_SESSION_SAMPLE 16
+
+// Histograms written at finalize, one CSV row per AP, policy and metric
+#define APP_UP_HIST_FILE_PREFIX "up_hist_"
+const double APP_UP_HIST_UNIT_TIME = 0.001; // Seconds
+const double APP_UP_HIST_UNIT_SIZE = 1.0 / 1024; // KB
+const double APP_UP_HIST_UNIT_RATE = 0.01; // KB/s
+
+// Per-contact phase breakdown written to up_timeline_<host>.csv,
+// uncomment to enable
+//#define APP_UP_CONTACT_TIMELINE
+
+// Cloud keeps first delivery of each chunk, duplicates are recorded as
+// RECV DUPL; MDCs skip chunks the cloud holds, synced at each AP contact
+// Only a cloud on the MDC's own partition is seen
+//#define APP_UP_CLOUD_DEDUP
+
+// MDCs sharing an AP hand chunks they cannot upload on their own path to
+// an MDC with spare upload capacity ahead, by plan and contact predictions
+// Peers failing to take a chunk are backed off, then dropped
+// Only peers on the MDC's own partition are considered
+//#define APP_UP_HANDOFF
+const double APP_UP_HANDOFF_CHECK = 5.0; // Seconds
+const CoordinateType APP_UP_HANDOFF_RANGE = 100; // Meters
+const double APP_UP_HANDOFF_BACKOFF_MAX = 120.0; // Seconds
+const int APP_UP_HANDOFF_FAIL_MAX = 4; // Peer is dropped after this many
+
+// Data sites stream pending chunks back to back over one connection to
+// the MDC, each item framed by its own header
+//#define APP_UP_DATA_SITE_BURST
+
+// Abstract link model of MDC to AP contacts, selected per scenario by
+// UP-LINK-MODEL ABSTRACT, UP-LINK-RATE-CURVE-FILE overrides the curve
+// Not validated against FULL yet, up_bench.py --compare-link-models runs
+// both on the same scenarios and reports the differences
+const double APP_UP_ABSTRACT_TICK = 0.5; // Seconds
+const double APP_UP_ABSTRACT_JOIN_DELAY = 1.0; // Scan to association
+const double APP_UP_ABSTRACT_SESSION_OVERHEAD = 0.2; // TCP open and close
+const double APP_UP_ABSTRACT_RATE_JITTER = 0.1; // Fraction, per tick
+const int APP_UP_ABSTRACT_CURVE_POINTS = 5;
+const double APP_UP_ABSTRACT_CURVE_DISTANCE[] = {0, 30, 60, 90, 120};
+const float APP_UP_ABSTRACT_CURVE_RATE[] = {2500, 2000, 1200, 500, 100};
+
 double AppUpRand(const int& rand_mod);
 double AppUpUniDist(const double& l, const double& r, double x);
 double AppUpExpDist(const double& lambda, double x);
@@ -0,0 +1,492 @@
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <map>
+#include <vector>
+#include <algorithm>
+
+#include "app_up_policy.h"
+
+const AppUpPolicyEntry APP_UP_POLICIES[] = {
+	{"OPPORTUNITY", APP_UP_ADAPTION_OPPORTUNITY, AppUpPolicyEverything, false},
+	{"STRICT_PLAN", APP_UP_ADAPTION_STRICT_PLAN, AppUpPolicyStrictPlan, false},
+	{"TIMELINE",    APP_UP_ADAPTION_TIMELINE,    AppUpPolicyTimeline,   true},
+	{"ADAPTIVE_GP", APP_UP_ADAPTION_ADAPTIVE_GP, AppUpPolicyAdaptiveGP, true},
+	{"CONTROL_TH",  APP_UP_ADAPTION_CONTROL_TH,  AppUpPolicyControlTh,  true},
+	{NULL,          APP_UP_ADAPTION_UNINITIALIZED, NULL,                false}
+};
+
+const AppUpPolicyEntry* AppUpPolicyFind(const char* name) {
+	if(strcmp(name, "EVERYTHING") == 0) name = "OPPORTUNITY";
+	for(const AppUpPolicyEntry* entry = APP_UP_POLICIES;
+			entry->name;
+			++entry) {
+		if(strcmp(entry->name, name) == 0) return entry;
+	}
+	return NULL;
+}
+
+const AppUpPolicyEntry* AppUpPolicyFindById(AppUpAdaptionPolicy policy) {
+	for(const AppUpPolicyEntry* entry = APP_UP_POLICIES;
+			entry->name;
+			++entry) {
+		if(entry->policy == policy) return entry;
+	}
+	return NULL;
+}
+
+float AppUpObjectiveF(float delay) {
+	if(delay > 0) {
+		return exp(-delay / APP_UP_OBJECTIVE_F_HALFLIFE * log(2.0));
+	}
+	return 1.0;
+}
+
+int AppUpPolicyChunkSizeLeft(AppUpClientDaemonDataChunkStr* chunkPtr) {
+	return chunkPtr->size - chunkPtr->sizeDone;
+}
+
+/*
+ * Size in KB that the next upload of a chunk will carry
+ */
+int AppUpPolicyChunkSizeNext(
+		AppUpPolicyState* state,
+		AppUpClientDaemonDataChunkStr* chunkPtr) {
+	int sizeLeft = AppUpPolicyChunkSizeLeft(chunkPtr);
+
+	if(state->segmentSize > 0 && state->segmentSize < sizeLeft) {
+		return state->segmentSize;
+	}
+	return sizeLeft;
+}
+
+int AppUpPolicyEverything(AppUpPolicyState* state) {
+	int chunkId = -1;
+	int chunkDeadline = -1;
+	float chunkPriority = 0.0;
+
+	for(AppUpClientDaemonDataChunkStr* chunkPtr = state->dataChunks;
+			chunkPtr;
+			chunkPtr = chunkPtr->next) {
+		if(chunkPtr->dirty == 0) {
+			if(chunkId < 0 || chunkPriority < chunkPtr->priority
+					|| (chunkPriority == chunkPtr->priority
+							&& chunkDeadline > chunkPtr->deadline)) {
+				chunkId = chunkPtr->identifier;
+				chunkDeadline = chunkPtr->deadline;
+				chunkPriority = chunkPtr->priority;
+			}
+		}
+	}
+	return chunkId;
+}
+
+int AppUpPolicyStrictPlan(AppUpPolicyState* state) {
+	std::map<int, int>* plan = state->plan;
+	int joinedAId = state->joinedAId;
+	int chunkId = -1;
+	int chunkDeadline = -1;
+	float chunkPriority = 0.0;
+
+	if(joinedAId < 1) return chunkId; // -1
+	for(AppUpClientDaemonDataChunkStr* chunkPtr = state->dataChunks;
+			chunkPtr;
+			chunkPtr = chunkPtr->next) {
+		if(plan->count(chunkPtr->identifier) > 0
+		&& plan->at(chunkPtr->identifier) == joinedAId
+		&& chunkPtr->dirty == 0) {
+			if(chunkId < 0 || chunkPriority < chunkPtr->priority
+					|| (chunkPriority == chunkPtr->priority
+							&& chunkDeadline > chunkPtr->deadline)) {
+				chunkId = chunkPtr->identifier;
+				chunkDeadline = chunkPtr->deadline;
+				chunkPriority = chunkPtr->priority;
+			}
+		}
+	}
+	return chunkId;
+}
+
+int AppUpPolicyTimeline(AppUpPolicyState* state) {
+	int joinedAId = state->joinedAId;
+	int chunkId = -1;
+	std::map<int, int>* plan = state->plan;
+	int numChunksThisAId = 0;
+	float estCompTime = state->estCompTime;
+
+	if(joinedAId < 1) return chunkId; // -1
+	for(std::map<int, int>::iterator it = plan->begin();
+			it != plan->end();
+			++it) {
+		if(it->second == joinedAId) {
+			++numChunksThisAId;
+		}
+	}
+
+	bool left = false;
+	int chunkDeadline = -1;
+	float chunkPriority = 0.0;
+
+	for(AppUpClientDaemonDataChunkStr* chunkPtr = state->dataChunks;
+			chunkPtr;
+			chunkPtr = chunkPtr->next) {
+		if(plan->count(chunkPtr->identifier) > 0
+		&& plan->at(chunkPtr->identifier) == joinedAId
+		&& (chunkPtr->dirty & 2) == 0) {
+			// This chunk is planned here and not uploaded yet
+			left = true;
+			if((chunkPtr->dirty & 1) != 0)
+				continue;
+		} else continue;
+
+		// Do not choose it if completion time is to be exceeded
+		if(state->currentTime
+				+ AppUpPolicyChunkSizeNext(state, chunkPtr)
+					/ state->currentRate
+			> estCompTime + APP_UP_GNDC_TIMELINE_GRACE_PERIOD) {
+			continue;
+		}
+
+		if(chunkId < 1 || chunkPriority < chunkPtr->priority
+				|| (chunkPriority == chunkPtr->priority
+						&& chunkDeadline > chunkPtr->deadline)) {
+			chunkId = chunkPtr->identifier;
+			chunkDeadline = chunkPtr->deadline;
+			chunkPriority = chunkPtr->priority;
+		}
+	}
+	if(chunkId > 0) return chunkId;
+
+	if(!left) { // All chunks in plan are uploaded
+		bool chunkMeetDeadline = false;
+		int chunkSize = -1;
+
+		for(AppUpClientDaemonDataChunkStr* chunkPtr = state->dataChunks;
+				chunkPtr;
+				chunkPtr = chunkPtr->next) {
+			float estUpTime = state->currentTime
+					+ AppUpPolicyChunkSizeLeft(chunkPtr)
+						/ state->currentRate;
+			float estSegTime = state->currentTime
+					+ AppUpPolicyChunkSizeNext(state, chunkPtr)
+						/ state->currentRate;
+			bool meetDeadline = estUpTime <= chunkPtr->deadline;
+
+			// Do not choose it if completion time is to be exceeded
+			if(estSegTime > estCompTime) {
+				continue;
+			}
+
+			//Try to get a small chunk with high priority
+			if(chunkPtr->dirty == 0) {
+				if(chunkId < 1 || (!chunkMeetDeadline && meetDeadline)
+						|| chunkPriority < chunkPtr->priority
+						|| (chunkPriority == chunkPtr->priority
+								&& chunkSize > AppUpPolicyChunkSizeLeft(
+										chunkPtr))) {
+					chunkId = chunkPtr->identifier;
+					chunkPriority = chunkPtr->priority;
+					chunkSize = AppUpPolicyChunkSizeLeft(chunkPtr);
+				}
+			}
+		}
+	}
+	if(chunkId > 0) return chunkId;
+
+	// If this is last opportunity, upload everything
+	if(state->atLastA)
+		chunkId = AppUpPolicyEverything(state);
+	return chunkId;
+}
+
+int AppUpPolicyAdaptiveGP(AppUpPolicyState* state) {
+	int joinedAId = state->joinedAId;
+	int chunkId = -1;
+	std::map<int, int>* plan = state->plan;
+	std::map<int, AppUpAccessPointSpec*>* specs = state->specs;
+	int numChunksThisAId = 0;
+	float estCompTime = state->estCompTime;
+
+	// Evaluate history data
+	std::map<int, float>* history = state->historyRates;
+	int historyEvalDif1 = 0;
+	int historyEvalDif2 = 0;
+	int historyEvalComp =
+			round((state->currentRate - 300) / APP_UP_GNDC_RATE_STEP);
+
+	if(historyEvalComp < 0) historyEvalComp = 0;
+	if(history->size() > 0) {
+		std::vector<float> historyDiff;
+		float sumDiff = 0.0;
+
+		for(std::map<int, float>::iterator it = history->begin();
+				it != history->end();
+				++it) {
+			if(specs->count(it->first) > 0) {
+				historyDiff.push_back(it->second
+						- specs->at(it->first)->estRate);
+				sumDiff += round(fabs(it->second
+						- specs->at(it->first)->estRate)
+								/ APP_UP_GNDC_RATE_STEP);
+			}
+		}
+		for(int k = historyDiff.size() - 1; k >= 0; --k) {
+			if(round(historyDiff[k] / APP_UP_GNDC_RATE_STEP) < 0) {
+				historyEvalDif1 +=
+						round(historyDiff[k] / APP_UP_GNDC_RATE_STEP);
+			} else break;
+		}
+		if(historyEvalDif1 >= 0) {
+			historyEvalDif1 = historyDiff[historyDiff.size() - 1];
+		}
+		historyEvalDif2 = sumDiff / historyDiff.size();
+
+		// Evaluate actual rate history
+		std::vector<float> historyComp;
+		float sumComp = 0.0;
+
+		for(std::map<int, float>::iterator it = history->begin();
+				it != history->end();
+				++it) {
+			if(specs->count(it->first) > 0) {
+				historyComp.push_back(state->currentRate - it->second);
+				sumComp += round(state->currentRate - it->second)
+						/ APP_UP_GNDC_RATE_STEP;
+			}
+		}
+		historyEvalComp += sumComp / historyComp.size();
+	}
+
+	// Determine grace period
+	float gracePeriod = round(APP_UP_GNDC_ADAPTIVE_GRACE_PERIOD
+			* log2(numChunksThisAId + 1)
+			* (2 + abs(historyEvalDif1) + historyEvalDif2 * historyEvalComp));
+
+	if(joinedAId < 1) return chunkId; // -1
+	for(std::map<int, int>::iterator it = plan->begin();
+			it != plan->end();
+			++it) {
+		if(it->second == joinedAId) {
+			++numChunksThisAId;
+		}
+	}
+
+	bool left = false;
+	int chunkDeadline = -1;
+	float chunkPriority = 0.0;
+
+	for(AppUpClientDaemonDataChunkStr* chunkPtr = state->dataChunks;
+			chunkPtr;
+			chunkPtr = chunkPtr->next) {
+		if(plan->count(chunkPtr->identifier) > 0
+		&& plan->at(chunkPtr->identifier) == joinedAId
+		&& (chunkPtr->dirty & 2) == 0) {
+			// This chunk is planned here and not uploaded yet
+			left = true;
+			if((chunkPtr->dirty & 1) != 0)
+				continue;
+		} else continue;
+
+		// Do not choose it if completion time is to be exceeded
+		if(state->currentTime
+				+ AppUpPolicyChunkSizeNext(state, chunkPtr)
+					/ state->currentRate
+			> estCompTime + gracePeriod) {
+			continue;
+		}
+
+		if(chunkId < 1 || chunkPriority < chunkPtr->priority
+				|| (chunkPriority == chunkPtr->priority
+						&& chunkDeadline > chunkPtr->deadline)) {
+			chunkId = chunkPtr->identifier;
+			chunkDeadline = chunkPtr->deadline;
+			chunkPriority = chunkPtr->priority;
+		}
+	}
+	if(chunkId > 0) return chunkId;
+
+	if(!left) { // All chunks in plan are uploaded
+		bool chunkMeetDeadline = false;
+		int chunkSize = -1;
+
+		for(AppUpClientDaemonDataChunkStr* chunkPtr = state->dataChunks;
+				chunkPtr;
+				chunkPtr = chunkPtr->next) {
+			float estUpTime = state->currentTime
+					+ AppUpPolicyChunkSizeLeft(chunkPtr)
+						/ state->currentRate;
+			float estSegTime = state->currentTime
+					+ AppUpPolicyChunkSizeNext(state, chunkPtr)
+						/ state->currentRate;
+			bool meetDeadline = estUpTime <= chunkPtr->deadline;
+
+			// Do not choose it if completion time is to be exceeded
+			if(estSegTime > estCompTime
+					+ (historyEvalDif1 > 0 ? gracePeriod : 0)) {
+				continue;
+			}
+
+			//Try to get a small chunk with high priority
+			if(chunkPtr->dirty == 0) {
+				if(chunkId < 1 || (!chunkMeetDeadline && meetDeadline)
+						|| chunkPriority < chunkPtr->priority
+						|| (chunkPriority == chunkPtr->priority
+								&& chunkSize > AppUpPolicyChunkSizeLeft(
+										chunkPtr))) {
+					chunkId = chunkPtr->identifier;
+					chunkPriority = chunkPtr->priority;
+					chunkSize = AppUpPolicyChunkSizeLeft(chunkPtr);
+				}
+			}
+		}
+	}
+	if(chunkId > 0) return chunkId;
+
+	// If this is last opportunity, upload everything
+	if(state->atLastA)
+		chunkId = AppUpPolicyEverything(state);
+	return chunkId;
+}
+
+int AppUpPolicyControlTh(AppUpPolicyState* state) {
+	int joinedAId = state->joinedAId;
+	int chunkId = -1;
+	float estCompTime = state->estCompTime;
+	float currentTime = state->currentTime;
+
+	if(joinedAId < 1) return chunkId; // -1
+
+	int queueSize = 0;
+
+	for(AppUpClientDaemonDataChunkStr* chunkPtr = state->dataChunks;
+			chunkPtr;
+			chunkPtr = chunkPtr->next) {
+		if(chunkPtr->dirty < 2)
+			++queueSize;
+	}
+
+	float chunkEval = 0.0;
+	float eval;
+	int sizeLeft;
+	int sizeNext;
+
+	for(AppUpClientDaemonDataChunkStr* chunkPtr = state->dataChunks;
+			chunkPtr;
+			chunkPtr = chunkPtr->next) {
+		if(chunkPtr->dirty > 0) continue;
+		sizeLeft = AppUpPolicyChunkSizeLeft(chunkPtr);
+		sizeNext = AppUpPolicyChunkSizeNext(state, chunkPtr);
+		eval = APP_UP_CONTROL_THEORY_K1 * queueSize * sizeLeft
+				+ chunkPtr->priority * AppUpObjectiveF(currentTime
+					+ sizeLeft / state->currentRate
+					- chunkPtr->deadline)
+				- APP_UP_CONTROL_THEORY_K3 * (currentTime - estCompTime)
+					* sizeNext / state->currentRate;
+		if(eval < 0) continue;
+		if(chunkId < 1 || eval > chunkEval) {
+			chunkId = chunkPtr->identifier;
+			chunkEval = eval;
+		}
+	}
+	if(chunkId > 0) return chunkId;
+
+	// If this is last opportunity, upload everything
+	if(state->atLastA)
+		chunkId = AppUpPolicyEverything(state);
+	return chunkId;
+}
+
+bool AppUpPlanChunkCompare(
+		const AppUpPlanChunk& a,
+		const AppUpPlanChunk& b) {
+	float densityA = a.priority / (a.sizeLeft > 0 ? a.sizeLeft : 1);
+	float densityB = b.priority / (b.sizeLeft > 0 ? b.sizeLeft : 1);
+
+	if(densityA != densityB) return densityA > densityB;
+	return a.deadline < b.deadline;
+}
+
+/*
+ * Assign pending chunks to remaining APs, greedy with one-swap repair
+ * Pure function of snapshot so that it can run off the event loop
+ * Chunks that fit at no AP are planned at 0, that is nowhere
+ */
+void AppUpPlanCompute(
+		const AppUpPlanSnapshot* snapshot,
+		std::map<int, int>* planOut) {
+	std::vector<AppUpPlanChunk> chunks(snapshot->chunks);
+	int numA = snapshot->aps.size();
+	int numD = chunks.size();
+	std::vector<float> capLeft(numA);
+	std::vector<std::vector<int> > members(numA);
+	std::vector<int> assigned(numD, -1);
+
+	if(numA < 1) return;
+	for(int a = 0; a < numA; ++a) {
+		capLeft[a] = snapshot->aps[a].capacity;
+	}
+	std::sort(chunks.begin(), chunks.end(), AppUpPlanChunkCompare);
+
+	// Earliest AP with room maximizes each chunk's objective
+	for(int d = 0; d < numD; ++d) {
+		for(int a = 0; a < numA; ++a) {
+			if(capLeft[a] >= chunks[d].sizeLeft) {
+				capLeft[a] -= chunks[d].sizeLeft;
+				members[a].push_back(d);
+				assigned[d] = a;
+				break;
+			}
+		}
+	}
+
+	// Repair, make room for a chunk by moving one cheaper chunk later
+	// A chunk with no later AP to go to is evicted to nowhere
+	for(int d = 0; d < numD; ++d) {
+		if(assigned[d] >= 0) continue;
+		for(int a = 0; a < numA && assigned[d] < 0; ++a) {
+			int numM = members[a].size();
+			float gainD = chunks[d].priority * AppUpObjectiveF(
+					snapshot->aps[a].compTime - chunks[d].deadline);
+
+			for(int k = numM - 1;
+					k >= 0 && k >= numM - APP_UP_REPLAN_REPAIR_SCAN;
+					--k) {
+				int e = members[a][k];
+				int b = -1;
+				float net;
+
+				if(capLeft[a] + chunks[e].sizeLeft < chunks[d].sizeLeft) {
+					continue;
+				}
+				for(int c = a + 1; c < numA; ++c) {
+					if(capLeft[c] >= chunks[e].sizeLeft) {
+						b = c;
+						break;
+					}
+				}
+				net = gainD - chunks[e].priority * AppUpObjectiveF(
+						snapshot->aps[a].compTime - chunks[e].deadline);
+				if(b >= 0) {
+					net += chunks[e].priority * AppUpObjectiveF(
+							snapshot->aps[b].compTime - chunks[e].deadline);
+				}
+				if(net <= 0) continue;
+
+				members[a][k] = d;
+				assigned[d] = a;
+				capLeft[a] += chunks[e].sizeLeft - chunks[d].sizeLeft;
+				assigned[e] = b;
+				if(b >= 0) {
+					capLeft[b] -= chunks[e].sizeLeft;
+					members[b].push_back(e);
+				}
+				break;
+			}
+		}
+	}
+
+	for(int d = 0; d < numD; ++d) {
+		(*planOut)[chunks[d].identifier] = assigned[d] >= 0
+				? snapshot->aps[assigned[d]].aId : 0;
+	}
+}
@@ -0,0 +1,117 @@
+#ifndef _UP_APP_POLICY_H
+#define _UP_APP_POLICY_H
+
+// Chunk selection policies of the UP daemon
+// Kept free of simulator types so they can be driven standalone
+
+#include <map>
+#include <vector>
+
+typedef struct struct_app_up_client_daemon_data_chunk_str {
+	int         identifier;
+	int         size; // KB
+	int         deadline;
+	float       priority;
+	char        dirty;
+	char        partial; // Upload was cut off in an earlier contact
+	int         sizeDone; // KB, delivered in completed segments
+	int         sizeSegment; // KB, 0 if not segmented
+	struct_app_up_client_daemon_data_chunk_str* next;
+} AppUpClientDaemonDataChunkStr;
+
+typedef enum enum_app_up_adaption_policy {
+	APP_UP_ADAPTION_UNINITIALIZED = -1,
+	APP_UP_ADAPTION_EVERYTHING,
+	APP_UP_ADAPTION_OPPORTUNITY = APP_UP_ADAPTION_EVERYTHING,
+	APP_UP_ADAPTION_STRICT_PLAN,
+	APP_UP_ADAPTION_TIMELINE,
+	APP_UP_ADAPTION_ADAPTIVE_GP,
+	APP_UP_ADAPTION_CONTROL_TH
+} AppUpAdaptionPolicy;
+
+typedef struct struct_app_up_access_point_spec {
+	int         estRate;
+	float       estCompTime;
+} AppUpAccessPointSpec;
+
+// Everything a policy reads to pick the next chunk
+typedef struct struct_app_up_policy_state {
+	AppUpClientDaemonDataChunkStr* dataChunks;
+	std::map<int, int>* plan;
+	std::map<int, AppUpAccessPointSpec*>* specs;
+	std::map<int, float>* historyRates;
+	int         joinedAId;
+	float       currentRate; // KB/s
+	double      currentTime; // Seconds
+	float       estCompTime; // Of joined AP, 0 if unknown
+	int         segmentSize; // KB, 0 if not segmented
+	bool        atLastA;
+} AppUpPolicyState;
+
+typedef int (*AppUpPolicyFunc)(AppUpPolicyState*);
+
+// Pending chunks and remaining APs, the input of a re-plan
+typedef struct struct_app_up_plan_chunk {
+	int         identifier;
+	int         sizeLeft; // KB
+	int         deadline;
+	float       priority;
+	int         planAId;
+} AppUpPlanChunk;
+
+typedef struct struct_app_up_plan_access_point {
+	int         aId;
+	float       capacity; // KB
+	float       compTime;
+} AppUpPlanAccessPoint;
+
+typedef struct struct_app_up_plan_snapshot {
+	float       currentTime;
+	std::vector<AppUpPlanChunk> chunks;
+	std::vector<AppUpPlanAccessPoint> aps; // In path order
+} AppUpPlanSnapshot;
+
+typedef struct struct_app_up_policy_entry {
+	const char* name; // As given in configuration
+	AppUpAdaptionPolicy policy;
+	AppUpPolicyFunc func;
+	bool        needsSpecs; // Configured with AP spec file
+} AppUpPolicyEntry;
+
+// Terminated by an entry with NULL name
+extern const AppUpPolicyEntry APP_UP_POLICIES[];
+
+const AppUpPolicyEntry* AppUpPolicyFind(const char* name);
+const AppUpPolicyEntry* AppUpPolicyFindById(AppUpAdaptionPolicy policy);
+
+float AppUpObjectiveF(float delay);
+
+int AppUpPolicyChunkSizeLeft(AppUpClientDaemonDataChunkStr* chunkPtr);
+
+int AppUpPolicyChunkSizeNext(
+		AppUpPolicyState* state,
+		AppUpClientDaemonDataChunkStr* chunkPtr);
+
+int AppUpPolicyEverything(AppUpPolicyState* state);
+int AppUpPolicyStrictPlan(AppUpPolicyState* state);
+int AppUpPolicyTimeline(AppUpPolicyState* state);
+int AppUpPolicyAdaptiveGP(AppUpPolicyState* state);
+int AppUpPolicyControlTh(AppUpPolicyState* state);
+
+bool AppUpPlanChunkCompare(
+		const AppUpPlanChunk& a,
+		const AppUpPlanChunk& b);
+
+void AppUpPlanCompute(
+		const AppUpPlanSnapshot* snapshot,
+		std::map<int, int>* planOut);
+
+const float APP_UP_OBJECTIVE_F_HALFLIFE = 30.0;
+const float APP_UP_GNDC_TIMELINE_GRACE_PERIOD = 60.0;
+const float APP_UP_GNDC_ADAPTIVE_GRACE_PERIOD = 10.0;
+const float APP_UP_GNDC_RATE_STEP = 50.0; // KB/s
+const float APP_UP_CONTROL_THEORY_K1 = 2e-6;
+const float APP_UP_CONTROL_THEORY_K3 = 1e-4;
+const int APP_UP_REPLAN_REPAIR_SCAN = 32; // Swap candidates per AP
+
+#endif
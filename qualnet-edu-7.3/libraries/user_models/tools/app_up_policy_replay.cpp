@@ -0,0 +1,371 @@
+// Trace driven evaluator of the UP chunk selection policies
+//
+// Replays the contacts an MDC recorded in up_timeline_<host>.csv, written
+// when APP_UP_CONTACT_TIMELINE is defined in app_up.h, against
+// registered policies without simulating the network. Each contact offers
+// its recorded window (join to leave) at its recorded goodput, chunks are
+// those the MDC was given in data files. Usage:
+//
+//   up_policy_replay [options] <timeline.csv> [policy ...]
+//
+//   -d <file>   Data file as read by data sites, repeatable
+//   -p <file>   Plan file, chunk to AP
+//   -s <file>   AP specification file
+//   -g <KB>     Segment size, 0 uploads whole chunks
+//   -o <s>      Overhead per upload session, seconds
+//   -r <KB/s>   Rate of contacts that carried no data
+//   -n <count>  Replays per policy, for timing
+//
+// Without policies all registered ones are evaluated. Chunks are assumed
+// to be on board from the start, the trace fixes contact times and rates.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <map>
+
+#include "app_up_policy.h"
+
+const int REPLAY_TIMELINE_FIELDS = 11; // Without delivered KB
+const double REPLAY_DEFAULT_RATE = 100.0; // KB/s
+
+typedef struct struct_replay_contact {
+	int         aId;
+	double      joinTime;
+	double      leaveTime;
+	double      rate; // KB/s, 0 if unknown
+} ReplayContact;
+
+typedef struct struct_replay_result {
+	int         delivered;
+	int         deadlinesMet;
+	int         partial;
+	double      objective;
+	double      priorities;
+	double      sizeDelivered; // KB
+} ReplayResult;
+
+typedef struct struct_replay_options {
+	int         segmentSize;
+	double      overhead;
+	double      defaultRate;
+	int         numReplays;
+} ReplayOptions;
+
+static double ReplayNow() {
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/*
+ * Reads rows "host,aId,join,scan,auth,assoc,handshake,transfer,idle,
+ * stopTimeout,leave[,KB]" in order of join time
+ */
+static bool ReplayReadTimeline(
+		const char* fileName,
+		std::vector<ReplayContact>* contacts) {
+	std::ifstream file(fileName);
+	std::string line;
+
+	if(!file.is_open()) return false;
+	while(std::getline(file, line)) {
+		std::vector<std::string> fields;
+		std::stringstream ss(line);
+		std::string field;
+		ReplayContact contact;
+		double transfer;
+
+		while(std::getline(ss, field, ',')) fields.push_back(field);
+		if((int)fields.size() < REPLAY_TIMELINE_FIELDS) continue;
+		contact.aId = atoi(fields[1].c_str());
+		contact.joinTime = atof(fields[2].c_str());
+		transfer = atof(fields[7].c_str());
+		contact.leaveTime = atof(fields[10].c_str());
+		contact.rate = 0.0;
+		if((int)fields.size() > REPLAY_TIMELINE_FIELDS && transfer > 0) {
+			contact.rate = atof(fields[11].c_str()) / transfer;
+		}
+		if(contact.aId < 1 || contact.leaveTime < contact.joinTime) continue;
+		contacts->push_back(contact);
+	}
+	return true;
+}
+
+static bool ReplayReadData(
+		const char* fileName,
+		std::vector<AppUpClientDaemonDataChunkStr>* chunks) {
+	std::ifstream file(fileName);
+	int numDataChunks = 0;
+	int linesRead = 0;
+	AppUpClientDaemonDataChunkStr chunk;
+
+	if(!file.is_open()) return false;
+	file >> numDataChunks;
+	memset(&chunk, 0, sizeof(chunk));
+	while(file >> chunk.identifier
+			>> chunk.size
+			>> chunk.deadline
+			>> chunk.priority) {
+		++linesRead;
+		if(chunk.identifier <= 0 || chunk.size <= 0 || chunk.deadline < 0
+				|| chunk.priority <= 0 || chunk.priority > 1) {
+			continue;
+		}
+		chunks->push_back(chunk);
+	}
+	return linesRead == numDataChunks;
+}
+
+static bool ReplayReadPlan(const char* fileName, std::map<int, int>* plan) {
+	std::ifstream file(fileName);
+	int numDataChunks = 0;
+	int idD, idA;
+
+	if(!file.is_open()) return false;
+	file >> numDataChunks;
+	while(file >> idD >> idA) (*plan)[idD] = idA;
+	return (int)plan->size() == numDataChunks;
+}
+
+static bool ReplayReadSpecs(
+		const char* fileName,
+		std::map<int, AppUpAccessPointSpec*>* specs) {
+	std::ifstream file(fileName);
+	int numA = 0;
+	int idA;
+	AppUpAccessPointSpec spec;
+
+	if(!file.is_open()) return false;
+	file >> numA;
+	while(file >> idA >> spec.estRate >> spec.estCompTime) {
+		if(idA <= 0 || spec.estRate <= 0 || spec.estCompTime <= 0) continue;
+		if(specs->count(idA) < 1) {
+			(*specs)[idA] = new AppUpAccessPointSpec(spec);
+		}
+	}
+	return true;
+}
+
+/*
+ * Rate the daemon would assume on joining, like its estimated rate
+ */
+static float ReplayEstRate(
+		AppUpPolicyState* state,
+		const ReplayContact& contact,
+		const ReplayOptions& options) {
+	if(state->historyRates->count(contact.aId) > 0
+			&& state->historyRates->at(contact.aId) > 0) {
+		return state->historyRates->at(contact.aId);
+	}
+	if(state->specs->count(contact.aId) > 0) {
+		return state->specs->at(contact.aId)->estRate;
+	}
+	return contact.rate > 0 ? contact.rate : options.defaultRate;
+}
+
+static void ReplayRun(
+		const AppUpPolicyEntry* entry,
+		const std::vector<ReplayContact>& contacts,
+		std::vector<AppUpClientDaemonDataChunkStr>* chunks,
+		std::map<int, int>* plan,
+		std::map<int, AppUpAccessPointSpec*>* specs,
+		const ReplayOptions& options,
+		ReplayResult* result) {
+	std::map<int, float> historyRates;
+	AppUpPolicyState state;
+	size_t i;
+
+	memset(result, 0, sizeof(ReplayResult));
+	for(i = 0; i < chunks->size(); i++) {
+		AppUpClientDaemonDataChunkStr* chunkPtr = &(*chunks)[i];
+
+		chunkPtr->dirty = 0;
+		chunkPtr->partial = 0;
+		chunkPtr->sizeDone = 0;
+		chunkPtr->sizeSegment = 0;
+		chunkPtr->next = i + 1 < chunks->size() ? &(*chunks)[i + 1] : NULL;
+		result->priorities += chunkPtr->priority;
+	}
+	state.dataChunks = chunks->empty() ? NULL : &(*chunks)[0];
+	state.plan = plan;
+	state.specs = specs;
+	state.historyRates = &historyRates;
+	state.segmentSize = options.segmentSize;
+
+	for(i = 0; i < contacts.size(); i++) {
+		const ReplayContact& contact = contacts[i];
+		double rate = contact.rate > 0 ? contact.rate : options.defaultRate;
+		double now = contact.joinTime;
+		double sizeTotal = 0.0;
+		double timeTotal = 0.0;
+
+		state.joinedAId = contact.aId;
+		state.currentRate = ReplayEstRate(&state, contact, options);
+		state.estCompTime = specs->count(contact.aId) > 0
+				? specs->at(contact.aId)->estCompTime : 0;
+		state.atLastA = i + 1 == contacts.size();
+		while(now < contact.leaveTime) {
+			AppUpClientDaemonDataChunkStr* chunkPtr = NULL;
+			int chunkId;
+			int sizeNext;
+			double upTime;
+
+			state.currentTime = now;
+			chunkId = entry->func(&state);
+			if(chunkId < 1) break;
+			for(chunkPtr = state.dataChunks;
+					chunkPtr && chunkPtr->identifier != chunkId;
+					chunkPtr = chunkPtr->next);
+			if(chunkPtr == NULL) break;
+
+			sizeNext = AppUpPolicyChunkSizeNext(&state, chunkPtr);
+			upTime = options.overhead + sizeNext / rate;
+			if(now + upTime > contact.leaveTime) { // Cut off by leaving
+				chunkPtr->partial = 1;
+				timeTotal += contact.leaveTime - now;
+				break;
+			}
+			now += upTime;
+			timeTotal += upTime;
+			sizeTotal += sizeNext;
+			chunkPtr->sizeDone += sizeNext;
+			if(AppUpPolicyChunkSizeLeft(chunkPtr) > 0) continue;
+
+			chunkPtr->dirty |= 2;
+			result->delivered++;
+			result->sizeDelivered += chunkPtr->size;
+			result->objective += chunkPtr->priority
+					* AppUpObjectiveF(now - chunkPtr->deadline);
+			if(now <= chunkPtr->deadline) result->deadlinesMet++;
+		}
+		// Same bookkeeping as the daemon on completing an AP
+		historyRates[contact.aId] = timeTotal > 0 ? sizeTotal / timeTotal : 0;
+	}
+	for(i = 0; i < chunks->size(); i++) {
+		if((*chunks)[i].dirty == 0 && (*chunks)[i].partial) result->partial++;
+	}
+}
+
+static void ReplayUsage() {
+	fprintf(stderr,
+			"usage: up_policy_replay [-d data]... [-p plan] [-s spec] "
+			"[-g segmentKB]\n"
+			"        [-o overhead] [-r rate] [-n replays] "
+			"<timeline.csv> [policy ...]\n");
+	exit(2);
+}
+
+int main(int argc, char** argv) {
+	std::vector<ReplayContact> contacts;
+	std::vector<AppUpClientDaemonDataChunkStr> chunks;
+	std::vector<const AppUpPolicyEntry*> entries;
+	std::map<int, int> plan;
+	std::map<int, AppUpAccessPointSpec*> specs;
+	ReplayOptions options;
+	int opt;
+
+	options.segmentSize = 0;
+	options.overhead = 0.0;
+	options.defaultRate = REPLAY_DEFAULT_RATE;
+	options.numReplays = 100;
+	while((opt = getopt(argc, argv, "d:p:s:g:o:r:n:")) != -1) {
+		switch(opt) {
+		case 'd':
+			if(!ReplayReadData(optarg, &chunks)) {
+				fprintf(stderr, "cannot read data file %s\n", optarg);
+				return 1;
+			}
+			break;
+		case 'p':
+			if(!ReplayReadPlan(optarg, &plan)) {
+				fprintf(stderr, "cannot read plan file %s\n", optarg);
+				return 1;
+			}
+			break;
+		case 's':
+			if(!ReplayReadSpecs(optarg, &specs)) {
+				fprintf(stderr, "cannot read spec file %s\n", optarg);
+				return 1;
+			}
+			break;
+		case 'g': options.segmentSize = atoi(optarg); break;
+		case 'o': options.overhead = atof(optarg); break;
+		case 'r': options.defaultRate = atof(optarg); break;
+		case 'n': options.numReplays = atoi(optarg); break;
+		default: ReplayUsage();
+		}
+	}
+	if(optind >= argc || options.numReplays < 1 || options.defaultRate <= 0) {
+		ReplayUsage();
+	}
+	if(!ReplayReadTimeline(argv[optind], &contacts)) {
+		fprintf(stderr, "cannot read timeline %s\n", argv[optind]);
+		return 1;
+	}
+	for(int i = optind + 1; i < argc; i++) {
+		const AppUpPolicyEntry* entry = AppUpPolicyFind(argv[i]);
+
+		if(entry == NULL) {
+			fprintf(stderr, "unknown policy %s\n", argv[i]);
+			return 1;
+		}
+		entries.push_back(entry);
+	}
+	if(entries.empty()) {
+		for(const AppUpPolicyEntry* entry = APP_UP_POLICIES;
+				entry->name;
+				++entry) {
+			entries.push_back(entry);
+		}
+	}
+
+	printf("# %d contacts, %d chunks, %d planned, %d specs\n",
+			(int)contacts.size(),
+			(int)chunks.size(),
+			(int)plan.size(),
+			(int)specs.size());
+	printf("%-12s %9s %9s %8s %12s %10s %12s\n",
+			"policy", "delivered", "deadlines", "partial",
+			"objective", "normalized", "replays/s");
+	for(size_t e = 0; e < entries.size(); e++) {
+		ReplayResult result;
+		double start;
+		double elapsed;
+
+		if(entries[e]->needsSpecs && specs.empty()) {
+			printf("%-12s needs an AP specification file\n",
+					entries[e]->name);
+			continue;
+		}
+		start = ReplayNow();
+		for(int i = 0; i < options.numReplays; i++) {
+			ReplayRun(entries[e], contacts, &chunks, &plan, &specs,
+					options, &result);
+		}
+		elapsed = ReplayNow() - start;
+		printf("%-12s %9d %9d %8d %12.4f %10.4f %12.1f\n",
+				entries[e]->name,
+				result.delivered,
+				result.deadlinesMet,
+				result.partial,
+				result.objective,
+				result.priorities > 0
+						? result.objective / result.priorities : 0.0,
+				elapsed > 0 ? options.numReplays / elapsed : 0.0);
+	}
+
+	for(std::map<int, AppUpAccessPointSpec*>::iterator it = specs.begin();
+			it != specs.end();
+			++it) {
+		delete it->second;
+	}
+	return 0;
+}
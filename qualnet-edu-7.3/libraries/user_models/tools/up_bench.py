@@ -0,0 +1,220 @@
+#!/usr/bin/env python
+"""Run UP scenarios of growing size and report simulator cost.
+
+Each size is given as N,M,K,C (data sites, APs, MDCs, chunks per site).
+For every size a scenario is generated with up_scenario_gen.py, the
+simulator is run on it and one CSV row is written with:
+
+  wall_s          Wall clock time of the run
+  sim_per_wall    Simulated seconds per wall clock second
+  events          UP records written by daemons and servers, or the
+                  kernel event count if the simulator prints one
+  events_per_s    events / wall_s
+  peak_rss_mb     Peak resident set size of the simulator process
+  delivered       Chunks received at the cloud
+  objective       Sum of priority * F(delay) over delivered chunks
+  objective_norm  objective over the sum of all chunk priorities
+
+F is the objective of the UP daemon, halving every 30 s past deadline.
+
+With --compare-link-models every scenario is run with UP-LINK-MODEL FULL
+and ABSTRACT. The ABSTRACT row then also has
+
+  delivered_delta       delivered minus that of the FULL run
+  objective_norm_delta  objective_norm minus that of the FULL run
+
+which is how the abstract link model is checked against full simulation.
+
+Usage:
+
+  up_bench.py --qualnet ./qualnet --base-config base.config \\
+      --size 4,2,1,4 --size 16,8,4,8 --size 64,32,16,16 -o bench
+"""
+
+import argparse
+import csv
+import glob
+import math
+import os
+import re
+import subprocess
+import sys
+import time
+
+import up_scenario_gen
+
+OBJECTIVE_F_HALFLIFE = 30.0  # As APP_UP_OBJECTIVE_F_HALFLIFE
+RECORD = re.compile(r"^(\S+) (\S+) (RECV DATA|RECV PART|SENT DATA|SENT PART) "
+                    r"(\d+) AT TIME (\S+)")
+KERNEL_EVENTS = re.compile(r"(\d+)\s+events", re.IGNORECASE)
+FIELDS = ("name", "sites", "aps", "mdcs", "chunks", "size_kb", "policy",
+          "link_model",
+          "sim_s", "wall_s", "sim_per_wall", "events", "events_per_s",
+          "peak_rss_mb", "delivered", "objective", "objective_norm",
+          "delivered_delta", "objective_norm_delta", "exit")
+
+
+def objective_f(delay):
+    if delay > 0:
+        return math.exp(-delay / OBJECTIVE_F_HALFLIFE * math.log(2.0))
+    return 1.0
+
+
+def score(run_dir, chunks):
+    """Returns (records, delivered, objective) from UP output files."""
+    records = 0
+    received = {}
+    for path in (glob.glob(os.path.join(run_dir, "server_*.out"))
+                 + glob.glob(os.path.join(run_dir, "daemon_*.out"))):
+        with open(path) as f:
+            for line in f:
+                match = RECORD.match(line)
+                if not match:
+                    continue
+                records += 1
+                role, _, kind, chunkId, at = match.groups()
+                if role == "CLOUD" and kind == "RECV DATA":
+                    chunkId = int(chunkId)
+                    at = float(at)
+                    received[chunkId] = min(at, received.get(chunkId, at))
+    objective = 0.0
+    for c in chunks:
+        if c["id"] in received:
+            objective += c["priority"] * objective_f(
+                received[c["id"]] - c["deadline"])
+    return records, len(received), objective
+
+
+def run(qualnet, run_dir, name, timeout):
+    """Runs the simulator, returns (wall, peak RSS in MB, events, exit)."""
+    log = open(os.path.join(run_dir, name + ".log"), "w")
+    start = time.time()
+    proc = subprocess.Popen([qualnet, name + ".config"], cwd=run_dir,
+                            stdout=log, stderr=subprocess.STDOUT)
+    deadline = start + timeout if timeout > 0 else None
+    while True:
+        pid, status, usage = os.wait4(proc.pid, os.WNOHANG)
+        if pid:
+            break
+        if deadline and time.time() > deadline:
+            proc.kill()
+            pid, status, usage = os.wait4(proc.pid, 0)
+            break
+        time.sleep(0.05)
+    wall = time.time() - start
+    log.close()
+
+    # ru_maxrss is in KB on Linux and bytes on macOS
+    rss = usage.ru_maxrss / (1024.0 * 1024 if sys.platform == "darwin"
+                             else 1024.0)
+    events = None
+    with open(os.path.join(run_dir, name + ".log")) as f:
+        for line in f:
+            match = KERNEL_EVENTS.search(line)
+            if match:
+                events = int(match.group(1))
+    code = os.WEXITSTATUS(status) if os.WIFEXITED(status) else -1
+    return wall, rss, events, code
+
+
+def parse_size(text):
+    values = [int(v) for v in text.split(",")]
+    if len(values) != 4:
+        raise argparse.ArgumentTypeError("expected N,M,K,C: %s" % text)
+    return values
+
+
+def bench(args, qualnet, base, name, n, m, k, c):
+    """Generates and runs one scenario, returns its CSV row."""
+    run_dir = os.path.join(args.out, name)
+    scenario = up_scenario_gen.generate(args)
+    scenario["name"] = name
+    up_scenario_gen.write(scenario, run_dir, base)
+
+    wall, rss, events, code = run(qualnet, run_dir, name, args.timeout)
+    records, delivered, objective = score(run_dir, scenario["chunks"])
+    if events is None:
+        events = records
+    total = sum(ch["priority"] for ch in scenario["chunks"])
+    row = {
+        "name": name, "sites": n, "aps": m, "mdcs": k, "chunks": c,
+        "size_kb": sum(ch["size"] for ch in scenario["chunks"]),
+        "policy": args.policy, "link_model": args.link_model,
+        "sim_s": scenario["simTime"],
+        "wall_s": "%.3f" % wall,
+        "sim_per_wall": "%.3f" % (scenario["simTime"] / wall
+                                  if wall > 0 else 0),
+        "events": events,
+        "events_per_s": "%.1f" % (events / wall if wall > 0 else 0),
+        "peak_rss_mb": "%.1f" % rss,
+        "delivered": delivered,
+        "objective": "%.4f" % objective,
+        "objective_norm": "%.4f" % (objective / total if total > 0 else 0),
+        "delivered_delta": "",
+        "objective_norm_delta": "",
+        "exit": code,
+    }
+    print("%-32s wall=%8.2fs rss=%8.1fMB events/s=%10.1f "
+          "delivered=%d/%d objective=%s" % (
+              name, wall, rss, float(row["events_per_s"]),
+              delivered, len(scenario["chunks"]), row["objective_norm"]))
+    return row
+
+
+def main():
+    p = up_scenario_gen.parser()
+    p.description = "Benchmark UP scenarios of growing size"
+    p.add_argument("--qualnet", required=True, help="simulator binary")
+    p.add_argument("--size", type=parse_size, action="append",
+                   metavar="N,M,K,C", help="scenario size, repeatable")
+    p.add_argument("--repeat", type=int, default=1,
+                   help="runs per size, seeds counting up from --seed")
+    p.add_argument("--timeout", type=float, default=0,
+                   help="kill runs after this many seconds")
+    p.add_argument("--csv", default="up_bench.csv")
+    p.add_argument("--compare-link-models", action="store_true",
+                   help="run every scenario with FULL and ABSTRACT links")
+    args = p.parse_args()
+    qualnet = os.path.abspath(args.qualnet)
+    base = os.path.abspath(args.base_config) if args.base_config else None
+    sizes = args.size or [[args.sites, args.aps, args.mdcs, args.chunks]]
+    seed = args.seed
+    models = (["FULL", "ABSTRACT"] if args.compare_link_models
+              else [args.link_model])
+
+    if not os.path.isdir(args.out):
+        os.makedirs(args.out)
+    out = open(os.path.join(args.out, args.csv), "w")
+    writer = csv.DictWriter(out, FIELDS)
+    writer.writeheader()
+
+    for n, m, k, c in sizes:
+        for r in range(args.repeat):
+            full = None
+            for model in models:
+                args.sites, args.aps, args.mdcs, args.chunks = n, m, k, c
+                args.seed = seed + r
+                args.link_model = model
+                name = "%s_%d_%d_%d_%d_s%d" % (args.name, n, m, k, c,
+                                               args.seed)
+                if len(models) > 1:
+                    name += "_" + model.lower()
+                row = bench(args, qualnet, base, name, n, m, k, c)
+                if model == "FULL":
+                    full = row
+                elif full is not None:
+                    row["delivered_delta"] = (row["delivered"]
+                                              - full["delivered"])
+                    row["objective_norm_delta"] = "%.4f" % (
+                        float(row["objective_norm"])
+                        - float(full["objective_norm"]))
+                    print("%-32s delivered_delta=%d objective_norm_delta=%s"
+                          % (name, row["delivered_delta"],
+                             row["objective_norm_delta"]))
+                writer.writerow(row)
+                out.flush()
+    out.close()
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,307 @@
+#!/usr/bin/env python
+"""Generate UP scenarios of a given size.
+
+Lays out one cloud server, M access points, K MDCs and N data sites and
+writes everything the UP application reads:
+
+  <name>.app             UP lines (CLOUD, MDC, DATA)
+  <name>.nodes           Node positions
+  <name>.config          Base configuration with scenario keys replaced
+  <name>.json            Chunk manifest, used to score runs
+  path_<mdc>.txt         numStops, then "t x y numA [aIds] numD [chunkIds]"
+  plan_<mdc>.txt         numChunks, then "chunkId aId"
+  spec_<mdc>.txt         numAPs, then "aId estRate estCompTime"
+  data_<site>.txt        numChunks, then "id sizeKB deadline priority"
+
+Node ids are assigned in that order: 1 is the cloud, then APs, MDCs and
+data sites. AP ids follow the daemon's convention of the last two bytes
+of the BSS address, which equal the AP node id under default MAC address
+assignment.
+
+Usage:
+
+  up_scenario_gen.py -n 8 -m 4 -k 2 -c 16 --size-dist lognormal -o out
+"""
+
+import argparse
+import json
+import math
+import os
+import random
+
+CLOUD_ID = 1
+PRIORITIES = (0.3, 0.6, 1.0)
+POLICIES = ("OPPORTUNITY", "STRICT_PLAN", "TIMELINE", "ADAPTIVE_GP",
+            "CONTROL_TH")
+POLICIES_WITH_SPECS = ("TIMELINE", "ADAPTIVE_GP", "CONTROL_TH")
+
+# Keys replaced in the base configuration
+CONFIG_KEYS = ("EXPERIMENT-NAME", "SIMULATION-TIME", "TERRAIN-DIMENSIONS",
+               "NODE-PLACEMENT", "NODE-POSITION-FILE", "APP-CONFIG-FILE",
+               "SUBNET", "MAC-DOT11-AP", "UP-LINK-MODEL")
+
+
+def chunk_size(rng, dist, mean):
+    """Returns a chunk size in KB, at least 1."""
+    if dist == "fixed":
+        size = mean
+    elif dist == "uniform":
+        size = rng.uniform(0, 2 * mean)
+    elif dist == "lognormal":
+        sigma = 1.0
+        size = rng.lognormvariate(math.log(mean) - sigma * sigma / 2, sigma)
+    elif dist == "pareto":
+        alpha = 1.5
+        size = mean * (alpha - 1) / alpha * rng.paretovariate(alpha)
+    else:
+        raise ValueError("unknown size distribution: %s" % dist)
+    return max(1, int(size))
+
+
+def grid(count, width, height, rng, jitter):
+    """Spreads count points over the terrain on a near-square grid."""
+    cols = max(1, int(math.ceil(math.sqrt(count))))
+    rows = max(1, int(math.ceil(float(count) / cols)))
+    points = []
+    for i in range(count):
+        x = (i % cols + 0.5) * width / cols
+        y = (i // cols + 0.5) * height / rows
+        points.append((round(x + rng.uniform(-jitter, jitter), 1),
+                       round(y + rng.uniform(-jitter, jitter), 1)))
+    return points
+
+
+def nearest(point, candidates):
+    return min(candidates,
+               key=lambda c: math.hypot(c[1][0] - point[0],
+                                        c[1][1] - point[1]))
+
+
+def generate(args):
+    """Builds the scenario in memory, returns a dict describing it."""
+    rng = random.Random(args.seed)
+    width, height = args.terrain
+
+    first = CLOUD_ID + 1
+    ap_ids = list(range(first, first + args.aps))
+    first += args.aps
+    mdc_ids = list(range(first, first + args.mdcs))
+    first += args.mdcs
+    site_ids = list(range(first, first + args.sites))
+
+    jitter = min(width, height) * 0.05
+    ap_pos = dict(zip(ap_ids, grid(len(ap_ids), width, height, rng, jitter)))
+    site_pos = dict((s, (round(rng.uniform(0, width), 1),
+                         round(rng.uniform(0, height), 1)))
+                    for s in site_ids)
+    depot = (0.0, 0.0)
+
+    positions = {CLOUD_ID: depot}
+    positions.update(ap_pos)
+    positions.update(dict((m, depot) for m in mdc_ids))
+    positions.update(site_pos)
+
+    chunks = []
+    site_chunks = dict((s, []) for s in site_ids)
+    next_chunk = 1
+    for s in site_ids:
+        for _ in range(args.chunks):
+            chunk = {"id": next_chunk, "site": s,
+                     "size": chunk_size(rng, args.size_dist, args.size_mean),
+                     "priority": rng.choice(PRIORITIES)}
+            site_chunks[s].append(chunk)
+            chunks.append(chunk)
+            next_chunk += 1
+
+    # Sites are served round robin, each MDC visits its sites in order of
+    # angle around the depot and uploads at the nearest AP after each
+    mdcs = []
+    end = args.start
+    for k, m in enumerate(mdc_ids):
+        sites = [s for i, s in enumerate(site_ids) if i % len(mdc_ids) == k]
+        sites.sort(key=lambda s: math.atan2(site_pos[s][1], site_pos[s][0]))
+        stops = [{"t": args.start + k * args.stagger, "pos": depot,
+                  "aps": [], "chunks": []}]
+        plan = {}
+        specs = {}
+        now = stops[0]["t"]
+        here = depot
+        for s in sites:
+            legs = [(site_pos[s], [], [c["id"] for c in site_chunks[s]])]
+            if ap_ids:
+                aId, apPos = nearest(site_pos[s], list(ap_pos.items()))
+                legs.append((apPos, [aId], []))
+            for pos, aps, ids in legs:
+                travel = math.hypot(pos[0] - here[0], pos[1] - here[1])
+                leg = max(1.0, round(travel / args.speed, 1))
+                now += leg + args.dwell
+                here = pos
+                stops.append({"t": leg, "pos": pos, "aps": aps,
+                              "chunks": ids})
+                for a in aps:
+                    spec = specs.setdefault(a, [args.ap_rate, now])
+                    spec[1] = now
+                    for c in site_chunks[s]:
+                        plan[c["id"]] = a
+            for c in site_chunks[s]:
+                c["deadline"] = int(now + rng.uniform(*args.slack))
+                c["mdc"] = m
+        mdcs.append({"id": m, "stops": stops, "plan": plan, "specs": specs})
+        end = max(end, now)
+
+    sim_time = args.sim_time
+    if sim_time <= 0:
+        sim_time = int(end * 1.5) + 60
+    return {"name": args.name, "seed": args.seed, "cloud": CLOUD_ID,
+            "aps": ap_ids, "mdcs": mdcs, "sites": site_ids,
+            "positions": positions, "chunks": chunks,
+            "terrain": [width, height], "simTime": sim_time,
+            "policy": args.policy, "linkModel": args.link_model}
+
+
+def write_lines(path, count, lines):
+    with open(path, "w") as f:
+        f.write("%d\n" % count)
+        for line in lines:
+            f.write(line + "\n")
+
+
+def write_config(base, scenario, out):
+    """Copies the base configuration, replacing scenario specific keys."""
+    name = scenario["name"]
+    lines = []
+    if base:
+        with open(base) as f:
+            for line in f:
+                words = line.split()
+                key = words[0] if words else ""
+                if key.startswith("["):
+                    key = words[-2] if len(words) > 1 else ""
+                if key not in CONFIG_KEYS:
+                    lines.append(line.rstrip("\n"))
+    last = max(scenario["positions"])
+    lines += [
+        "",
+        "# Generated by up_scenario_gen.py",
+        "EXPERIMENT-NAME %s" % name,
+        "SIMULATION-TIME %dS" % scenario["simTime"],
+        "TERRAIN-DIMENSIONS (%d, %d)" % tuple(scenario["terrain"]),
+        "SUBNET N16-192.168.0.0 { 1 thru %d }" % last,
+        "NODE-PLACEMENT FILE",
+        "NODE-POSITION-FILE %s.nodes" % name,
+        "APP-CONFIG-FILE %s.app" % name,
+        "UP-LINK-MODEL %s" % scenario["linkModel"],
+    ]
+    for a in scenario["aps"]:
+        lines.append("[%d] MAC-DOT11-AP YES" % a)
+    with open(os.path.join(out, name + ".config"), "w") as f:
+        f.write("\n".join(lines) + "\n")
+
+
+def write(scenario, out, base=None):
+    if not os.path.isdir(out):
+        os.makedirs(out)
+    name = scenario["name"]
+    policy = scenario["policy"]
+    cloud = scenario["cloud"]
+
+    app = ["UP %d %d CLOUD" % (cloud, cloud)]
+    for mdc in scenario["mdcs"]:
+        m = mdc["id"]
+        path = "path_%d.txt" % m
+        plan = "plan_%d.txt" % m
+        spec = "spec_%d.txt" % m
+
+        write_lines(os.path.join(out, path), len(mdc["stops"]), [
+            "%.1f %.1f %.1f %d%s %d%s" % (
+                s["t"], s["pos"][0], s["pos"][1],
+                len(s["aps"]), "".join(" %d" % a for a in s["aps"]),
+                len(s["chunks"]), "".join(" %d" % c for c in s["chunks"]))
+            for s in mdc["stops"]])
+        if policy == "OPPORTUNITY":
+            plan = "-"
+        else:
+            write_lines(os.path.join(out, plan), len(mdc["plan"]),
+                        ["%d %d" % kv for kv in sorted(mdc["plan"].items())])
+        line = "UP %d %d MDC %s %s %s" % (m, cloud, path, plan, policy)
+        if policy in POLICIES_WITH_SPECS:
+            write_lines(os.path.join(out, spec), len(mdc["specs"]),
+                        ["%d %d %.1f" % (a, r, t) for a, (r, t)
+                         in sorted(mdc["specs"].items())])
+            line += " " + spec
+        app.append(line)
+
+    for s in scenario["sites"]:
+        chunks = [c for c in scenario["chunks"] if c["site"] == s]
+        if not chunks:
+            continue
+        data = "data_%d.txt" % s
+        write_lines(os.path.join(out, data), len(chunks), [
+            "%d %d %d %.1f" % (c["id"], c["size"], c["deadline"],
+                               c["priority"]) for c in chunks])
+        app.append("UP %d %d DATA %s" % (s, chunks[0]["mdc"], data))
+
+    with open(os.path.join(out, name + ".app"), "w") as f:
+        f.write("\n".join(app) + "\n")
+    with open(os.path.join(out, name + ".nodes"), "w") as f:
+        for n, (x, y) in sorted(scenario["positions"].items()):
+            f.write("%d 0 (%.1f, %.1f, 0)\n" % (n, x, y))
+    with open(os.path.join(out, name + ".json"), "w") as f:
+        json.dump({"name": name, "chunks": scenario["chunks"]}, f)
+    write_config(base, scenario, out)
+
+
+def parser():
+    p = argparse.ArgumentParser(description="Generate a UP scenario")
+    p.add_argument("-n", "--sites", type=int, default=4,
+                   help="number of data sites")
+    p.add_argument("-m", "--aps", type=int, default=2,
+                   help="number of access points")
+    p.add_argument("-k", "--mdcs", type=int, default=1,
+                   help="number of MDCs")
+    p.add_argument("-c", "--chunks", type=int, default=4,
+                   help="data chunks per data site")
+    p.add_argument("--size-dist", default="lognormal",
+                   choices=("fixed", "uniform", "lognormal", "pareto"))
+    p.add_argument("--size-mean", type=float, default=2048,
+                   help="mean chunk size in KB")
+    p.add_argument("--slack", type=float, nargs=2, default=(60, 600),
+                   metavar=("MIN", "MAX"),
+                   help="deadline after planned upload, in seconds")
+    p.add_argument("--policy", default="STRICT_PLAN", choices=POLICIES)
+    p.add_argument("--link-model", default="FULL",
+                   choices=("FULL", "ABSTRACT"),
+                   help="MDC to AP contacts through the stack or abstracted")
+    p.add_argument("--ap-rate", type=int, default=500,
+                   help="estimated AP rate in KB/s for spec files")
+    p.add_argument("--speed", type=float, default=10.0,
+                   help="MDC speed in m/s")
+    p.add_argument("--dwell", type=float, default=15.0,
+                   help="assumed time spent at each stop in seconds")
+    p.add_argument("--start", type=float, default=10.0,
+                   help="MDC start time in seconds")
+    p.add_argument("--stagger", type=float, default=5.0,
+                   help="start offset between MDCs in seconds")
+    p.add_argument("--terrain", type=float, nargs=2, default=(1500, 1500),
+                   metavar=("X", "Y"))
+    p.add_argument("--sim-time", type=int, default=0,
+                   help="simulation time in seconds, 0 to derive from paths")
+    p.add_argument("--base-config",
+                   help="configuration with radio, MAC and routing settings")
+    p.add_argument("--name", default="up")
+    p.add_argument("--seed", type=int, default=1)
+    p.add_argument("-o", "--out", default=".")
+    return p
+
+
+def main():
+    args = parser().parse_args()
+    scenario = generate(args)
+    write(scenario, args.out, args.base_config)
+    print("%s: %d nodes, %d chunks, %d KB in %s" % (
+        args.name, len(scenario["positions"]), len(scenario["chunks"]),
+        sum(c["size"] for c in scenario["chunks"]), args.out))
+
+
+if __name__ == "__main__":
+    main()
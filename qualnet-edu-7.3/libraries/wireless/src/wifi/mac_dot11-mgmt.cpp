@@ -2897,10 +2897,15 @@ int MacDot11ManagementProcessDeauthenticate(
         result = DOT11_R_NOT_IMPLEMENTED;
 
     } else {  // STATION
-        ERROR_ReportError("MacDot11ManagementProcessDeauthenticate:"
-                          " AP mode deauthenticate not implimented.\n");
+        // Modifications
+        MacDot11Trace(node, dot11, rxFrame, "Receive");
+        MacDot11ManagementNotifyLinkLost(
+            node,
+            dot11,
+            DOT11_UP_LINK_LOST_DEAUTHENTICATE);
+        MacDot11ManagementReset(node, dot11);
 
-        result = DOT11_R_NOT_IMPLEMENTED;
+        result = DOT11_R_OK;
     }
 
     return result;
@@ -3909,10 +3914,15 @@ int MacDot11ManagementProcessDisassociate(
         result = DOT11_R_NOT_IMPLEMENTED;
 
     } else { // STATION
-        // TODO: Not supported yet...not sure how to do it
-        ERROR_ReportError("MacDot11ManagementProcessDisassociate:"
-                          " Station mode disassociation not implimented.\n");
-        result = DOT11_R_NOT_IMPLEMENTED;
+        // Modifications
+        // Drop the association and look for an AP again
+        MacDot11Trace(node, dot11, rxFrame, "Receive");
+        MacDot11ManagementNotifyLinkLost(
+            node,
+            dot11,
+            DOT11_UP_LINK_LOST_DISASSOCIATE);
+        MacDot11ManagementReset(node, dot11);
+        result = DOT11_R_OK;
     }
 
     return result;
@@ -4562,6 +4572,9 @@ int MacDot11ManagementAuthenticate(
         dot11,
         DOT11_S_M_WFAUTH);
 
+    // Modifications
+    dot11->upAuthStartTime = node->getNodeTime();
+
     if (!MacDot11IsAp(dot11))
         {
         dot11->mgmtSendResponse = FALSE;
@@ -4644,6 +4657,9 @@ int MacDot11ManagementAssociateRequest(
         dot11,
         DOT11_S_M_WFASSOC);
 
+    // Modifications
+    dot11->upAssocStartTime = node->getNodeTime();
+
     if (newFrameInfo->frameType == DOT11_ASSOC_REQ)
     {
         dot11->mgmtSendResponse = FALSE;
@@ -4705,6 +4721,12 @@ int MacDot11ManagementReassociateRequest(
 {
     int result = DOT11_R_FAILED;
 
+    // Modifications
+    MacDot11ManagementNotifyLinkLost(
+        node,
+        dot11,
+        DOT11_UP_LINK_LOST_REASSOCIATE);
+
     // dot11s. Reassociate in case of MAPs.
     // Alloc Association Request frame
     Message* msg = NULL;
@@ -4961,6 +4983,121 @@ void MacDot11AuthenticationCompleted(
     }
 
 } // MacDot11AuthenticationCompleted
+// Modifications
+//--------------------------------------------------------------------------
+/*!
+ * \brief  Report signal strength and data rate of associated AP to the
+ *         UP application.
+ *
+ * \param node      Node*           : Pointer to node
+ * \param dot11     MacDataDot11*   : Pointer to Dot11 structure
+ */
+//--------------------------------------------------------------------------
+void MacDot11ManagementNotifyRateHint(
+    Node* node,
+    MacDataDot11* dot11)
+{
+    Message* msg;
+    ActionData acnData;
+    MacDot11UpRateHint hint;
+    DOT11_DataRateEntry* rateEntry;
+    clocktype duration;
+
+    // No UP application on this node, nobody to tell
+    if (node->appData.upData == NULL || dot11->associatedAP == NULL)
+    {
+        return;
+    }
+
+    rateEntry = MacDot11StationGetDataRateEntry(
+        node,
+        dot11,
+        dot11->bssAddr);
+    if (dot11->isHTEnable)
+    {
+        MAC_PHY_TxRxVector txVector = rateEntry->txVector;
+        txVector.length = (size_t)DOT11_UP_RATE_HINT_FRAME_SIZE;
+        duration = PHY_GetTransmissionDuration(
+            node, dot11->myMacData->phyNumber, txVector);
+    }
+    else
+    {
+        duration = PHY_GetTransmissionDuration(
+            node,
+            dot11->myMacData->phyNumber,
+            rateEntry->dataRateType,
+            DOT11_UP_RATE_HINT_FRAME_SIZE);
+    }
+
+    hint.bssAddr = dot11->bssAddr;
+    hint.rssMean = dot11->associatedAP->rssMean;
+    hint.cinrMean = dot11->associatedAP->cinrMean;
+    hint.phyRate = 0.0;
+    if (duration > 0)
+    {
+        hint.phyRate = DOT11_UP_RATE_HINT_FRAME_SIZE * 8.0
+            / ((double)duration / SECOND);
+    }
+    dot11->upRateHintTime = node->getNodeTime();
+
+    msg = MESSAGE_Alloc(node,
+            APP_LAYER,
+            APP_UP_CLIENT_DAEMON,
+            MSG_APP_UP_FromMacRateHint);
+    MESSAGE_InfoAlloc(node, msg, sizeof(MacDot11UpRateHint));
+    memcpy(MESSAGE_ReturnInfo(msg), &hint, sizeof(MacDot11UpRateHint));
+
+    //Trace Information
+    acnData.actionType = SEND;
+    acnData.actionComment = NO_COMMENT;
+    TRACE_PrintTrace(node, msg, TRACE_MAC_LAYER,
+            PACKET_OUT, &acnData);
+    MESSAGE_Send(node, msg, (clocktype)0);
+}
+
+//--------------------------------------------------------------------------
+/*!
+ * \brief  Tell the UP application that the link to the associated AP is
+ *         gone, once per join.
+ *
+ * \param node      Node*           : Pointer to node
+ * \param dot11     MacDataDot11*   : Pointer to Dot11 structure
+ * \param reason    MacDot11UpLinkLostReason : Why the link was lost
+ */
+//--------------------------------------------------------------------------
+void MacDot11ManagementNotifyLinkLost(
+    Node* node,
+    MacDataDot11* dot11,
+    MacDot11UpLinkLostReason reason)
+{
+    Message* msg;
+    ActionData acnData;
+    MacDot11UpLinkLost linkLost;
+
+    if (!dot11->upLinkUp)
+    {
+        return;
+    }
+    dot11->upLinkUp = FALSE;
+
+    linkLost.bssAddr = dot11->bssAddr;
+    linkLost.reason = (int)reason;
+
+    msg = MESSAGE_Alloc(node,
+            APP_LAYER,
+            APP_UP_CLIENT_DAEMON,
+            MSG_APP_UP_FromMacLinkLost);
+    MESSAGE_InfoAlloc(node, msg, sizeof(MacDot11UpLinkLost));
+    memcpy(MESSAGE_ReturnInfo(msg), &linkLost, sizeof(MacDot11UpLinkLost));
+
+    //Trace Information
+    acnData.actionType = SEND;
+    acnData.actionComment = NO_COMMENT;
+    TRACE_PrintTrace(node, msg, TRACE_MAC_LAYER,
+            PACKET_OUT, &acnData);
+    MESSAGE_Send(node, msg, (clocktype)0);
+}
+
 //--------------------------------------------------------------------------
 /*!
  * \brief  Start scanning for BSS
@@ -5345,6 +5482,9 @@ int MacDot11ManagementJoinCompleted(
 			PACKET_OUT, &acnData);
 	MESSAGE_Send(node, msg, (clocktype)0);
 
+	dot11->upLinkUp = TRUE;
+	MacDot11ManagementNotifyRateHint(node, dot11);
+
     MacDot11ManagementSetState(
         node,
         dot11,
@@ -5645,6 +5785,9 @@ void MacDot11ManagementStartJoin(
 
     dot11->ScanStarted = TRUE;
 
+    // Modifications
+    dot11->upScanStartTime = node->getNodeTime();
+
     //No need to wait for 1.5 * beaconInterval as
     //as scanning precess is not started yet.
     //Wait randomly between 0-2 TU
@@ -6415,6 +6558,12 @@ void MacDot11ManagementReset(
     Node* node,
     MacDataDot11* dot11)
 {
+    // Modifications
+    MacDot11ManagementNotifyLinkLost(
+        node,
+        dot11,
+        DOT11_UP_LINK_LOST_RESET);
+
     if (dot11->state != DOT11_S_IDLE)
     {
         //set state to pending
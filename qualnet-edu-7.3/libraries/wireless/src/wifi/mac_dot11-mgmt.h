@@ -1198,5 +1198,15 @@ int MacDot11ManagementProcessAuthenticate(
     MacDataDot11* dot11,
     DOT11_Frame* rxFrame);
 
+// Modifications
+void MacDot11ManagementNotifyRateHint(
+    Node* node,
+    MacDataDot11* dot11);
+
+void MacDot11ManagementNotifyLinkLost(
+    Node* node,
+    MacDataDot11* dot11,
+    MacDot11UpLinkLostReason reason);
+
 
 #endif //MAC_DOT11_MGMT_H
@@ -935,6 +935,14 @@ void MacDot11ProcessBeacon(
             //This is beacon from my AP, update measurement
             MacDot11StationUpdateAPMeasurement(node, dot11, msg);
             MacDot11StationProcessBeacon(node, dot11, msg);
+
+            // Modifications
+            if (MacDot11IsStationJoined(dot11) &&
+                node->getNodeTime() - dot11->upRateHintTime
+                    >= DOT11_UP_RATE_HINT_INTERVAL)
+            {
+                MacDot11ManagementNotifyRateHint(node, dot11);
+            }
         }
 
         if (MacDot11IsAssociationDynamic(dot11) &&
@@ -3862,6 +3870,11 @@ void MacDot11Init(
     dot11->beaconIsDue = FALSE;
     dot11->beaconInterval = 0;
     dot11->beaconsMissed = 0;
+    dot11->upRateHintTime = 0;
+    dot11->upLinkUp = FALSE;
+    dot11->upScanStartTime = 0;
+    dot11->upAuthStartTime = 0;
+    dot11->upAssocStartTime = 0;
     dot11->stationCheckTimerStarted = FALSE;
 
     dot11->pktsToSend = 0;
@@ -1796,6 +1796,13 @@ struct MacDataDot11 {
     clocktype lastBeaconRecieve;           // Last beacon time
     unsigned int beaconsMissed;         // Number of missed beacons
 
+    // Modifications
+    clocktype upRateHintTime;           // Last rate hint sent to UP app
+    BOOL upLinkUp;                      // UP app was told about join
+    clocktype upScanStartTime;          // Join phases reported to UP app
+    clocktype upAuthStartTime;
+    clocktype upAssocStartTime;
+
 
     // Statistics collection variables.
     BOOL printApStatistics;             // Output AP stats?
@@ -3342,4 +3349,31 @@ void MacDot11ProcessMyFrame(
     MacDataDot11* dot11,
     Message* msg);
 
+// Modifications
+// Link quality of associated AP, reported to UP application
+typedef struct struct_mac_dot11_up_rate_hint {
+    Mac802Address bssAddr;
+    double rssMean;                     // avg RSS, in dBm
+    double cinrMean;                    // avg SINR, in dB
+    double phyRate;                     // bps, including PHY overhead
+} MacDot11UpRateHint;
+
+// Why link to associated AP was lost, reported to UP application
+typedef enum {
+    DOT11_UP_LINK_LOST_RESET,           // Beacon loss or failed exchange
+    DOT11_UP_LINK_LOST_DISASSOCIATE,
+    DOT11_UP_LINK_LOST_DEAUTHENTICATE,
+    DOT11_UP_LINK_LOST_REASSOCIATE
+} MacDot11UpLinkLostReason;
+
+typedef struct struct_mac_dot11_up_link_lost {
+    Mac802Address bssAddr;
+    int reason;                         // MacDot11UpLinkLostReason
+} MacDot11UpLinkLost;
+
+// Interval of rate hints while joined
+#define DOT11_UP_RATE_HINT_INTERVAL (1 * SECOND)
+// Frame size used to derive effective PHY rate
+#define DOT11_UP_RATE_HINT_FRAME_SIZE 1500
+
 #endif /*MAC_DOT11_H*/
@@ -1340,6 +1340,9 @@ APP_Initialize(Node *node, const NodeInput *nodeInput)
 
     node->appData.uniqueId = 0;
 
+    // Modifications
+    node->appData.upData = NULL;
+
     /* Setting up Border Gateway Protocol */
     node->appData.exteriorGatewayVar = NULL;
 
@@ -3441,7 +3444,8 @@ APP_InitializeApplications(
 							destNodeId,
 							appInput.inputStrings[i],
 							appNamePtr,
-							nodeType);
+							nodeType,
+							nodeInput);
 						AppUpServerInit(
 							node,
 							sourceAddr);
@@ -3471,7 +3475,8 @@ APP_InitializeApplications(
 							destNodeId,
 							appInput.inputStrings[i],
 							appNamePtr,
-							nodeType);
+							nodeType,
+							nodeInput);
 					}
                 	break; }
                 default: